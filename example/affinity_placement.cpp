@@ -0,0 +1,149 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+
+// Check coroutine placement against a synthetic coronet::topology of three
+// nodes, whatever the machine has. Coroutines are started on a thread_pool
+// built from it, with tokens given a node or a core by with_affinity and a
+// numa_allocator for that node. Each must run on a worker of that node,
+// await an operation placed on the next node, and be resumed on its own
+// node again. Each must also take its frame from its node's allocator.
+// Returns non-zero on any misplacement.
+//
+// usage: affinity_placement [coroutines per affinity]
+
+#include <coronet/affinity.hpp>
+#include <coronet/coronet.hpp>
+#include <coronet/thread_pool.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <thread>
+#include <vector>
+
+using pool_type = coronet::thread_pool;
+
+constexpr int nodes = 3;
+
+std::atomic<int> misplaced{0};
+std::atomic<long> allocated[nodes + 1];
+std::atomic<long> deallocated[nodes + 1];
+
+// A numa_allocator that counts what it hands out per node, with index 0
+// for "no preference".
+template<class T = void>
+struct counting_allocator : coronet::numa_allocator<T>
+{
+    counting_allocator() = default;
+    explicit counting_allocator(int node) noexcept
+      : coronet::numa_allocator<T>(node)
+    {}
+    template<class U>
+    counting_allocator(counting_allocator<U> const& that) noexcept
+      : coronet::numa_allocator<T>(that)
+    {}
+    T* allocate(std::size_t n)
+    {
+        ++allocated[this->node_ + 1];
+        return coronet::numa_allocator<T>::allocate(n);
+    }
+    void deallocate(T* p, std::size_t n) noexcept
+    {
+        ++deallocated[this->node_ + 1];
+        coronet::numa_allocator<T>::deallocate(p, n);
+    }
+};
+
+void
+expect_node(pool_type* pool, int node, char const* where)
+{
+    int const actual = pool->current_node();
+    if(actual != node && ++misplaced <= 10)
+        std::printf("%s: on node %d, expected %d\n", where, actual, node);
+}
+
+inline constexpr coronet::async where =
+    [](pool_type* pool, auto token) -> coronet::result_t<decltype(token),
+                                                         int(pool_type*)> {
+    INITIAL_SUSPEND(token);
+    co_return pool->current_node();
+};
+
+inline constexpr coronet::async placed =
+    [](pool_type* pool, int node,
+       auto token) -> coronet::result_t<decltype(token),
+                                        void(pool_type*, int)> {
+    INITIAL_SUSPEND(token);
+    expect_node(pool, node, "started");
+    if(coronet::get_affinity(token).node != node && ++misplaced <= 10)
+        std::printf("the token's affinity lost node %d\n", node);
+    int const next = (node + 1) % nodes;
+    auto const there = coronet::with_affinity(
+        coronet::yield(pool->get_executor()), coronet::affinity{next});
+    if(co_await where(pool, there) != next && ++misplaced <= 10)
+        std::printf("awaited on the wrong node, expected %d\n", next);
+    expect_node(pool, node, "resumed");
+};
+
+int
+main(int argc, char* argv[])
+{
+    int const count = argc > 1 ? std::atoi(argv[1]) : 100;
+    coronet::topology const topo{{{0, 1}, {2, 3}, {4, 5}}};
+    pool_type pool{topo, 2};
+    std::printf("detected %zu node(s); testing %zu synthetic nodes\n",
+                coronet::topology::detect().node_count(),
+                pool.topology().node_count());
+
+    std::atomic<int> done{0};
+    int started = 0;
+    std::vector<long> expected(nodes + 1);
+    for(int node = 0; node < nodes; ++node)
+    {
+        // The node itself, then each of its cores.
+        std::vector<coronet::affinity> affinities{{node, -1}};
+        for(int cpu : topo.cpus(static_cast<std::size_t>(node)))
+            affinities.push_back({-1, cpu});
+        for(auto const aff : affinities)
+        {
+            if(aff.core >= 0 && topo.node_of(aff.core) != node)
+                ++misplaced;
+            auto const token = coronet::with_affinity(
+                coronet::via(pool.get_executor(),
+                             counting_allocator<>{node}),
+                aff);
+            for(int i = 0; i < count; ++i, ++started)
+                placed(&pool, node, [&done](std::exception_ptr eptr) {
+                    if(eptr)
+                        ++misplaced;
+                    ++done;
+                } | token);
+            expected[node + 1] += count;
+        }
+    }
+    while(done.load() != started)
+        std::this_thread::yield();
+    pool.join();
+
+    for(int i = 0; i <= nodes; ++i)
+    {
+        std::printf("node %2d: %ld frames allocated, %ld freed\n", i - 1,
+                    allocated[i].load(), deallocated[i].load());
+        if(allocated[i] != expected[i] || deallocated[i] != expected[i])
+            ++misplaced;
+    }
+    std::printf("%d coroutines, %d misplaced\n", started, misplaced.load());
+    return misplaced != 0;
+}
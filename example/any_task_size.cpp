@@ -0,0 +1,132 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+
+// Compare the code size of async members that are templates over the
+// completion token with that of virtual members that take a
+// coronet::any_token and return a coronet::any_task. The same program is
+// built both ways, as any_task_size_template and any_task_size_erased:
+// a number of services, each with one async member, awaited from
+// coroutines that run with several different tokens. Each template member
+// is instantiated once per token type, and each virtual one once. Compare
+// the text sizes of the two builds with size(1).
+//
+// usage: any_task_size
+
+#include <coronet/any_task.hpp>
+#include <coronet/coronet.hpp>
+#include <coronet/manual_executor.hpp>
+
+#include <cstdio>
+#include <exception>
+#include <memory>
+#include <utility>
+
+#ifndef CORONET_ANY_TASK_SIZE_ERASED
+#define CORONET_ANY_TASK_SIZE_ERASED 1
+#endif
+
+constexpr std::size_t services = 24;
+
+#if CORONET_ANY_TASK_SIZE_ERASED
+template<std::size_t I>
+struct service_interface
+{
+    virtual ~service_interface() = default;
+    virtual coronet::any_task<int> async_op(int a,
+                                            coronet::any_token token) = 0;
+    auto async_op(int a)
+    {
+        return coronet::callable_with_implicit_context{
+            [this, a](auto token) {
+                return this->async_op(a, coronet::any_token{token});
+            }};
+    }
+};
+
+template<std::size_t I>
+struct service : service_interface<I>
+{
+    using service_interface<I>::async_op;
+    coronet::any_task<int> async_op(int a, coronet::any_token token) override
+    {
+        INITIAL_SUSPEND(token);
+        co_return a + static_cast<int>(I);
+    }
+};
+#else
+template<std::size_t I>
+struct service
+{
+    CO_PP_template(class Token)(
+        requires coronet::CompletionToken<Token>)
+    auto async_op(int a, Token token) -> coronet::result_t<Token, int(int)>
+    {
+        INITIAL_SUSPEND(token);
+        co_return a + static_cast<int>(I);
+    }
+    auto async_op(int a)
+    {
+        return coronet::callable_with_implicit_context{
+            [this, a](auto token) { return this->async_op(a, token); }};
+    }
+};
+#endif
+
+template<std::size_t... Is>
+struct all_services : service<Is>...
+{
+};
+
+template<std::size_t... Is>
+auto make_services(std::index_sequence<Is...>) -> all_services<Is...>;
+
+using services_type =
+    decltype(make_services(std::make_index_sequence<services>{}));
+
+// Await every service once. The token type of the awaited operations
+// depends on the allocator of Token.
+template<class Token, std::size_t... Is>
+auto
+await_all(services_type* s, int* sum, std::index_sequence<Is...>,
+          Token token) -> coronet::result_t<Token,
+                                            void(services_type*, int*,
+                                                 std::index_sequence<Is...>)>
+{
+    INITIAL_SUSPEND(token);
+    ((*sum += co_await static_cast<service<Is>*>(s)->async_op(1)), ...);
+}
+
+int
+main()
+{
+    coronet::manual_executor ex;
+    auto const e = ex.get_executor();
+    auto s = std::make_unique<services_type>();
+    int sum = 0;
+    constexpr auto indices = std::make_index_sequence<services>{};
+    auto const done = [](std::exception_ptr eptr) {
+        if(eptr)
+            std::rethrow_exception(eptr);
+    };
+    auto const start = [&](auto alloc) {
+        await_all(s.get(), &sum, indices, done | coronet::via(e, alloc));
+    };
+    start(std::allocator<int>{});
+    start(std::allocator<char>{});
+    start(std::allocator<long>{});
+    start(std::allocator<void>{});
+    ex.run();
+    std::printf("%s: %zu services, 4 token types, sum %d\n",
+                CORONET_ANY_TASK_SIZE_ERASED ? "erased" : "template",
+                services, sum);
+}
@@ -0,0 +1,101 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+
+// Run trees of nested coroutines, the shape one inbound request spawns,
+// with their frames allocated by std::allocator and by a fresh
+// coronet::arena_allocator per request, and report the time per request
+// and per frame. The root awaits a number of middle operations, each of
+// which awaits a number of leaves, all through implicit tokens, so only
+// the root is given an allocator. Everything runs on a
+// coronet::manual_executor, leaving out threads and the clock.
+//
+// usage: arena_bench [requests per tree size]
+
+#include <coronet/arena_allocator.hpp>
+#include <coronet/coronet.hpp>
+#include <coronet/manual_executor.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+
+using clock_type = std::chrono::steady_clock;
+
+inline constexpr coronet::async leaf =
+    [](int arg, auto token) -> coronet::result_t<decltype(token), int(int)> {
+    INITIAL_SUSPEND(token);
+    co_return arg + 1;
+};
+
+inline constexpr coronet::async middle =
+    [](int arg, int leaves,
+       auto token) -> coronet::result_t<decltype(token), int(int, int)> {
+    INITIAL_SUSPEND(token);
+    for(int i = 0; i < leaves; ++i)
+        arg = co_await leaf(arg);
+    co_return arg;
+};
+
+inline constexpr coronet::async request =
+    [](int middles, int leaves,
+       auto token) -> coronet::result_t<decltype(token), int(int, int)> {
+    INITIAL_SUSPEND(token);
+    int n = 0;
+    for(int i = 0; i < middles; ++i)
+        n = co_await middle(n, leaves);
+    co_return n;
+};
+
+template<class MakeAllocator>
+double
+bench(int requests, int middles, int leaves, MakeAllocator make_allocator)
+{
+    coronet::manual_executor ex;
+    long total = 0;
+    auto const t0 = clock_type::now();
+    for(int i = 0; i < requests; ++i)
+    {
+        request(middles, leaves,
+                [&total](std::exception_ptr, int n) { total += n; } |
+                    coronet::via(ex.get_executor(), make_allocator()));
+        ex.run_until_idle();
+    }
+    std::chrono::duration<double, std::nano> const ns = clock_type::now() - t0;
+    if(total != static_cast<long>(requests) * middles * leaves)
+        std::printf("wrong result\n");
+    return ns.count() / requests;
+}
+
+int
+main(int argc, char* argv[])
+{
+    int const requests = argc > 1 ? std::atoi(argv[1]) : 200000;
+    struct
+    {
+        int middles, leaves;
+    } const shapes[] = {{3, 2}, {5, 5}, {9, 10}};
+    std::printf("%6s %14s %14s %14s %14s\n", "frames", "std ns/req",
+                "arena ns/req", "std ns/frame", "arena ns/frame");
+    for(auto [middles, leaves] : shapes)
+    {
+        int const frames = 1 + middles * (1 + leaves);
+        auto const heap = bench(requests, middles, leaves,
+                                [] { return std::allocator<void>{}; });
+        auto const arena = bench(requests, middles, leaves, [] {
+            return coronet::arena_allocator<>{};
+        });
+        std::printf("%6d %14.0f %14.0f %14.1f %14.1f\n", frames, heap, arena,
+                    heap / frames, arena / frames);
+    }
+}
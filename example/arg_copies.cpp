@@ -0,0 +1,160 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+
+// Count the copies and moves that an argument of a coronet::async
+// operation goes through on its way into the coroutine frame, for each
+// kind of completion token, passing it as an lvalue and as an rvalue. The
+// frame's own copy of a by-value parameter accounts for one move in every
+// row. Operations that take move-only arguments are run too, to show that
+// they work with every token.
+//
+// usage: arg_copies
+
+#include <coronet/coronet.hpp>
+#include <coronet/manual_executor.hpp>
+#include <coronet/sender.hpp>
+
+#include <cstdio>
+#include <exception>
+#include <memory>
+#include <utility>
+
+inline int copies = 0;
+inline int moves = 0;
+
+struct counted
+{
+    int value = 1;
+
+    counted() = default;
+    counted(counted const& that) noexcept
+      : value(that.value)
+    {
+        ++copies;
+    }
+    counted(counted&& that) noexcept
+      : value(that.value)
+    {
+        ++moves;
+    }
+    counted& operator=(counted const&) = delete;
+};
+
+inline constexpr coronet::async take =
+    [](counted arg, auto token) -> coronet::result_t<decltype(token),
+                                                     int(counted)> {
+    INITIAL_SUSPEND(token);
+    co_return arg.value;
+};
+
+inline constexpr coronet::async take_unique =
+    [](std::unique_ptr<int> arg,
+       auto token) -> coronet::result_t<decltype(token),
+                                        int(std::unique_ptr<int>)> {
+    INITIAL_SUSPEND(token);
+    co_return *arg;
+};
+
+using executor_t = coronet::manual_executor::executor_type;
+
+struct receiver
+{
+    int* total;
+    void set_value(int v)
+    {
+        *total += v;
+    }
+    void set_error(std::exception_ptr)
+    {
+        std::terminate();
+    }
+};
+
+// Await make_op() from a coroutine, and count what it copies and moves.
+template<class MakeOp>
+void await_row(char const* name, executor_t e, coronet::manual_executor& ex,
+               MakeOp make_op)
+{
+    int total = 0;
+    auto driver = [&](auto token) -> coronet::result_t<decltype(token),
+                                                       void()> {
+        INITIAL_SUSPEND(token);
+        counted arg;
+        copies = moves = 0;
+        total += co_await make_op(arg);
+        std::printf("%-44s %8d %8d\n", name, copies, moves);
+    };
+    driver([](std::exception_ptr) {} | coronet::via(e));
+    ex.run();
+    if(total != 1)
+        std::printf("wrong result\n");
+}
+
+int
+main()
+{
+    coronet::manual_executor ex;
+    auto const e = ex.get_executor();
+    std::printf("%-44s %8s %8s\n", "", "copies", "moves");
+
+    await_row("co_await take(arg)", e, ex,
+              [](counted& arg) { return take(arg); });
+    await_row("co_await take(std::move(arg))", e, ex,
+              [](counted& arg) { return take(std::move(arg)); });
+    await_row("co_await take(arg, yield(e))", e, ex,
+              [e](counted& arg) { return take(arg, coronet::yield(e)); });
+    await_row("co_await take(std::move(arg), yield(e))", e, ex,
+              [e](counted& arg) {
+                  return take(std::move(arg), coronet::yield(e));
+              });
+    await_row("co_await take(arg, as_sender(e))", e, ex,
+              [e](counted& arg) { return take(arg, coronet::as_sender(e)); });
+    await_row("co_await take(std::move(arg), as_sender(e))", e, ex,
+              [e](counted& arg) {
+                  return take(std::move(arg), coronet::as_sender(e));
+              });
+    {
+        int total = 0;
+        counted arg;
+        copies = moves = 0;
+        take(arg, [&](std::exception_ptr, int v) { total += v; } |
+                      coronet::via(e));
+        std::printf("%-44s %8d %8d\n", "take(arg, fn | via(e))", copies,
+                    moves);
+        copies = moves = 0;
+        take(std::move(arg), [&](std::exception_ptr, int v) { total += v; } |
+                                 coronet::via(e));
+        std::printf("%-44s %8d %8d\n", "take(std::move(arg), fn | via(e))",
+                    copies, moves);
+        ex.run();
+        if(total != 2)
+            std::printf("wrong result\n");
+    }
+
+    int total = 0;
+    await_row("co_await take_unique(p)", e, ex, [](counted&) {
+        return take_unique(std::make_unique<int>(1));
+    });
+    await_row("co_await take_unique(p, yield(e))", e, ex, [e](counted&) {
+        return take_unique(std::make_unique<int>(1), coronet::yield(e));
+    });
+    take_unique(std::make_unique<int>(1),
+                [&](std::exception_ptr, int v) { total += v; } |
+                    coronet::via(e));
+    auto op = take_unique(std::make_unique<int>(1), coronet::as_sender(e))
+                  .connect(receiver{&total});
+    op.start();
+    ex.run();
+    if(total != 2)
+        std::printf("wrong result\n");
+}
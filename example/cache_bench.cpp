@@ -0,0 +1,175 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+
+// Put many concurrent clients in front of a slow backend, each asking for
+// keys drawn from a Zipf distribution, so that a few keys are asked for
+// all the time. Compare calling the backend for every request with
+// coalescing concurrent requests for a key through coronet::single_flight
+// and with caching values in a coronet::async_cache. Each row reports the
+// requests served per second and how many of them reached the backend.
+//
+// usage: cache_bench [clients] [requests per client] [keys] [threads]
+
+#include <coronet/async_cache.hpp>
+#include <coronet/coronet.hpp>
+#include <coronet/net.hpp>
+#include <experimental/io_context>
+#include <experimental/timer>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace net = std::experimental::net;
+using clock_type = std::chrono::steady_clock;
+
+constexpr std::chrono::microseconds backend_latency{200};
+
+struct settings
+{
+    int clients = 256;
+    int requests = 2000;
+    std::size_t keys = 100000;
+    int threads = 4;
+};
+
+std::atomic<long> backend_calls{0};
+
+// The backend takes a while to answer, without keeping a thread busy.
+inline constexpr coronet::async fetch =
+    [](std::uint64_t key, net::io_context* ctx,
+       auto token) -> coronet::result_t<decltype(token),
+                                        std::uint64_t(std::uint64_t,
+                                                      net::io_context*)> {
+    INITIAL_SUSPEND(token);
+    backend_calls.fetch_add(1, std::memory_order_relaxed);
+    net::steady_timer timer{*ctx, backend_latency};
+    co_await coronet::async_wait(timer);
+    co_return key * 2654435761u;
+};
+
+// Draws keys in [0, n) with probability proportional to 1 / (rank + 1).
+struct zipf
+{
+    std::vector<double> cdf;
+
+    explicit zipf(std::size_t n)
+      : cdf(n)
+    {
+        double sum = 0;
+        for(std::size_t i = 0; i < n; ++i)
+            cdf[i] = sum += 1.0 / static_cast<double>(i + 1);
+        for(auto& c : cdf)
+            c /= sum;
+    }
+    template<class Rng>
+    std::uint64_t operator()(Rng& rng) const
+    {
+        auto const u = std::uniform_real_distribution<double>{}(rng);
+        return static_cast<std::uint64_t>(
+            std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin());
+    }
+};
+
+// The parameters live in the coroutine frame; a lambda's captures would
+// not outlive the full expression that starts it.
+inline constexpr coronet::async client =
+    [](zipf const* keys, int requests, unsigned seed, auto* get,
+       std::uint64_t* checksum,
+       auto token) -> coronet::result_t<decltype(token),
+                                        void(zipf const*, int, unsigned,
+                                             decltype(get),
+                                             std::uint64_t*)> {
+    INITIAL_SUSPEND(token);
+    std::minstd_rand rng{seed};
+    for(int i = 0; i < requests; ++i)
+        *checksum += co_await (*get)((*keys)(rng));
+};
+
+template<class Get>
+void
+bench(char const* name, settings const& s, zipf const& keys,
+      net::io_context& ctx, Get get)
+{
+    std::atomic<int> done{0};
+    std::vector<std::uint64_t> checksums(s.clients);
+    backend_calls = 0;
+    auto const t0 = clock_type::now();
+    for(int c = 0; c < s.clients; ++c)
+        client(&keys, s.requests, static_cast<unsigned>(c + 1), &get,
+               &checksums[c],
+               [&done](std::exception_ptr) { ++done; } |
+                   coronet::via(ctx.get_executor()));
+    while(done.load() != s.clients)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    std::chrono::duration<double> const secs = clock_type::now() - t0;
+    auto const total = static_cast<double>(s.clients) * s.requests;
+    std::printf("%-14s %12.0f %14ld %9.2f%%\n", name, total / secs.count(),
+                backend_calls.load(),
+                100.0 * static_cast<double>(backend_calls.load()) / total);
+}
+
+int
+main(int argc, char* argv[])
+{
+    settings s;
+    if(argc > 1)
+        s.clients = std::atoi(argv[1]);
+    if(argc > 2)
+        s.requests = std::atoi(argv[2]);
+    if(argc > 3)
+        s.keys = static_cast<std::size_t>(std::atoi(argv[3]));
+    if(argc > 4)
+        s.threads = std::atoi(argv[4]);
+
+    net::io_context ctx;
+    auto guard = net::make_work_guard(ctx);
+    std::vector<std::thread> threads;
+    for(int i = 0; i < s.threads; ++i)
+        threads.emplace_back([&ctx] { ctx.run(); });
+
+    zipf const keys{s.keys};
+    std::printf("%d clients x %d requests, %zu Zipf keys, %d threads, "
+                "%dus backend\n",
+                s.clients, s.requests, s.keys, s.threads,
+                static_cast<int>(backend_latency.count()));
+    std::printf("%-14s %12s %14s %10s\n", "", "req/s", "backend calls",
+                "of reqs");
+
+    bench("backend only", s, keys, ctx,
+          [&ctx](std::uint64_t key) { return fetch(key, &ctx); });
+
+    auto flight = coronet::make_single_flight<std::uint64_t, std::uint64_t>(
+        [&ctx](std::uint64_t key) { return fetch(key, &ctx); });
+    bench("single_flight", s, keys, ctx,
+          [&flight](std::uint64_t key) { return flight(key); });
+
+    coronet::async_cache<std::uint64_t, std::uint64_t> cache{
+        s.keys / 10, std::chrono::seconds(10)};
+    bench("async_cache", s, keys, ctx, [&](std::uint64_t key) {
+        return cache.async_get(
+            key, [&ctx](std::uint64_t k) { return fetch(k, &ctx); });
+    });
+
+    guard.reset();
+    for(auto& t : threads)
+        t.join();
+}
@@ -0,0 +1,128 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+
+// Measure the throughput of coronet::channel with one producer and one
+// consumer, many producers and one consumer, and many of each, for an
+// unbuffered and a buffered channel. Producers and consumers are
+// coroutines on an io_context run by a number of threads. The last
+// producer to finish closes the channel, and the consumers stop when
+// receiving fails.
+//
+// usage: channel_bench [messages] [producers/consumers] [threads]
+
+#include <coronet/channel.hpp>
+#include <coronet/coronet.hpp>
+#include <experimental/executor>
+#include <experimental/io_context>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace net = std::experimental::net;
+using clock_type = std::chrono::steady_clock;
+
+inline constexpr coronet::async producer =
+    [](coronet::channel<long>* ch, long messages, std::atomic<int>* left,
+       auto token) -> coronet::result_t<decltype(token),
+                                        void(coronet::channel<long>*, long,
+                                             std::atomic<int>*)> {
+    INITIAL_SUSPEND(token);
+    for(long i = 0; i < messages; ++i)
+        co_await ch->async_send(i);
+    if(left->fetch_sub(1) == 1)
+        ch->close();
+};
+
+inline constexpr coronet::async consumer =
+    [](coronet::channel<long>* ch, long* received,
+       auto token) -> coronet::result_t<decltype(token),
+                                        void(coronet::channel<long>*,
+                                             long*)> {
+    INITIAL_SUSPEND(token);
+    for(;;)
+    {
+        try
+        {
+            co_await ch->async_receive();
+        }
+        catch(coronet::channel_closed const&)
+        {
+            break;
+        }
+        ++*received;
+    }
+};
+
+void
+bench(char const* name, net::io_context& ctx, std::size_t capacity,
+      long messages, int producers, int consumers)
+{
+    coronet::channel<long> ch{capacity};
+    std::atomic<int> left{producers};
+    std::atomic<int> done{0};
+    std::vector<long> received(consumers);
+    auto const per_producer = messages / producers;
+    auto const t0 = clock_type::now();
+    for(int c = 0; c < consumers; ++c)
+        consumer(&ch, &received[c], [&done](std::exception_ptr) { ++done; } |
+                                        coronet::via(ctx.get_executor()));
+    for(int p = 0; p < producers; ++p)
+        producer(&ch, per_producer, &left,
+                 [&done](std::exception_ptr) { ++done; } |
+                     coronet::via(ctx.get_executor()));
+    while(done.load() != producers + consumers)
+        std::this_thread::yield();
+    std::chrono::duration<double> const secs = clock_type::now() - t0;
+    long total = 0;
+    for(auto r : received)
+        total += r;
+    if(total != per_producer * producers)
+        std::printf("lost messages\n");
+    std::printf("%-8s %9zu %12.0f msgs/s\n", name, capacity,
+                static_cast<double>(total) / secs.count());
+}
+
+int
+main(int argc, char* argv[])
+{
+    long const messages = argc > 1 ? std::atol(argv[1]) : 1000000;
+    int const n = argc > 2 ? std::atoi(argv[2]) : 4;
+    int const threads = argc > 3 ? std::atoi(argv[3]) : 4;
+
+    net::io_context ctx;
+    auto guard = net::make_work_guard(ctx);
+    std::vector<std::thread> io;
+    for(int i = 0; i < threads; ++i)
+        io.emplace_back([&ctx] { ctx.run(); });
+
+    std::printf("%ld messages, %d threads\n", messages, threads);
+    std::printf("%-8s %9s\n", "", "capacity");
+    for(std::size_t capacity : {std::size_t(0), std::size_t(64)})
+    {
+        bench("1:1", ctx, capacity, messages, 1, 1);
+        bench((std::to_string(n) + ":1").c_str(), ctx, capacity, messages,
+              n, 1);
+        bench((std::to_string(n) + ":" + std::to_string(n)).c_str(), ctx,
+              capacity, messages, n, n);
+    }
+
+    guard.reset();
+    for(auto& t : io)
+        t.join();
+}
@@ -0,0 +1,148 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+
+// Measure the error path of an async operation that fails by throwing a
+// std::system_error against one that returns coronet::expected, both when
+// a coroutine awaits it and when a callback is given the result. A run
+// where every operation succeeds is the baseline.
+//
+// usage: expected_bench [operations]
+
+#include <coronet/coronet.hpp>
+#include <coronet/expected.hpp>
+#include <coronet/manual_executor.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <system_error>
+
+using clock_type = std::chrono::steady_clock;
+
+// The operations that one coroutine awaits in a row. Without the tail
+// calls of an optimized build, each one that completes inline takes some
+// stack until the coroutine finishes.
+constexpr int batch = 1000;
+
+inline std::error_code const reset =
+    std::make_error_code(std::errc::connection_reset);
+
+inline constexpr coronet::async throwing =
+    [](bool fail, auto token) -> coronet::result_t<decltype(token),
+                                                   int(bool)> {
+    INITIAL_SUSPEND(token);
+    if(fail)
+        throw std::system_error(reset);
+    co_return 1;
+};
+
+inline constexpr coronet::async returning =
+    [](bool fail,
+       auto token) -> coronet::result_t<decltype(token),
+                                        coronet::expected<int>(bool)> {
+    INITIAL_SUSPEND(token);
+    if(fail)
+        co_return coronet::unexpected{reset};
+    co_return 1;
+};
+
+inline constexpr coronet::async await_throwing =
+    [](int n, bool fail, long* errors,
+       auto token) -> coronet::result_t<decltype(token),
+                                        void(int, bool, long*)> {
+    INITIAL_SUSPEND(token);
+    for(int i = 0; i < n; ++i)
+    {
+        try
+        {
+            co_await throwing(fail);
+        }
+        catch(std::system_error const&)
+        {
+            ++*errors;
+        }
+    }
+};
+
+inline constexpr coronet::async await_returning =
+    [](int n, bool fail, long* errors,
+       auto token) -> coronet::result_t<decltype(token),
+                                        void(int, bool, long*)> {
+    INITIAL_SUSPEND(token);
+    for(int i = 0; i < n; ++i)
+        if(!co_await returning(fail))
+            ++*errors;
+};
+
+template<class Run>
+void
+bench(char const* name, int n, bool fail, Run run)
+{
+    long errors = 0;
+    auto const t0 = clock_type::now();
+    run(&errors);
+    std::chrono::duration<double, std::nano> const ns = clock_type::now() - t0;
+    if(errors != (fail ? n : 0))
+        std::printf("wrong error count\n");
+    std::printf("%-34s %-8s %10.1f ns/op\n", name, fail ? "error" : "success",
+                ns.count() / n);
+}
+
+int
+main(int argc, char* argv[])
+{
+    int const n = argc > 1 ? std::atoi(argv[1]) : 200000;
+    coronet::manual_executor ex;
+    auto const e = ex.get_executor();
+    std::printf("%d operations\n", n);
+
+    for(bool fail : {false, true})
+    {
+        bench("co_await, throw system_error", n, fail,
+              [&](long* errors) {
+                  for(int i = 0; i < n; i += batch)
+                      await_throwing(
+                          (std::min)(batch, n - i), fail, errors,
+                          [](std::exception_ptr) {} | coronet::via(e));
+                  ex.run();
+              });
+        bench("co_await, return expected", n, fail,
+              [&](long* errors) {
+                  for(int i = 0; i < n; i += batch)
+                      await_returning(
+                          (std::min)(batch, n - i), fail, errors,
+                          [](std::exception_ptr) {} | coronet::via(e));
+                  ex.run();
+              });
+        bench("callback, exception_ptr", n, fail,
+              [&](long* errors) {
+                  for(int i = 0; i < n; ++i)
+                      throwing(fail,
+                               [errors](std::exception_ptr eptr, int) {
+                                   *errors += eptr != nullptr;
+                               } | coronet::via(e));
+                  ex.run();
+              });
+        bench("callback, error_code", n, fail,
+              [&](long* errors) {
+                  for(int i = 0; i < n; ++i)
+                      returning(fail,
+                                [errors](std::error_code ec, int) {
+                                    *errors += ec != std::error_code{};
+                                } | coronet::via(e));
+                  ex.run();
+              });
+    }
+}
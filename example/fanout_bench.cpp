@@ -0,0 +1,89 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+
+// Fan N operations out to an idle coronet::thread_pool, either all at
+// once with spawn_all, which hands the pool the N coroutine handles in
+// one bulk_post, or one at a time, each through a via(e) callback and a
+// post of its own. Each row reports the time per operation and the worker
+// wake-ups per round; a bulk_post wakes at most min(N, idle) workers.
+//
+// usage: fanout_bench [threads] [rounds]
+
+#include <coronet/coronet.hpp>
+#include <coronet/spawn.hpp>
+#include <coronet/thread_pool.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <thread>
+#include <vector>
+
+using clock_type = std::chrono::steady_clock;
+
+inline constexpr coronet::async touch =
+    [](std::atomic<int>* done,
+       auto token) -> coronet::result_t<decltype(token),
+                                        void(std::atomic<int>*)> {
+    INITIAL_SUSPEND(token);
+    ++*done;
+};
+
+template<class Start>
+void
+bench(char const* name, coronet::thread_pool& pool, int n, int rounds,
+      Start start)
+{
+    auto const before = pool.metrics();
+    std::chrono::nanoseconds total{};
+    for(int r = 0; r < rounds; ++r)
+    {
+        // Let the workers go idle, as between bursts of requests.
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        std::atomic<int> done{0};
+        auto const t0 = clock_type::now();
+        start(n, &done);
+        while(done.load() != n)
+            std::this_thread::yield();
+        total += clock_type::now() - t0;
+    }
+    auto const after = pool.metrics();
+    std::printf("%-10s %6d %12.1f ns/op %10.1f wakeups/round\n", name, n,
+                static_cast<double>(total.count()) / (double(n) * rounds),
+                static_cast<double>(after.wakeups - before.wakeups) /
+                    rounds);
+}
+
+int
+main(int argc, char* argv[])
+{
+    int const threads = argc > 1 ? std::atoi(argv[1]) : 4;
+    int const rounds = argc > 2 ? std::atoi(argv[2]) : 200;
+    coronet::thread_pool pool{static_cast<std::size_t>(threads)};
+    auto const e = pool.get_executor();
+    std::printf("%d threads, %d rounds\n", threads, rounds);
+
+    for(int n : {1, 16, 256, 4096})
+    {
+        bench("spawn_all", pool, n, rounds, [&](int n, std::atomic<int>* d) {
+            std::vector<decltype(touch(d))> ops(n, touch(d));
+            coronet::spawn_all(ops, coronet::yield(e));
+        });
+        bench("post each", pool, n, rounds, [&](int n, std::atomic<int>* d) {
+            for(int i = 0; i < n; ++i)
+                touch(d, [](std::exception_ptr) {} | coronet::via(e));
+        });
+    }
+}
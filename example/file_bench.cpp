@@ -0,0 +1,134 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+
+// Measure random-read throughput through coronet::file_service with each
+// backend, at several block sizes. A number of coroutines, all on one
+// io_context thread, keep that many reads in flight. The file is written
+// first, so unless the page cache is dropped between the two steps, this
+// measures the cost of the asynchronous machinery more than the disk.
+//
+// usage: file_bench [file] [megabytes] [reads in flight]
+
+#include <coronet/coronet.hpp>
+#include <coronet/file.hpp>
+#include <experimental/buffer>
+#include <experimental/executor>
+#include <experimental/io_context>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace net = std::experimental::net;
+using clock_type = std::chrono::steady_clock;
+
+// Make the given number of reads of block bytes each, at random offsets.
+inline constexpr coronet::async reader =
+    [](coronet::file_service* files, int fd, std::size_t size,
+       std::size_t block, int reads, unsigned seed,
+       auto token) -> coronet::result_t<decltype(token),
+                                        void(coronet::file_service*, int,
+                                             std::size_t, std::size_t, int,
+                                             unsigned)> {
+    INITIAL_SUSPEND(token);
+    std::vector<char> buf(block);
+    std::mt19937_64 rng{seed};
+    auto const blocks = size / block;
+    for(int i = 0; i < reads; ++i)
+        co_await files->async_read_at(fd, rng() % blocks * block,
+                                      net::buffer(buf));
+};
+
+void
+bench(char const* name, coronet::file_service& files, int fd,
+      std::size_t size, std::size_t block, int depth)
+{
+    net::io_context ctx;
+    auto guard = net::make_work_guard(ctx);
+    std::thread t{[&ctx] { ctx.run(); }};
+    // About a quarter of the file per run, and at least 64 reads each.
+    int const reads = static_cast<int>(
+        (std::max)(std::size_t(64), size / 4 / block / depth));
+    std::atomic<int> running{depth};
+    auto const start = clock_type::now();
+    for(int i = 0; i < depth; ++i)
+        reader(&files, fd, size, block, reads, static_cast<unsigned>(i),
+               [&running](std::exception_ptr e) {
+                   if(e)
+                       std::fprintf(stderr, "read failed\n");
+                   --running;
+               } | coronet::via(ctx.get_executor()));
+    while(running != 0)
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    std::chrono::duration<double> const secs = clock_type::now() - start;
+    guard.reset();
+    t.join();
+    double const n = static_cast<double>(reads) * depth;
+    std::printf("%-12s %8zu KiB %10.0f reads/s %10.1f MiB/s\n", name,
+                block / 1024, n / secs.count(),
+                n * static_cast<double>(block) / secs.count() / (1 << 20));
+}
+
+int
+main(int argc, char* argv[])
+{
+    char const* path = argc > 1 ? argv[1] : "file_bench.dat";
+    std::size_t const size =
+        (argc > 2 ? static_cast<std::size_t>(std::atoi(argv[2])) : 256) << 20;
+    int const depth = argc > 3 ? std::atoi(argv[3]) : 32;
+
+    int const fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
+    {
+        std::perror(path);
+        return 1;
+    }
+    std::vector<char> chunk(1 << 20, 'x');
+    for(std::size_t off = 0; off < size; off += chunk.size())
+        if(::pwrite(fd, chunk.data(), chunk.size(),
+                    static_cast<::off_t>(off)) < 0)
+        {
+            std::perror("pwrite");
+            return 1;
+        }
+    std::printf("%zu MiB file, %d reads in flight\n", size >> 20, depth);
+
+    std::vector<std::pair<char const*, coronet::file_service*>> services;
+    std::unique_ptr<coronet::file_service> uring;
+    try
+    {
+        uring = std::make_unique<coronet::file_service>(
+            coronet::file_service::backend::io_uring);
+        services.push_back({"io_uring", uring.get()});
+    }
+    catch(std::system_error const& e)
+    {
+        std::printf("io_uring unavailable: %s\n", e.what());
+    }
+    coronet::file_service pool{coronet::file_service::backend::thread_pool};
+    services.push_back({"thread_pool", &pool});
+
+    for(std::size_t block : {4 << 10, 16 << 10, 64 << 10, 256 << 10, 1 << 20})
+        for(auto [name, files] : services)
+            bench(name, *files, fd, size, block, depth);
+    ::close(fd);
+    ::unlink(path);
+}
@@ -0,0 +1,215 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+//
+
+// Load-test coronet::http_server over loopback with each of coronet's
+// executor options, and report requests per second and latency
+// percentiles. Each client connection sends a batch of pipelined requests
+// and waits for all of the responses before it sends the next batch.
+//
+// usage: http_bench [seconds] [connections] [pipeline depth] [threads]
+
+#include <coronet/coronet.hpp>
+#include <coronet/http.hpp>
+#include <coronet/thread_pool.hpp>
+#include <experimental/buffer>
+#include <experimental/internet>
+#include <experimental/io_context>
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace net = std::experimental::net;
+using tcp = net::ip::tcp;
+using clock_type = std::chrono::steady_clock;
+
+struct settings
+{
+    std::chrono::seconds duration{3};
+    int connections = 32;
+    int depth = 8;
+    int threads = 4;
+};
+
+struct load_result
+{
+    std::size_t requests = 0;
+    std::vector<double> latencies; // microseconds
+};
+
+// Count the complete responses at the front of buf and erase them.
+int
+consume_responses(std::string& buf)
+{
+    int n = 0;
+    std::size_t pos = 0;
+    for(;;)
+    {
+        auto const end = buf.find("\r\n\r\n", pos);
+        if(end == std::string::npos)
+            break;
+        std::string_view head(buf.data() + pos, end - pos);
+        std::size_t length = 0;
+        auto const cl = head.find("Content-Length: ");
+        if(cl != std::string_view::npos)
+            std::from_chars(head.data() + cl + 16,
+                            head.data() + head.size(), length);
+        if(buf.size() < end + 4 + length)
+            break;
+        pos = end + 4 + length;
+        ++n;
+    }
+    buf.erase(0, pos);
+    return n;
+}
+
+load_result
+run_load(tcp::endpoint endpoint, settings const& s)
+{
+    std::string batch;
+    for(int i = 0; i < s.depth; ++i)
+        batch += "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n";
+
+    load_result result;
+    std::mutex mtx;
+    auto const deadline = clock_type::now() + s.duration;
+    std::vector<std::thread> clients;
+    for(int c = 0; c < s.connections; ++c)
+        clients.emplace_back([&] {
+            net::io_context ctx;
+            tcp::socket socket{ctx};
+            socket.connect(endpoint);
+            socket.set_option(tcp::no_delay(true));
+            std::vector<double> latencies;
+            std::string in;
+            char buf[16 * 1024];
+            while(clock_type::now() < deadline)
+            {
+                auto const start = clock_type::now();
+                net::write(socket, net::buffer(batch));
+                for(int got = 0; got < s.depth;)
+                {
+                    in.append(buf, socket.read_some(net::buffer(buf)));
+                    int const n = consume_responses(in);
+                    auto const us =
+                        std::chrono::duration<double, std::micro>(
+                            clock_type::now() - start)
+                            .count();
+                    latencies.insert(latencies.end(), n, us);
+                    got += n;
+                }
+            }
+            std::lock_guard<std::mutex> lock{mtx};
+            result.requests += latencies.size();
+            result.latencies.insert(
+                result.latencies.end(), latencies.begin(), latencies.end());
+        });
+    for(auto& t : clients)
+        t.join();
+    return result;
+}
+
+void
+report(char const* name, settings const& s, load_result r)
+{
+    std::sort(r.latencies.begin(), r.latencies.end());
+    auto pct = [&](double p) {
+        if(r.latencies.empty())
+            return 0.0;
+        return r.latencies[static_cast<std::size_t>(
+            p * static_cast<double>(r.latencies.size() - 1))];
+    };
+    std::printf("%-28s %12.0f %10.1f %10.1f %10.1f\n", name,
+                static_cast<double>(r.requests) /
+                    static_cast<double>(s.duration.count()),
+                pct(0.5), pct(0.99), pct(0.999));
+}
+
+coronet::http_response
+hello(coronet::http_request const&)
+{
+    coronet::http_response res;
+    res.body = "Hello, world!\n";
+    return res;
+}
+
+// Serve on loopback, with connections running on whatever executor
+// make_executor returns, while io_threads threads run the io_context.
+template<class MakeExecutor>
+void
+bench(char const* name, settings const& s, int io_threads,
+      MakeExecutor make_executor)
+{
+    net::io_context ctx;
+    auto guard = net::make_work_guard(ctx);
+    coronet::http_server server{
+        ctx, tcp::endpoint{net::ip::address_v4::loopback(), 0}, hello};
+    std::vector<std::thread> io;
+    for(int i = 0; i < io_threads; ++i)
+        io.emplace_back([&ctx] { ctx.run(); });
+    {
+        auto ex = make_executor(ctx);
+        server.async_run([](std::exception_ptr) {} | coronet::via(ex));
+        report(name, s, run_load(server.local_endpoint(), s));
+        // Let the connections wind down before tearing the server down.
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        server.close();
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    guard.reset();
+    ctx.stop();
+    for(auto& t : io)
+        t.join();
+}
+
+int
+main(int argc, char* argv[])
+{
+    settings s;
+    if(argc > 1)
+        s.duration = std::chrono::seconds(std::atoi(argv[1]));
+    if(argc > 2)
+        s.connections = std::atoi(argv[2]);
+    if(argc > 3)
+        s.depth = std::atoi(argv[3]);
+    if(argc > 4)
+        s.threads = std::atoi(argv[4]);
+
+    std::printf("%d connections, pipeline depth %d, %d threads, %ds each\n",
+                s.connections, s.depth, s.threads,
+                static_cast<int>(s.duration.count()));
+    std::printf("%-28s %12s %10s %10s %10s\n", "executor", "req/s",
+                "p50 us", "p99 us", "p999 us");
+
+    bench("io_context, 1 thread", s, 1,
+          [](net::io_context& ctx) { return ctx.get_executor(); });
+
+    bench("io_context, N threads", s, s.threads,
+          [](net::io_context& ctx) { return ctx.get_executor(); });
+
+    coronet::thread_pool pool{static_cast<std::size_t>(s.threads)};
+    bench("thread_pool + 1 I/O thread", s, 1,
+          [&pool](net::io_context&) { return pool.get_executor(); });
+    pool.join();
+}
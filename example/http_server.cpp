@@ -0,0 +1,49 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+//
+
+#include <coronet/coronet.hpp>
+#include <coronet/http.hpp>
+#include <experimental/internet>
+#include <experimental/io_context>
+
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+
+namespace net = std::experimental::net;
+
+int
+main(int argc, char* argv[])
+{
+    unsigned short const port =
+        argc > 1 ? static_cast<unsigned short>(std::atoi(argv[1])) : 8080;
+
+    net::io_context ctx;
+    coronet::http_server server{
+        ctx, net::ip::tcp::endpoint{net::ip::tcp::v4(), port},
+        [](coronet::http_request const& req) {
+            coronet::http_response res;
+            if(req.target == "/")
+                res.body = "Hello, world!\n";
+            else
+                res.status = 404;
+            return res;
+        }};
+    std::printf("listening on port %d\n", server.local_endpoint().port());
+
+    // Accept and serve connections on this thread.
+    server.async_run([](std::exception_ptr) {} |
+                     coronet::via(ctx.get_executor()));
+    ctx.run();
+}
@@ -0,0 +1,186 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+
+// Issue many concurrent calls through one coronet::multiplexed_client over
+// loopback, to a server thread that answers the frames of each read in
+// reverse order, so that replies arrive out of order. Some requests are
+// large enough to span several reads. Every reply is checked against its
+// request, and the number of server reads shows how well the requests
+// were coalesced into writes. Then the client is closed, and a call after
+// that must fail.
+//
+// usage: multiplexed_loopback [calls] [max in flight]
+
+#include <coronet/coronet.hpp>
+#include <coronet/multiplexed_client.hpp>
+#include <coronet/thread_pool.hpp>
+#include <experimental/buffer>
+#include <experimental/internet>
+#include <experimental/io_context>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace net = std::experimental::net;
+using tcp = net::ip::tcp;
+using clock_type = std::chrono::steady_clock;
+using client_type = coronet::multiplexed_client<tcp>;
+
+constexpr std::size_t header_size = client_type::header_size;
+
+std::uint64_t
+get_be(char const* p, int n)
+{
+    std::uint64_t v = 0;
+    for(int i = 0; i < n; ++i)
+        v = (v << 8) | static_cast<unsigned char>(p[i]);
+    return v;
+}
+
+void
+put_be(char* p, std::uint64_t v, int n)
+{
+    for(int i = n - 1; i >= 0; --i, v >>= 8)
+        p[i] = static_cast<char>(v);
+}
+
+// Prefix every payload with "re:" and send the replies to each read's
+// frames last first, until the client hangs up.
+int
+serve(tcp::socket& socket)
+{
+    int reads = 0;
+    std::string in;
+    std::vector<char> buf(64 * 1024);
+    for(;;)
+    {
+        std::error_code ec;
+        auto const n = socket.read_some(net::buffer(buf), ec);
+        if(ec)
+            return reads;
+        ++reads;
+        in.append(buf.data(), n);
+        std::vector<std::pair<std::uint64_t, std::string>> frames;
+        std::size_t pos = 0;
+        while(in.size() - pos >= header_size)
+        {
+            auto const size = get_be(&in[pos], 4);
+            if(in.size() - pos < header_size + size)
+                break;
+            frames.emplace_back(get_be(&in[pos + 4], 8),
+                                in.substr(pos + header_size, size));
+            pos += header_size + size;
+        }
+        in.erase(0, pos);
+        std::string out;
+        for(auto it = frames.rbegin(); it != frames.rend(); ++it)
+        {
+            auto const reply = "re:" + it->second;
+            char header[header_size];
+            put_be(header, reply.size(), 4);
+            put_be(header + 4, it->first, 8);
+            out.append(header, header_size);
+            out += reply;
+        }
+        net::write(socket, net::buffer(out), ec);
+        if(ec)
+            return reads;
+    }
+}
+
+inline constexpr coronet::async call =
+    [](client_type* client, int i,
+       auto token) -> coronet::result_t<decltype(token),
+                                        bool(client_type*, int)> {
+    INITIAL_SUSPEND(token);
+    auto request = "request " + std::to_string(i);
+    if(i % 100 == 0)
+        request += std::string(3000, static_cast<char>('a' + i % 26));
+    auto const reply = co_await client->async_call(request);
+    co_return reply == "re:" + request;
+};
+
+int
+main(int argc, char* argv[])
+{
+    int const calls = argc > 1 ? std::atoi(argv[1]) : 5000;
+    std::size_t const in_flight =
+        argc > 2 ? static_cast<std::size_t>(std::atoi(argv[2])) : 64;
+
+    net::io_context ctx;
+    auto guard = net::make_work_guard(ctx);
+    tcp::acceptor acceptor{ctx,
+                           tcp::endpoint{net::ip::address_v4::loopback(), 0}};
+    std::atomic<int> server_reads{0};
+    std::thread server{[&] {
+        tcp::socket socket{ctx};
+        acceptor.accept(socket);
+        server_reads = serve(socket);
+    }};
+    std::thread io{[&ctx] { ctx.run(); }};
+
+    tcp::socket socket{ctx};
+    socket.connect(acceptor.local_endpoint());
+    coronet::thread_pool pool{4};
+    auto const e = pool.get_executor();
+    client_type::options opts;
+    opts.max_in_flight = in_flight;
+    client_type client{std::move(socket), opts};
+    std::atomic<bool> running{true};
+    client.async_run([&running](std::exception_ptr) {
+        running = false;
+    } | coronet::via(e));
+
+    std::atomic<int> done{0};
+    std::atomic<int> bad{0};
+    auto const t0 = clock_type::now();
+    for(int i = 0; i < calls; ++i)
+        call(&client, i, [&](std::exception_ptr eptr, bool ok) {
+            if(eptr || !ok)
+                ++bad;
+            ++done;
+        } | coronet::via(e));
+    while(done.load() != calls)
+        std::this_thread::yield();
+    std::chrono::duration<double> const secs = clock_type::now() - t0;
+
+    client.close();
+    std::atomic<int> after{0};
+    call(&client, 1, [&after](std::exception_ptr eptr, bool) {
+        after = eptr ? 1 : 2;
+    } | coronet::via(e));
+    while(running || after.load() == 0)
+        std::this_thread::yield();
+    server.join();
+
+    std::printf("%d calls, %zu in flight: %.0f calls/s, %d bad replies, "
+                "%d server reads\n",
+                calls, in_flight, calls / secs.count(), bad.load(),
+                server_reads.load());
+    std::printf("call after close: %s\n",
+                after == 1 ? "failed, as it should" : "succeeded");
+
+    guard.reset();
+    io.join();
+    pool.join();
+    return bad.load() == 0 && after == 1 ? 0 : 1;
+}
@@ -0,0 +1,145 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+
+// Measure a contended coronet::async_mutex against a std::mutex. Many
+// coroutines, on an io_context run by a number of threads, repeatedly take
+// the lock, do a little work while holding it, and do a little more
+// without it. With std::mutex a waiting coroutine blocks its thread; with
+// async_mutex it suspends, and its thread moves on to other coroutines.
+// Each row reports the critical sections completed per second.
+//
+// usage: mutex_bench [coroutines] [iterations] [threads] [work]
+
+#include <coronet/coronet.hpp>
+#include <coronet/synchronization.hpp>
+#include <experimental/executor>
+#include <experimental/io_context>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace net = std::experimental::net;
+using clock_type = std::chrono::steady_clock;
+
+// Something for the optimizer to leave alone, work iterations long.
+inline unsigned
+spin(unsigned seed, int work)
+{
+    for(int i = 0; i < work; ++i)
+        seed = seed * 1664525u + 1013904223u;
+    return seed;
+}
+
+struct shared_state
+{
+    unsigned value = 1;
+    long sections = 0;
+    std::atomic<unsigned> outside{0};
+};
+
+inline constexpr coronet::async async_worker =
+    [](coronet::async_mutex* m, shared_state* s, int iterations, int work,
+       auto token) -> coronet::result_t<decltype(token),
+                                        void(coronet::async_mutex*,
+                                             shared_state*, int, int)> {
+    INITIAL_SUSPEND(token);
+    unsigned local = 1;
+    for(int i = 0; i < iterations; ++i)
+    {
+        {
+            co_await m->async_lock();
+            std::lock_guard<coronet::async_mutex> g{*m, std::adopt_lock};
+            s->value = spin(s->value, work);
+            ++s->sections;
+        }
+        local = spin(local, work);
+    }
+    s->outside.fetch_add(local, std::memory_order_relaxed);
+};
+
+inline constexpr coronet::async blocking_worker =
+    [](std::mutex* m, shared_state* s, int iterations, int work,
+       auto token) -> coronet::result_t<decltype(token),
+                                        void(std::mutex*, shared_state*, int,
+                                             int)> {
+    INITIAL_SUSPEND(token);
+    unsigned local = 1;
+    for(int i = 0; i < iterations; ++i)
+    {
+        {
+            std::lock_guard<std::mutex> g{*m};
+            s->value = spin(s->value, work);
+            ++s->sections;
+        }
+        local = spin(local, work);
+    }
+    s->outside.fetch_add(local, std::memory_order_relaxed);
+};
+
+template<class Start>
+void
+bench(char const* name, net::io_context& ctx, int coroutines,
+      int iterations, Start start)
+{
+    std::atomic<int> done{0};
+    shared_state s;
+    auto const t0 = clock_type::now();
+    for(int c = 0; c < coroutines; ++c)
+        start(&s, [&done](std::exception_ptr) { ++done; } |
+                      coronet::via(ctx.get_executor()));
+    while(done.load() != coroutines)
+        std::this_thread::yield();
+    std::chrono::duration<double> const secs = clock_type::now() - t0;
+    if(s.sections != static_cast<long>(coroutines) * iterations)
+        std::printf("lost critical sections\n");
+    std::printf("%-12s %14.0f sections/s\n", name,
+                static_cast<double>(s.sections) / secs.count());
+}
+
+int
+main(int argc, char* argv[])
+{
+    int const coroutines = argc > 1 ? std::atoi(argv[1]) : 64;
+    int const iterations = argc > 2 ? std::atoi(argv[2]) : 20000;
+    int const threads = argc > 3 ? std::atoi(argv[3]) : 4;
+    int const work = argc > 4 ? std::atoi(argv[4]) : 50;
+
+    net::io_context ctx;
+    auto guard = net::make_work_guard(ctx);
+    std::vector<std::thread> io;
+    for(int i = 0; i < threads; ++i)
+        io.emplace_back([&ctx] { ctx.run(); });
+
+    std::printf("%d coroutines x %d iterations, %d threads, work %d\n",
+                coroutines, iterations, threads, work);
+    coronet::async_mutex am;
+    bench("async_mutex", ctx, coroutines, iterations,
+          [&](shared_state* s, auto token) {
+              async_worker(&am, s, iterations, work, token);
+          });
+    std::mutex sm;
+    bench("std::mutex", ctx, coroutines, iterations,
+          [&](shared_state* s, auto token) {
+              blocking_worker(&sm, s, iterations, work, token);
+          });
+
+    guard.reset();
+    for(auto& t : io)
+        t.join();
+}
@@ -0,0 +1,133 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+
+// Await a chain of operations nested 100 deep, each awaiting the next
+// without a completion token, and report the time, allocations and
+// allocator copies per level. The root is given a counting allocator,
+// either directly or through the type-erased coronet::allocator, whose
+// copies allocate. The nested frames borrow the root's allocator, so
+// neither should copy it per level.
+//
+// usage: nesting_bench [chains] [depth]
+
+#include <coronet/coronet.hpp>
+#include <coronet/detail/allocator.hpp>
+#include <coronet/manual_executor.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <memory>
+
+using clock_type = std::chrono::steady_clock;
+
+inline long allocations = 0;
+inline long copies = 0;
+
+template<class T = void>
+struct counting_allocator
+{
+    using value_type = T;
+
+    counting_allocator() = default;
+    counting_allocator(counting_allocator const&) noexcept
+    {
+        ++copies;
+    }
+    template<class U>
+    counting_allocator(counting_allocator<U> const&) noexcept
+    {
+        ++copies;
+    }
+    T* allocate(std::size_t n)
+    {
+        ++allocations;
+        return std::allocator<T>{}.allocate(n);
+    }
+    void deallocate(T* p, std::size_t n) noexcept
+    {
+        std::allocator<T>{}.deallocate(p, n);
+    }
+    template<class U>
+    friend bool
+    operator==(counting_allocator const&, counting_allocator<U> const&)
+    {
+        return true;
+    }
+    template<class U>
+    friend bool
+    operator!=(counting_allocator const&, counting_allocator<U> const&)
+    {
+        return false;
+    }
+};
+
+template<class Token>
+auto nest(int depth, Token token) -> coronet::result_t<Token, int(int)>;
+
+inline auto
+nest(int depth)
+{
+    return coronet::callable_with_implicit_context{
+        [depth](auto token) { return nest(depth, token); }};
+}
+
+// async_stuff2 style: each level awaits the next without a token.
+template<class Token>
+auto nest(int depth, Token token) -> coronet::result_t<Token, int(int)>
+{
+    INITIAL_SUSPEND(token);
+    if(depth == 0)
+        co_return 0;
+    co_return 1 + co_await nest(depth - 1);
+}
+
+template<class Alloc>
+void
+bench(char const* name, int chains, int depth, Alloc const& alloc)
+{
+    coronet::manual_executor ex;
+    auto const e = ex.get_executor();
+    long total = 0;
+    allocations = copies = 0;
+    auto const t0 = clock_type::now();
+    for(int i = 0; i < chains; ++i)
+    {
+        nest(depth,
+             [&total](std::exception_ptr, int levels) { total += levels; } |
+                 coronet::via(e, alloc));
+        ex.run();
+    }
+    std::chrono::duration<double, std::nano> const ns = clock_type::now() - t0;
+    auto const levels = static_cast<double>(chains) * depth;
+    if(total != static_cast<long>(levels))
+        std::printf("wrong result\n");
+    std::printf("%-28s %10.1f %12.2f %12.2f\n", name, ns.count() / levels,
+                static_cast<double>(allocations) / levels,
+                static_cast<double>(copies) / levels);
+}
+
+int
+main(int argc, char* argv[])
+{
+    int const chains = argc > 1 ? std::atoi(argv[1]) : 10000;
+    int const depth = argc > 2 ? std::atoi(argv[2]) : 100;
+    std::printf("%d chains, %d levels deep\n", chains, depth);
+    std::printf("%-28s %10s %12s %12s\n", "root allocator", "ns/level",
+                "allocs/level", "copies/level");
+    bench("std::allocator", chains, depth, std::allocator<void>{});
+    bench("counting_allocator", chains, depth, counting_allocator<>{});
+    bench("coronet::allocator", chains, depth,
+          coronet::allocator<>{counting_allocator<>{}});
+}
@@ -0,0 +1,132 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+
+// Score batches of items with coronet::async_transform_reduce and decode
+// them in place with coronet::async_parallel_for, on coronet::thread_pools
+// of 1 to N threads, and report the time per batch and the speedup over a
+// plain loop on one thread. Each batch is driven by a coroutine on the
+// pool, which awaits both operations through implicit tokens.
+//
+// usage: parallel_bench [max threads] [items per batch] [work per item]
+
+#include <coronet/coronet.hpp>
+#include <coronet/parallel.hpp>
+#include <coronet/thread_pool.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+using clock_type = std::chrono::steady_clock;
+
+// Stands in for scoring or decoding one item: `work` rounds of a hash.
+std::uint64_t
+churn(std::uint64_t x, int work)
+{
+    for(int i = 0; i < work; ++i)
+        x = (x ^ (x >> 29)) * 0xbf58476d1ce4e5b9u + 0x9e3779b97f4a7c15u;
+    return x;
+}
+
+inline constexpr coronet::async run_batches =
+    [](std::vector<std::uint64_t>* items, int batches, int work,
+       std::uint64_t* total,
+       auto token) -> coronet::result_t<decltype(token),
+                                        void(std::vector<std::uint64_t>*, int,
+                                             int, std::uint64_t*)> {
+    INITIAL_SUSPEND(token);
+    for(int b = 0; b < batches; ++b)
+    {
+        *total += co_await coronet::async_transform_reduce(
+            *items, std::uint64_t(0), std::plus<>{},
+            [work](std::uint64_t x) { return churn(x, work) & 0xff; });
+        co_await coronet::async_parallel_for(
+            *items, [work](std::uint64_t& x) { x = churn(x, work); });
+    }
+};
+
+struct result
+{
+    double us_per_batch;
+    std::uint64_t total;
+};
+
+result
+serial(std::size_t n, int batches, int work)
+{
+    std::vector<std::uint64_t> items(n);
+    std::iota(items.begin(), items.end(), std::uint64_t(1));
+    std::uint64_t total = 0;
+    auto const t0 = clock_type::now();
+    for(int b = 0; b < batches; ++b)
+    {
+        for(auto x : items)
+            total += churn(x, work) & 0xff;
+        for(auto& x : items)
+            x = churn(x, work);
+    }
+    std::chrono::duration<double, std::micro> const us = clock_type::now() - t0;
+    return {us.count() / batches, total};
+}
+
+result
+parallel(unsigned threads, std::size_t n, int batches, int work)
+{
+    coronet::thread_pool pool{threads};
+    std::vector<std::uint64_t> items(n);
+    std::iota(items.begin(), items.end(), std::uint64_t(1));
+    std::uint64_t total = 0;
+    std::atomic<bool> done{false};
+    auto const t0 = clock_type::now();
+    run_batches(&items, batches, work, &total,
+                [&done](std::exception_ptr) { done = true; } |
+                    coronet::via(pool.get_executor()));
+    while(!done)
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    std::chrono::duration<double, std::micro> const us = clock_type::now() - t0;
+    return {us.count() / batches, total};
+}
+
+int
+main(int argc, char* argv[])
+{
+    unsigned const max_threads =
+        argc > 1 ? static_cast<unsigned>(std::atoi(argv[1]))
+                 : (std::max)(1u, std::thread::hardware_concurrency());
+    std::size_t const n =
+        argc > 2 ? static_cast<std::size_t>(std::atoi(argv[2])) : 4096;
+    int const work = argc > 3 ? std::atoi(argv[3]) : 100;
+    int const batches = 200;
+
+    auto const base = serial(n, batches, work);
+    std::printf("%zu items, %d rounds per item, %d batches\n", n, work,
+                batches);
+    std::printf("%8s %14s %8s\n", "threads", "us/batch", "speedup");
+    std::printf("%8s %14.1f %8.2f\n", "serial", base.us_per_batch, 1.0);
+    for(unsigned t = 1; t <= max_threads; ++t)
+    {
+        auto const r = parallel(t, n, batches, work);
+        if(r.total != base.total)
+            std::printf("wrong result\n");
+        std::printf("%8u %14.1f %8.2f\n", t, r.us_per_batch,
+                    base.us_per_batch / r.us_per_batch);
+    }
+}
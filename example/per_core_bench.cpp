@@ -0,0 +1,194 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+//
+
+// Compare an echo server on a coronet::per_core_runtime with the same
+// server on one io_context shared by as many threads, over loopback, at
+// 1, 2, 4, ... cores. Each client connection sends a small message and
+// waits for it to come back, over and over, and the report is in round
+// trips per second and in speedup over one core. The clients run on the
+// same machine, so leave them some CPUs.
+//
+// usage: per_core_bench [seconds] [connections per core] [max cores]
+
+#include <coronet/coronet.hpp>
+#include <coronet/net.hpp>
+#include <coronet/per_core_runtime.hpp>
+#include <experimental/buffer>
+#include <experimental/internet>
+#include <experimental/io_context>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace net = std::experimental::net;
+using tcp = net::ip::tcp;
+using clock_type = std::chrono::steady_clock;
+
+constexpr std::size_t message_size = 64;
+
+struct settings
+{
+    std::chrono::seconds duration{2};
+    int connections = 8; // per core
+    std::size_t cores = (std::max)(1u, std::thread::hardware_concurrency());
+};
+
+inline constexpr coronet::async echo =
+    [](tcp::socket socket,
+       auto token) -> coronet::result_t<decltype(token), void(tcp::socket)> {
+    INITIAL_SUSPEND(token);
+    char buf[message_size];
+    for(;;)
+    {
+        auto const n =
+            co_await coronet::async_read_some(socket, net::buffer(buf));
+        co_await coronet::async_write(socket, net::buffer(buf, n));
+    }
+};
+
+// Accept connections on a shared io_context until the acceptor closes.
+inline constexpr coronet::async accept_loop =
+    [](net::io_context* ctx, tcp::acceptor* acceptor,
+       auto token) -> coronet::result_t<decltype(token),
+                                        void(net::io_context*,
+                                             tcp::acceptor*)> {
+    INITIAL_SUSPEND(token);
+    while(acceptor->is_open())
+    {
+        tcp::socket socket{*ctx};
+        try
+        {
+            co_await coronet::async_accept(*acceptor, socket);
+        }
+        catch(std::system_error const&)
+        {
+            continue;
+        }
+        echo(std::move(socket),
+             [](std::exception_ptr) {} | coronet::via(ctx->get_executor()));
+    }
+};
+
+// Returns the round trips per second of all the connections together.
+double
+run_load(tcp::endpoint endpoint, int connections, settings const& s)
+{
+    std::atomic<std::size_t> total{0};
+    std::atomic<bool> start{false};
+    std::vector<std::thread> clients;
+    for(int c = 0; c < connections; ++c)
+        clients.emplace_back([&] {
+            net::io_context ctx;
+            tcp::socket socket{ctx};
+            socket.connect(endpoint);
+            socket.set_option(tcp::no_delay(true));
+            char out[message_size] = "ping";
+            char in[message_size];
+            while(!start.load())
+                std::this_thread::yield();
+            auto const deadline = clock_type::now() + s.duration;
+            std::size_t n = 0;
+            for(; clock_type::now() < deadline; ++n)
+            {
+                net::write(socket, net::buffer(out));
+                net::read(socket, net::buffer(in));
+            }
+            total += n;
+        });
+    start = true;
+    for(auto& t : clients)
+        t.join();
+    return static_cast<double>(total.load()) /
+           static_cast<double>(s.duration.count());
+}
+
+double
+bench_per_core(std::size_t cores, settings const& s)
+{
+    coronet::per_core_runtime rt{cores};
+    auto const endpoint =
+        rt.listen(tcp::endpoint{net::ip::address_v4::loopback(), 0},
+                  [&rt](tcp::socket socket, std::size_t) noexcept {
+                      echo(std::move(socket),
+                           [](std::exception_ptr) {} |
+                               coronet::via(rt.get_executor(),
+                                            rt.get_allocator()));
+                  });
+    return run_load(endpoint, s.connections * static_cast<int>(cores), s);
+}
+
+double
+bench_shared(std::size_t threads, settings const& s)
+{
+    net::io_context ctx;
+    auto guard = net::make_work_guard(ctx);
+    tcp::acceptor acceptor{
+        ctx, tcp::endpoint{net::ip::address_v4::loopback(), 0}};
+    accept_loop(&ctx, &acceptor,
+                [](std::exception_ptr) {} | coronet::via(ctx.get_executor()));
+    std::vector<std::thread> io;
+    for(std::size_t i = 0; i < threads; ++i)
+        io.emplace_back([&ctx] { ctx.run(); });
+    auto const rate = run_load(acceptor.local_endpoint(),
+                               s.connections * static_cast<int>(threads), s);
+    net::post(ctx, [&acceptor] {
+        std::error_code ec;
+        acceptor.close(ec);
+    });
+    // Let the connections wind down before stopping.
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    guard.reset();
+    ctx.stop();
+    for(auto& t : io)
+        t.join();
+    return rate;
+}
+
+int
+main(int argc, char* argv[])
+{
+    settings s;
+    if(argc > 1)
+        s.duration = std::chrono::seconds(std::atoi(argv[1]));
+    if(argc > 2)
+        s.connections = std::atoi(argv[2]);
+    if(argc > 3)
+        s.cores = static_cast<std::size_t>(std::atoi(argv[3]));
+
+    std::printf("%d-byte echo, %d connections per core, %ds each\n",
+                static_cast<int>(message_size), s.connections,
+                static_cast<int>(s.duration.count()));
+    std::printf("%6s %14s %9s %14s %9s\n", "cores", "per-core rt/s",
+                "speedup", "shared rt/s", "speedup");
+    double per_core_1 = 0, shared_1 = 0;
+    for(std::size_t cores = 1; cores <= s.cores; cores *= 2)
+    {
+        auto const per_core = bench_per_core(cores, s);
+        auto const shared = bench_shared(cores, s);
+        if(cores == 1)
+        {
+            per_core_1 = per_core;
+            shared_1 = shared;
+        }
+        std::printf("%6zu %14.0f %8.2fx %14.0f %8.2fx\n", cores, per_core,
+                    per_core / per_core_1, shared, shared / shared_1);
+    }
+}
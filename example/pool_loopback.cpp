@@ -0,0 +1,242 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+
+// Run clients against a line echo server over loopback, both built on
+// coronet's net.hpp operations. Clients either take their connections from
+// a coronet::connection_pool or connect anew for every request. Each row
+// reports requests per second and how many connections the server
+// accepted. Then the pool is left idle until its reaper closes the idle
+// connections, and it is shut down and destroyed.
+//
+// usage: pool_loopback [clients] [requests per client] [threads]
+
+#include <coronet/connection_pool.hpp>
+#include <coronet/coronet.hpp>
+#include <coronet/net.hpp>
+#include <experimental/buffer>
+#include <experimental/internet>
+#include <experimental/io_context>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace net = std::experimental::net;
+using tcp = net::ip::tcp;
+using clock_type = std::chrono::steady_clock;
+using pool_type = coronet::connection_pool<tcp>;
+
+struct server_stats
+{
+    std::atomic<int> accepted{0};
+    std::atomic<int> closed{0};
+};
+
+inline constexpr coronet::async echo =
+    [](tcp::socket* raw, server_stats* stats,
+       auto token) -> coronet::result_t<decltype(token),
+                                        void(tcp::socket*, server_stats*)> {
+    INITIAL_SUSPEND(token);
+    std::unique_ptr<tcp::socket> socket{raw};
+    std::string buffer;
+    try
+    {
+        for(;;)
+        {
+            auto const n =
+                co_await coronet::async_read_until(*socket, buffer, "\n");
+            co_await coronet::async_write(*socket,
+                                          net::buffer(buffer.data(), n));
+            buffer.erase(0, n);
+        }
+    }
+    catch(std::system_error const&)
+    {
+    }
+    ++stats->closed;
+};
+
+// Accepts until the acceptor is closed.
+inline constexpr coronet::async serve =
+    [](net::io_context* ctx, tcp::acceptor* acceptor, server_stats* stats,
+       auto token) -> coronet::result_t<decltype(token),
+                                        void(net::io_context*, tcp::acceptor*,
+                                             server_stats*)> {
+    INITIAL_SUSPEND(token);
+    for(;;)
+    {
+        auto socket = std::make_unique<tcp::socket>(*ctx);
+        try
+        {
+            co_await coronet::async_accept(*acceptor, *socket);
+        }
+        catch(std::system_error const&)
+        {
+            break;
+        }
+        ++stats->accepted;
+        echo(socket.release(), stats,
+             [](std::exception_ptr) {} | coronet::via(ctx->get_executor()));
+    }
+};
+
+// Send a line and check that it comes back.
+inline constexpr coronet::async round_trip =
+    [](tcp::socket* socket, std::string const* line, std::string* buffer,
+       auto token) -> coronet::result_t<decltype(token),
+                                        void(tcp::socket*, std::string const*,
+                                             std::string*)> {
+    INITIAL_SUSPEND(token);
+    co_await coronet::async_write(*socket, net::buffer(*line));
+    auto const n = co_await coronet::async_read_until(*socket, *buffer, "\n");
+    if(buffer->compare(0, n, *line) != 0)
+        throw std::runtime_error("echo mismatch");
+    buffer->erase(0, n);
+};
+
+inline constexpr coronet::async pooled_client =
+    [](pool_type* pool, tcp::endpoint endpoint, int requests,
+       auto token) -> coronet::result_t<decltype(token),
+                                        void(pool_type*, tcp::endpoint,
+                                             int)> {
+    INITIAL_SUSPEND(token);
+    std::string buffer;
+    for(int i = 0; i < requests; ++i)
+    {
+        auto lease = co_await pool->async_acquire(endpoint);
+        std::string const line = "request " + std::to_string(i) + "\n";
+        try
+        {
+            co_await round_trip(&lease.socket(), &line, &buffer);
+        }
+        catch(...)
+        {
+            lease.invalidate();
+            throw;
+        }
+    }
+};
+
+inline constexpr coronet::async connecting_client =
+    [](net::io_context* ctx, tcp::endpoint endpoint, int requests,
+       auto token) -> coronet::result_t<decltype(token),
+                                        void(net::io_context*,
+                                             tcp::endpoint, int)> {
+    INITIAL_SUSPEND(token);
+    std::string buffer;
+    for(int i = 0; i < requests; ++i)
+    {
+        tcp::socket socket{*ctx};
+        co_await coronet::async_connect(socket, endpoint);
+        std::string const line = "request " + std::to_string(i) + "\n";
+        co_await round_trip(&socket, &line, &buffer);
+    }
+};
+
+template<class Start>
+void
+bench(char const* name, net::io_context& ctx, server_stats& stats,
+      int clients, int requests, Start start)
+{
+    std::atomic<int> done{0};
+    std::atomic<int> failed{0};
+    int const accepted = stats.accepted;
+    auto const t0 = clock_type::now();
+    for(int c = 0; c < clients; ++c)
+        start([&](std::exception_ptr eptr) {
+            if(eptr)
+                ++failed;
+            ++done;
+        } | coronet::via(ctx.get_executor()));
+    while(done.load() != clients)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    std::chrono::duration<double> const secs = clock_type::now() - t0;
+    std::printf("%-22s %12.0f req/s %8d accepted %4d failed\n", name,
+                static_cast<double>(clients) * requests / secs.count(),
+                stats.accepted - accepted, failed.load());
+}
+
+int
+main(int argc, char* argv[])
+{
+    int const clients = argc > 1 ? std::atoi(argv[1]) : 32;
+    int const requests = argc > 2 ? std::atoi(argv[2]) : 500;
+    int const threads = argc > 3 ? std::atoi(argv[3]) : 2;
+
+    net::io_context ctx;
+    auto guard = net::make_work_guard(ctx);
+    std::vector<std::thread> io;
+    for(int i = 0; i < threads; ++i)
+        io.emplace_back([&ctx] { ctx.run(); });
+
+    server_stats stats;
+    tcp::acceptor acceptor{ctx,
+                           tcp::endpoint{net::ip::address_v4::loopback(), 0}};
+    auto const endpoint = acceptor.local_endpoint();
+    std::atomic<bool> serving{true};
+    serve(&ctx, &acceptor, &stats, [&serving](std::exception_ptr) {
+        serving = false;
+    } | coronet::via(ctx.get_executor()));
+
+    std::printf("%d clients x %d requests, %d threads\n", clients, requests,
+                threads);
+    {
+        pool_type::options opts;
+        opts.max_per_endpoint = 8;
+        opts.idle_timeout = std::chrono::milliseconds(100);
+        opts.reap_interval = std::chrono::milliseconds(50);
+        pool_type pool{ctx, opts};
+        std::atomic<bool> running{true};
+        pool.async_run([&running](std::exception_ptr) {
+            running = false;
+        } | coronet::via(ctx.get_executor()));
+
+        bench("connection_pool", ctx, stats, clients, requests,
+              [&](auto token) {
+                  pooled_client(&pool, endpoint, requests, token);
+              });
+
+        // Wait for the reaper to close every idle connection.
+        int const closed = stats.closed;
+        int const pooled = stats.accepted;
+        auto const deadline = clock_type::now() + std::chrono::seconds(5);
+        while(stats.closed - closed != pooled && clock_type::now() < deadline)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        std::printf("reaped %d of %d idle connections\n",
+                    stats.closed - closed, pooled);
+
+        pool.shutdown();
+        while(running)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    bench("connect per request", ctx, stats, clients, requests,
+          [&](auto token) {
+              connecting_client(&ctx, endpoint, requests, token);
+          });
+
+    net::post(ctx, [&acceptor] { acceptor.close(); });
+    while(serving)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    guard.reset();
+    for(auto& t : io)
+        t.join();
+}
@@ -0,0 +1,133 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+
+// Measure the cost of posting to coronet::thread_pool, and to an
+// io_context through coronet::instrumented_context. Producer threads post
+// small work items as fast as they can, and each run is timed until the
+// last item has run. Build with CORONET_EXECUTOR_METRICS=0 to compare
+// against the uninstrumented executors. The io_context is also posted to
+// directly, in runs alternating with the instrumented ones, and the
+// median rates of the two give the cost of the counting.
+//
+// usage: post_bench [items per producer] [producers] [workers] [runs]
+
+#include <coronet/metrics.hpp>
+#include <coronet/thread_pool.hpp>
+#include <experimental/executor>
+#include <experimental/io_context>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace net = std::experimental::net;
+using clock_type = std::chrono::steady_clock;
+
+template<class Executor>
+double
+posts_per_second(Executor ex, int items, int producers)
+{
+    std::atomic<long> remaining{static_cast<long>(items) * producers};
+    auto const start = clock_type::now();
+    std::vector<std::thread> threads;
+    for(int p = 0; p < producers; ++p)
+        threads.emplace_back([&] {
+            for(int i = 0; i < items; ++i)
+                ex.post(
+                    [&remaining] {
+                        remaining.fetch_sub(1, std::memory_order_relaxed);
+                    },
+                    std::allocator<void>{});
+        });
+    for(auto& t : threads)
+        t.join();
+    while(remaining.load(std::memory_order_relaxed) != 0)
+        std::this_thread::yield();
+    std::chrono::duration<double> const t = clock_type::now() - start;
+    return static_cast<double>(items) * producers / t.count();
+}
+
+double
+median(std::vector<double> v)
+{
+    std::sort(v.begin(), v.end());
+    return v[v.size() / 2];
+}
+
+void
+report(char const* name, double rate, coronet::executor_metrics const& m)
+{
+    std::printf("%-22s %12.0f posts/s   wait %7.1f us mean %9.1f us max\n",
+                name, rate,
+                std::chrono::duration<double, std::micro>(m.mean_wait())
+                    .count(),
+                std::chrono::duration<double, std::micro>(m.max_wait)
+                    .count());
+}
+
+int
+main(int argc, char* argv[])
+{
+    int const items = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    int const producers = argc > 2 ? std::atoi(argv[2]) : 2;
+    int const workers = argc > 3 ? std::atoi(argv[3]) : 2;
+    int const runs = argc > 4 ? std::atoi(argv[4]) : 5;
+    std::printf("metrics %s, %d producers x %d items, %d workers\n",
+                CORONET_EXECUTOR_METRICS ? "on" : "off", producers, items,
+                workers);
+
+    {
+        coronet::thread_pool pool{static_cast<std::size_t>(workers)};
+        double const rate =
+            posts_per_second(pool.get_executor(), items, producers);
+        report("thread_pool", rate, pool.metrics());
+    }
+    {
+        net::io_context ctx;
+        auto guard = net::make_work_guard(ctx);
+        std::vector<std::thread> io;
+        for(int i = 0; i < workers; ++i)
+            io.emplace_back([&ctx] { ctx.run(); });
+        coronet::instrumented_context<net::io_context::executor_type> mon{
+            ctx.get_executor()};
+        std::vector<double> bare, counted;
+        // Each goes first in every other pair, as the second of a pair
+        // finds a busier machine.
+        for(int r = 0; r < runs; ++r)
+        {
+            auto const run_bare = [&] {
+                bare.push_back(
+                    posts_per_second(ctx.get_executor(), items, producers));
+            };
+            if(r % 2 == 0)
+                run_bare();
+            counted.push_back(
+                posts_per_second(mon.get_executor(), items, producers));
+            if(r % 2 != 0)
+                run_bare();
+        }
+        report("io_context", median(counted), mon.metrics());
+        std::printf("%-22s %12.0f posts/s   counting costs %.2f%%\n",
+                    "io_context, bare", median(bare),
+                    100 * (median(bare) / median(counted) - 1));
+        guard.reset();
+        for(auto& t : io)
+            t.join();
+    }
+}
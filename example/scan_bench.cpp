@@ -0,0 +1,127 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+
+// Compare the delimiter scanners behind coronet::async_read_until, and the
+// adaptive one that it uses, with a naive byte loop and with
+// std::string_view::find. Each scanner finds
+// every delimiter in a buffer of lines of a given length, and the
+// throughput is reported in GB/s. The default buffer of 256 KiB stays in
+// cache, as a socket's read buffer does.
+//
+// usage: scan_bench [kilobytes]
+
+#include <coronet/detail/scan.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <string_view>
+
+using clock_type = std::chrono::steady_clock;
+
+char const*
+find_naive(char const* first, char const* last, std::string_view delim) noexcept
+{
+    for(; static_cast<std::size_t>(last - first) >= delim.size(); ++first)
+    {
+        std::size_t i = 0;
+        while(i != delim.size() && first[i] == delim[i])
+            ++i;
+        if(i == delim.size())
+            return first;
+    }
+    return last;
+}
+
+char const*
+find_string_view(
+    char const* first, char const* last, std::string_view delim) noexcept
+{
+    std::string_view const s(first, static_cast<std::size_t>(last - first));
+    auto const pos = s.find(delim);
+    return pos == std::string_view::npos ? last : first + pos;
+}
+
+// Lines of printable text of line_length bytes, each ending in delim. In
+// noisy text, one byte in eight is the first byte of the delimiter.
+std::string
+make_input(std::size_t size, std::size_t line_length, std::string_view delim,
+           bool noisy)
+{
+    std::mt19937 rng{42};
+    std::uniform_int_distribution<int> ch{' ', '~'};
+    std::string s;
+    s.reserve(size + line_length + delim.size());
+    while(s.size() < size)
+    {
+        for(std::size_t i = 0; i < line_length; ++i)
+            s += noisy && rng() % 8 == 0 ? delim[0]
+                                         : static_cast<char>(ch(rng));
+        s += delim;
+    }
+    return s;
+}
+
+void
+bench(char const* name, coronet::_scan_fn scan, std::string const& input,
+      std::string_view delim)
+{
+    auto const* const last = input.data() + input.size();
+    std::size_t found = 0;
+    auto const start = clock_type::now();
+    int const rounds = static_cast<int>((std::size_t{1} << 30) / input.size());
+    for(int r = 0; r < rounds; ++r)
+        for(auto* p = input.data();; ++found)
+        {
+            p = scan(p, last, delim);
+            if(p == last)
+                break;
+            p += delim.size();
+        }
+    std::chrono::duration<double> const t = clock_type::now() - start;
+    std::printf("  %-12s %8.2f GB/s  (%zu found)\n", name,
+                static_cast<double>(input.size()) * rounds / t.count() / 1e9,
+                found / rounds);
+}
+
+int
+main(int argc, char* argv[])
+{
+    std::size_t const size =
+        (argc > 1 ? static_cast<std::size_t>(std::atoi(argv[1])) : 256) << 10;
+    struct
+    {
+        std::string_view delim;
+        bool noisy;
+    } const cases[] = {{"\n", false}, {"\r\n", false}, {"\r\n\r\n", false},
+                       {"--boundary", true}};
+    for(auto const& c : cases)
+        for(std::size_t line : {16, 64, 1024})
+        {
+            auto const delim = c.delim;
+            auto const input = make_input(size, line, delim, c.noisy);
+            std::printf("delimiter of %zu bytes, lines of %zu bytes%s\n",
+                        delim.size(), line, c.noisy ? ", noisy" : "");
+            bench("naive", &find_naive, input, delim);
+            bench("string_view", &find_string_view, input, delim);
+            bench("memchr", &coronet::_find_delimiter_scalar, input, delim);
+#if CORONET_HAS_X86_SIMD
+            bench("sse2", &coronet::_find_delimiter_sse2, input, delim);
+            if(__builtin_cpu_supports("avx2"))
+                bench("avx2", &coronet::_find_delimiter_avx2, input, delim);
+#endif
+            bench("coronet", &coronet::_find_delimiter, input, delim);
+        }
+}
@@ -0,0 +1,202 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+
+// Send a file over a loopback TCP connection, first with
+// coronet::async_send_file and then with a loop that reads a block of the
+// file and writes it to the socket, and report the bandwidth and the CPU
+// time that each spends per GiB. The sender runs on one io_context thread,
+// whose CPU time is reported on its own, and a plain blocking thread
+// reads and discards the data on the other end.
+//
+// usage: send_file_bench [file] [megabytes] [passes] [block KiB]
+
+#include <coronet/coronet.hpp>
+#include <coronet/net.hpp>
+#include <experimental/buffer>
+#include <experimental/executor>
+#include <experimental/internet>
+#include <experimental/io_context>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace net = std::experimental::net;
+using tcp = net::ip::tcp;
+using clock_type = std::chrono::steady_clock;
+
+double
+thread_cpu_seconds(pthread_t thread)
+{
+    ::clockid_t id;
+    ::timespec ts{};
+    if(::pthread_getcpuclockid(thread, &id) == 0)
+        ::clock_gettime(id, &ts);
+    return static_cast<double>(ts.tv_sec) +
+        static_cast<double>(ts.tv_nsec) / 1e9;
+}
+
+double
+process_cpu_seconds()
+{
+    ::rusage ru{};
+    ::getrusage(RUSAGE_SELF, &ru);
+    auto const secs = [](::timeval tv) {
+        return static_cast<double>(tv.tv_sec) +
+            static_cast<double>(tv.tv_usec) / 1e6;
+    };
+    return secs(ru.ru_utime) + secs(ru.ru_stime);
+}
+
+// Send the first size bytes of the file, passes times over.
+inline constexpr coronet::async send_file =
+    [](tcp::socket* socket, int fd, std::size_t size, int passes,
+       auto token) -> coronet::result_t<decltype(token),
+                                        void(tcp::socket*, int, std::size_t,
+                                             int)> {
+    INITIAL_SUSPEND(token);
+    for(int i = 0; i < passes; ++i)
+        co_await coronet::async_send_file(*socket, fd, 0, size);
+};
+
+inline constexpr coronet::async read_write =
+    [](tcp::socket* socket, int fd, std::size_t size, int passes,
+       std::size_t block,
+       auto token) -> coronet::result_t<decltype(token),
+                                        void(tcp::socket*, int, std::size_t,
+                                             int, std::size_t)> {
+    INITIAL_SUSPEND(token);
+    std::vector<char> buf(block);
+    for(int i = 0; i < passes; ++i)
+        for(std::size_t off = 0; off < size;)
+        {
+            auto const n = ::pread(fd, buf.data(),
+                                   (std::min)(block, size - off),
+                                   static_cast<::off_t>(off));
+            if(n <= 0)
+                throw std::system_error(errno, std::system_category());
+            co_await coronet::async_write(
+                *socket,
+                net::buffer(buf.data(), static_cast<std::size_t>(n)));
+            off += static_cast<std::size_t>(n);
+        }
+};
+
+template<class Start>
+void
+bench(char const* name, std::size_t total, Start start)
+{
+    net::io_context ctx;
+    auto guard = net::make_work_guard(ctx);
+    std::thread t{[&ctx] { ctx.run(); }};
+
+    tcp::acceptor acceptor{
+        ctx, tcp::endpoint{net::ip::address_v4::loopback(), 0}};
+    tcp::socket sender{ctx};
+    tcp::socket receiver{ctx};
+    receiver.connect(acceptor.local_endpoint());
+    acceptor.accept(sender);
+
+    std::size_t received = 0;
+    std::thread sink{[&] {
+        std::vector<char> buf(1 << 20);
+        for(;;)
+        {
+            auto const n =
+                ::read(receiver.native_handle(), buf.data(), buf.size());
+            if(n <= 0)
+                break;
+            received += static_cast<std::size_t>(n);
+        }
+    }};
+
+    std::atomic<bool> done{false};
+    bool failed = false;
+    auto const cpu0 = thread_cpu_seconds(t.native_handle());
+    auto const all0 = process_cpu_seconds();
+    auto const t0 = clock_type::now();
+    start(&sender, [&](std::exception_ptr e) {
+        failed = e != nullptr;
+        done = true;
+    } | coronet::via(ctx.get_executor()));
+    while(!done)
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    sender.shutdown(tcp::socket::shutdown_send);
+    sink.join();
+    std::chrono::duration<double> const secs = clock_type::now() - t0;
+    auto const cpu = thread_cpu_seconds(t.native_handle()) - cpu0;
+    auto const all = process_cpu_seconds() - all0;
+    guard.reset();
+    t.join();
+
+    if(failed || received != total)
+    {
+        std::printf("%-12s failed: %zu of %zu bytes\n", name, received, total);
+        return;
+    }
+    double const gib = static_cast<double>(total) / (1 << 30);
+    std::printf("%-12s %8.2f GiB/s %8.3f s CPU/GiB sender %8.3f s CPU/GiB "
+                "total\n",
+                name, gib / secs.count(), cpu / gib, all / gib);
+}
+
+int
+main(int argc, char* argv[])
+{
+    char const* path = argc > 1 ? argv[1] : "send_file_bench.dat";
+    std::size_t const size =
+        (argc > 2 ? static_cast<std::size_t>(std::atoi(argv[2])) : 64) << 20;
+    int const passes = argc > 3 ? std::atoi(argv[3]) : 16;
+    std::size_t const block =
+        (argc > 4 ? static_cast<std::size_t>(std::atoi(argv[4])) : 64) << 10;
+
+    int const fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
+    {
+        std::perror(path);
+        return 1;
+    }
+    std::vector<char> chunk(1 << 20, 'x');
+    for(std::size_t off = 0; off < size; off += chunk.size())
+        if(::pwrite(fd, chunk.data(), chunk.size(),
+                    static_cast<::off_t>(off)) < 0)
+        {
+            std::perror("pwrite");
+            return 1;
+        }
+    std::printf("%zu MiB file, %d passes, %zu KiB blocks for read+write\n",
+                size >> 20, passes, block >> 10);
+
+    std::size_t const total = size * static_cast<std::size_t>(passes);
+    for(int round = 0; round != 2; ++round)
+    {
+        bench("send_file", total, [&](tcp::socket* s, auto token) {
+            send_file(s, fd, size, passes, std::move(token));
+        });
+        bench("read+write", total, [&](tcp::socket* s, auto token) {
+            read_write(s, fd, size, passes, block, std::move(token));
+        });
+    }
+    ::close(fd);
+    ::unlink(path);
+}
@@ -0,0 +1,194 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+
+// Compare the cost per operation of awaiting a trivial async operation
+// through yield tokens with the cost of running it as a sender, and of
+// sender pipelines built only from adaptors. Each row reports the time
+// and the number of allocations per operation, counted by the allocator
+// that every token is given. Everything runs on a coronet::manual_executor,
+// leaving out threads and the clock.
+//
+// usage: sender_bench [operations per row]
+
+#include <coronet/coronet.hpp>
+#include <coronet/manual_executor.hpp>
+#include <coronet/sender.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <memory>
+
+using clock_type = std::chrono::steady_clock;
+
+inline long allocations = 0;
+
+template<class T = void>
+struct counting_allocator
+{
+    using value_type = T;
+
+    counting_allocator() = default;
+    template<class U>
+    counting_allocator(counting_allocator<U> const&) noexcept
+    {}
+    T* allocate(std::size_t n)
+    {
+        ++allocations;
+        return std::allocator<T>{}.allocate(n);
+    }
+    void deallocate(T* p, std::size_t n) noexcept
+    {
+        std::allocator<T>{}.deallocate(p, n);
+    }
+    template<class U>
+    friend bool
+    operator==(counting_allocator const&, counting_allocator<U> const&)
+    {
+        return true;
+    }
+    template<class U>
+    friend bool
+    operator!=(counting_allocator const&, counting_allocator<U> const&)
+    {
+        return false;
+    }
+};
+
+using executor_t = coronet::manual_executor::executor_type;
+
+inline constexpr coronet::async add_one =
+    [](int arg, auto token) -> coronet::result_t<decltype(token), int(int)> {
+    INITIAL_SUSPEND(token);
+    co_return arg + 1;
+};
+
+// Await n operations from a driver coroutine, getting each one's token
+// from make_op(i). The arguments are parameters, not lambda captures, so
+// that they live in the coroutine frame.
+inline constexpr coronet::async driver =
+    [](int n, auto make_op, long* total,
+       auto token) -> coronet::result_t<decltype(token),
+                                        void(int, decltype(make_op), long*)> {
+    INITIAL_SUSPEND(token);
+    for(int i = 0; i < n; ++i)
+        *total += co_await make_op(i);
+};
+
+struct row
+{
+    double ns;
+    double allocs;
+};
+
+template<class Run>
+row measure(int n, Run run)
+{
+    coronet::manual_executor ex;
+    long total = 0;
+    allocations = 0;
+    auto const t0 = clock_type::now();
+    run(ex, total);
+    std::chrono::duration<double, std::nano> const ns = clock_type::now() - t0;
+    if(total < n)
+        std::printf("wrong result\n");
+    return {ns.count() / n, static_cast<double>(allocations) / n};
+}
+
+// Run a driver coroutine whose own frame is not counted.
+template<class MakeOp>
+void drive(coronet::manual_executor& ex, int n, long& total, MakeOp make_op)
+{
+    auto const e = ex.get_executor();
+    driver(n, make_op, &total,
+           [](std::exception_ptr) {} |
+               coronet::via(e, counting_allocator<>{}));
+    allocations = 0;
+    ex.run();
+}
+
+struct receiver
+{
+    long* total;
+    void set_value(int v)
+    {
+        *total += v;
+    }
+    void set_error(std::exception_ptr)
+    {
+        std::terminate();
+    }
+};
+
+int
+main(int argc, char* argv[])
+{
+    int const n = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    counting_allocator<> const alloc;
+    auto const print = [](char const* name, row r) {
+        std::printf("%-34s %10.1f %10.2f\n", name, r.ns, r.allocs);
+    };
+    std::printf("%-34s %10s %10s\n", "", "ns/op", "allocs/op");
+
+    print("co_await op() (implicit yield)",
+          measure(n, [&](auto& ex, long& total) {
+              drive(ex, n, total, [](int i) { return add_one(i); });
+          }));
+    print("co_await op(yield(e))", measure(n, [&](auto& ex, long& total) {
+              auto const e = ex.get_executor();
+              drive(ex, n, total, [=](int i) {
+                  return add_one(i, coronet::yield(e, alloc));
+              });
+          }));
+    print("co_await op(as_sender(e))", measure(n, [&](auto& ex, long& total) {
+              auto const e = ex.get_executor();
+              drive(ex, n, total, [=](int i) {
+                  return add_one(i, coronet::as_sender(e, alloc));
+              });
+          }));
+    print("connect(op(as_sender(e))), start",
+          measure(n, [&](auto& ex, long& total) {
+              auto const e = ex.get_executor();
+              for(int i = 0; i < n; ++i)
+              {
+                  auto op = add_one(i, coronet::as_sender(e, alloc))
+                                .connect(receiver{&total});
+                  op.start();
+                  ex.run_until_idle();
+              }
+          }));
+    print("connect(just | then | then), start",
+          measure(n, [&](auto&, long& total) {
+              auto const inc = [](int v) { return v + 1; };
+              for(int i = 0; i < n; ++i)
+              {
+                  auto op = (coronet::just(i) | coronet::then(inc) |
+                             coronet::then(inc))
+                                .connect(receiver{&total});
+                  op.start();
+              }
+          }));
+    print("co_await when_all(just | then, ...)",
+          measure(n, [&](auto& ex, long& total) {
+              auto const inc = [](int v) { return v + 1; };
+              drive(ex, n, total, [=](int i) {
+                  return coronet::when_all(
+                             coronet::just(i) | coronet::then(inc),
+                             coronet::just(i) | coronet::then(inc)) |
+                         coronet::then([](auto both) {
+                             return std::get<0>(both) + std::get<1>(both);
+                         });
+              });
+          }));
+}
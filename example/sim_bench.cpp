@@ -0,0 +1,141 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+
+// Drive coroutines through two coronet::manual_executors under many
+// seeded random schedules. Each schedule starts a batch of operations on
+// executor A that await work on executor B, which task::_awaitable must
+// post there and repost back, and nested implicit calls, which it must
+// run inline. A coroutine given a yield token for A also awaits an
+// operation given an equal token, which shares its execution context and
+// must run inline too. Every resumption is checked against the executor
+// it should run on. Since no thread or clock is involved, the run reports
+// the cost of coronet's scheduling alone, and a failing seed replays
+// exactly.
+//
+// usage: sim_bench [schedules] [operations per schedule]
+
+#include <coronet/coronet.hpp>
+#include <coronet/manual_executor.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <random>
+
+using clock_type = std::chrono::steady_clock;
+
+coronet::manual_executor* on_a = nullptr;
+coronet::manual_executor* on_b = nullptr;
+long failures = 0;
+
+void
+expect_on(coronet::manual_executor* ex, char const* where)
+{
+    if(coronet::manual_executor::current() != ex)
+    {
+        if(++failures <= 10)
+            std::printf("resumed on the wrong executor %s\n", where);
+    }
+}
+
+inline constexpr coronet::async leaf =
+    [](int arg, auto token) -> coronet::result_t<decltype(token), int(int)> {
+    INITIAL_SUSPEND(token);
+    co_return arg + 1;
+};
+
+// Runs on B when given a token for B.
+inline constexpr coronet::async remote =
+    [](int arg, auto token) -> coronet::result_t<decltype(token), int(int)> {
+    INITIAL_SUSPEND(token);
+    expect_on(on_b, "in remote");
+    int const i = co_await leaf(arg);
+    expect_on(on_b, "after leaf");
+    co_return i * 2;
+};
+
+// Runs on A when given a token for A. An operation given the same token
+// type, executor and allocator must run inline, with no work item of A's
+// in between; one given a token for B hops there and back.
+inline constexpr coronet::async relay =
+    [](int arg, auto token) -> coronet::result_t<decltype(token), int(int)> {
+    INITIAL_SUSPEND(token);
+    expect_on(on_a, "in relay");
+    auto const executed = on_a->executed();
+    int i = co_await leaf(arg, coronet::yield(on_a->get_executor()));
+    if(on_a->executed() != executed && ++failures <= 10)
+        std::printf("an operation in the same context was posted\n");
+    expect_on(on_a, "after same context leaf");
+    i = co_await remote(i, coronet::yield(on_b->get_executor()));
+    expect_on(on_a, "after remote");
+    co_return i;
+};
+
+// Runs on A, and hops to B and back by way of relay.
+inline constexpr coronet::async local =
+    [](int arg, auto token) -> coronet::result_t<decltype(token), int(int)> {
+    INITIAL_SUSPEND(token);
+    int i = co_await leaf(arg);
+    expect_on(on_a, "after leaf");
+    i = co_await relay(i, coronet::yield(on_a->get_executor()));
+    expect_on(on_a, "after relay");
+    co_return i;
+};
+
+// Run one schedule and return the number of work items it took.
+std::uint64_t
+run_schedule(std::uint64_t seed, int operations)
+{
+    coronet::manual_executor a{seed}, b{~seed};
+    on_a = &a;
+    on_b = &b;
+    long sum = 0, expected = 0;
+    for(int k = 0; k < operations; ++k)
+    {
+        expected += (k + 3) * 2;
+        local(k, [&sum](std::exception_ptr e, int i) {
+            if(e)
+                ++failures;
+            sum += i;
+        } | coronet::via(a.get_executor()));
+    }
+    std::mt19937_64 pick{seed};
+    while(a.ready() + b.ready() != 0)
+    {
+        bool const use_a = b.ready() == 0 || (a.ready() != 0 && pick() % 2);
+        (use_a ? a : b).step();
+    }
+    if(sum != expected && ++failures <= 10)
+        std::printf("seed %llu: sum %ld, expected %ld\n",
+                    static_cast<unsigned long long>(seed), sum, expected);
+    return a.executed() + b.executed();
+}
+
+int
+main(int argc, char* argv[])
+{
+    long const schedules = argc > 1 ? std::atol(argv[1]) : 100000;
+    int const operations = argc > 2 ? std::atoi(argv[2]) : 8;
+    std::uint64_t steps = 0;
+    auto const start = clock_type::now();
+    for(long s = 0; s < schedules; ++s)
+        steps += run_schedule(static_cast<std::uint64_t>(s), operations);
+    std::chrono::duration<double> const t = clock_type::now() - start;
+    std::printf("%ld schedules of %d operations: %.0f schedules/s, "
+                "%.1f ns per work item, %ld failures\n",
+                schedules, operations,
+                static_cast<double>(schedules) / t.count(),
+                t.count() * 1e9 / static_cast<double>(steps), failures);
+    return failures != 0;
+}
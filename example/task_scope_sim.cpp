@@ -0,0 +1,234 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+
+// Drive a coronet::task_scope on a coronet::manual_executor, whose virtual
+// clock makes every step exact. Three scenarios, each checked as it runs:
+// a spawner starting more operations than the concurrency limit allows
+// must wait for slots, and no more than the limit may be live at once;
+// request_stop must fail the waiting spawner and end the operations
+// already started, which poll stop_requested; and an operation that
+// throws must stop the scope and have async_join rethrow its exception to
+// each of two joiners. Returns non-zero on any failed check.
+//
+// usage: task_scope_sim
+
+#include <coronet/coronet.hpp>
+#include <coronet/manual_executor.hpp>
+#include <coronet/task_scope.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#include <experimental/coroutine>
+
+constexpr std::chrono::milliseconds tick{1};
+
+int live = 0;
+int peak = 0;
+int started = 0;
+int failures = 0;
+
+void
+check(bool ok, char const* what)
+{
+    if(!ok)
+    {
+        ++failures;
+        std::printf("failed: %s\n", what);
+    }
+}
+
+// Resume the awaiting coroutine one tick later on the virtual clock.
+struct next_tick
+{
+    static bool await_ready() noexcept
+    {
+        return false;
+    }
+    static void await_suspend(std::experimental::coroutine_handle<> h)
+    {
+        coronet::manual_executor::current()->get_executor().post_after(
+            tick, h, std::allocator<void>{});
+    }
+    static void await_resume() noexcept {}
+};
+
+coronet::manual_executor::executor_type
+here()
+{
+    return coronet::manual_executor::current()->get_executor();
+}
+
+// Holds a slot for the given number of ticks, or until the scope is
+// stopped, and then throws if asked to.
+inline constexpr coronet::async hold =
+    [](coronet::task_scope* scope, int ticks, bool fail,
+       auto token) -> coronet::result_t<decltype(token),
+                                        void(coronet::task_scope*, int,
+                                             bool)> {
+    INITIAL_SUSPEND(token);
+    ++started;
+    peak = (std::max)(peak, ++live);
+    for(int i = 0; i < ticks && !scope->stop_requested(); ++i)
+        co_await next_tick{};
+    --live;
+    if(fail)
+        throw std::runtime_error("operation failed");
+};
+
+// Spawns count operations that hold a slot for ticks each, one after the
+// other, and notes whether a spawn was cancelled.
+inline constexpr coronet::async spawner =
+    [](coronet::task_scope* scope, int count, int ticks, bool* cancelled,
+       auto token) -> coronet::result_t<decltype(token),
+                                        void(coronet::task_scope*, int, int,
+                                             bool*)> {
+    INITIAL_SUSPEND(token);
+    try
+    {
+        for(int i = 0; i < count; ++i)
+            co_await scope->async_spawn(hold(scope, ticks, false),
+                                        coronet::yield(here()));
+    }
+    catch(std::system_error const& e)
+    {
+        *cancelled = e.code() == std::errc::operation_canceled;
+    }
+};
+
+inline constexpr coronet::async joiner =
+    [](coronet::task_scope* scope, std::string* error,
+       auto token) -> coronet::result_t<decltype(token),
+                                        void(coronet::task_scope*,
+                                             std::string*)> {
+    INITIAL_SUSPEND(token);
+    try
+    {
+        co_await scope->async_join();
+        *error = "none";
+    }
+    catch(std::exception const& e)
+    {
+        *error = e.what();
+    }
+};
+
+auto
+expect_no_error(char const* what)
+{
+    return [what](std::exception_ptr e) { check(!e, what); };
+}
+
+void
+backpressure()
+{
+    live = peak = started = 0;
+    coronet::manual_executor sim;
+    coronet::task_scope scope{3};
+    bool cancelled = false;
+    spawner(&scope, 20, 10, &cancelled,
+            expect_no_error("the spawner completes") |
+                coronet::via(sim.get_executor()));
+    sim.run_until_idle();
+    check(started == 3 && scope.size() == 3,
+          "the spawner waits once three operations are live");
+    sim.run();
+    std::string error;
+    joiner(&scope, &error, expect_no_error("the joiner completes") |
+                               coronet::via(sim.get_executor()));
+    sim.run();
+    check(started == 20 && peak == 3 && !cancelled,
+          "twenty operations start, never more than three at once");
+    check(sim.now() == 7 * 10 * tick,
+          "a slot is handed on as soon as an operation finishes");
+    check(error == "none" && scope.size() == 0,
+          "the join completes without an error once all have finished");
+    std::printf("backpressure: %d started, peak %d, done after %lld ms\n",
+                started, peak,
+                static_cast<long long>(
+                    std::chrono::duration_cast<std::chrono::milliseconds>(
+                        sim.now())
+                        .count()));
+}
+
+void
+stop()
+{
+    live = peak = started = 0;
+    coronet::manual_executor sim;
+    coronet::task_scope scope{2};
+    bool cancelled = false;
+    spawner(&scope, 10, 1000, &cancelled,
+            expect_no_error("the spawner completes") |
+                coronet::via(sim.get_executor()));
+    sim.advance(5 * tick);
+    check(started == 2 && !cancelled, "two run and the spawner waits");
+    scope.request_stop();
+    std::string error;
+    joiner(&scope, &error, expect_no_error("the joiner completes") |
+                               coronet::via(sim.get_executor()));
+    sim.run();
+    check(cancelled, "request_stop fails the waiting spawner");
+    check(started == 2 && sim.now() <= 6 * tick,
+          "the started operations see the stop and end early");
+    check(error == "none", "a stop alone is not an error to join");
+    check(!scope.try_spawn(hold(&scope, 1, false),
+                           coronet::yield(sim.get_executor())),
+          "a stopped scope starts nothing");
+    std::printf("stop: cancelled %d, %d started, done after %lld ms\n",
+                cancelled, started,
+                static_cast<long long>(
+                    std::chrono::duration_cast<std::chrono::milliseconds>(
+                        sim.now())
+                        .count()));
+}
+
+void
+failure()
+{
+    live = peak = started = 0;
+    coronet::manual_executor sim;
+    coronet::task_scope scope;
+    for(int i = 0; i < 5; ++i)
+        check(scope.try_spawn(hold(&scope, i == 2 ? 2 : 50, i == 2),
+                              coronet::yield(sim.get_executor())),
+              "an unlimited scope has room");
+    std::string first, second;
+    joiner(&scope, &first, expect_no_error("the first joiner completes") |
+                               coronet::via(sim.get_executor()));
+    joiner(&scope, &second, expect_no_error("the second joiner completes") |
+                                coronet::via(sim.get_executor()));
+    sim.run();
+    check(scope.stop_requested(), "a failed operation stops the scope");
+    check(sim.now() <= 3 * tick, "the others see the stop and end early");
+    check(first == "operation failed" && second == "operation failed",
+          "every joiner gets the exception");
+    std::printf("failure: joiners saw \"%s\" and \"%s\"\n", first.c_str(),
+                second.c_str());
+}
+
+int
+main()
+{
+    backpressure();
+    stop();
+    failure();
+    std::printf("%d failed checks\n", failures);
+    return failures != 0;
+}
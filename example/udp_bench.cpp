@@ -0,0 +1,130 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+
+// Blast small datagrams over loopback with coronet::async_send_batch and
+// count them with coronet::async_receive_batch, at several batch sizes,
+// and report packets per second on each side. The sender and the receiver
+// each run on an io_context thread of their own. A batch size of 1 costs
+// one system call per datagram, as a plain send_to/receive_from loop would.
+//
+// usage: udp_bench [seconds per run] [datagram bytes]
+
+#include <coronet/coronet.hpp>
+#include <coronet/udp.hpp>
+#include <experimental/buffer>
+#include <experimental/executor>
+#include <experimental/internet>
+#include <experimental/io_context>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <string>
+#include <thread>
+
+namespace net = std::experimental::net;
+using udp = net::ip::udp;
+using clock_type = std::chrono::steady_clock;
+
+// Send the same full batch over and over until told to stop.
+inline constexpr coronet::async sender =
+    [](udp::socket* socket, coronet::datagram_batch* batch,
+       std::atomic<bool> const* stop, std::size_t* sent,
+       auto token) -> coronet::result_t<decltype(token),
+                                        void(udp::socket*,
+                                             coronet::datagram_batch*,
+                                             std::atomic<bool> const*,
+                                             std::size_t*)> {
+    INITIAL_SUSPEND(token);
+    while(!stop->load(std::memory_order_relaxed))
+        *sent += co_await coronet::async_send_batch(*socket, *batch);
+};
+
+// Count datagrams until the socket is closed.
+inline constexpr coronet::async receiver =
+    [](udp::socket* socket, coronet::datagram_batch* batch,
+       std::size_t* received,
+       auto token) -> coronet::result_t<decltype(token),
+                                        void(udp::socket*,
+                                             coronet::datagram_batch*,
+                                             std::size_t*)> {
+    INITIAL_SUSPEND(token);
+    for(;;)
+        *received += co_await coronet::async_receive_batch(*socket, *batch);
+};
+
+void
+bench(std::size_t batch_size, std::size_t bytes, std::chrono::seconds secs)
+{
+    net::io_context rx_ctx, tx_ctx;
+    auto rx_guard = net::make_work_guard(rx_ctx);
+    auto tx_guard = net::make_work_guard(tx_ctx);
+    std::thread rx_thread{[&rx_ctx] { rx_ctx.run(); }};
+    std::thread tx_thread{[&tx_ctx] { tx_ctx.run(); }};
+
+    udp::socket rx{rx_ctx, udp::endpoint{net::ip::address_v4::loopback(), 0}};
+    udp::socket tx{tx_ctx, udp::endpoint{net::ip::address_v4::loopback(), 0}};
+    rx.set_option(udp::socket::receive_buffer_size{8 << 20});
+
+    coronet::datagram_batch in{64, (std::max)(bytes, std::size_t(64))};
+    coronet::datagram_batch out{batch_size, bytes};
+    std::string const payload(bytes, 'x');
+    while(out.push(net::buffer(payload), rx.local_endpoint()))
+        ;
+
+    std::atomic<bool> stop{false};
+    std::atomic<int> running{2};
+    std::size_t sent = 0, received = 0;
+    auto const done = [&running](std::exception_ptr) { --running; };
+    auto const t0 = clock_type::now();
+    receiver(&rx, &in, &received, done | coronet::via(rx_ctx.get_executor()));
+    sender(&tx, &out, &stop, &sent, done | coronet::via(tx_ctx.get_executor()));
+    std::this_thread::sleep_for(secs);
+    stop = true;
+    while(running == 2)
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    std::chrono::duration<double> const elapsed = clock_type::now() - t0;
+    // Let the receiver drain what is in flight, then stop it.
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    net::post(rx_ctx, [&rx] { rx.close(); });
+    while(running != 0)
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    rx_guard.reset();
+    tx_guard.reset();
+    rx_thread.join();
+    tx_thread.join();
+
+    auto const rate = [&](std::size_t n) {
+        return static_cast<double>(n) / elapsed.count() / 1e6;
+    };
+    std::printf("batch %3zu %8.2f Mpps sent %8.2f Mpps received %6.2f%% "
+                "lost\n",
+                batch_size, rate(sent), rate(received),
+                sent ? 100.0 * static_cast<double>(sent - received) /
+                        static_cast<double>(sent)
+                     : 0.0);
+}
+
+int
+main(int argc, char* argv[])
+{
+    std::chrono::seconds const secs{argc > 1 ? std::atoi(argv[1]) : 2};
+    std::size_t const bytes =
+        argc > 2 ? static_cast<std::size_t>(std::atoi(argv[2])) : 64;
+    std::printf("%zu byte datagrams, %lld s per run\n", bytes,
+                static_cast<long long>(secs.count()));
+    for(std::size_t batch : {1, 4, 16, 64})
+        bench(batch, bytes, secs);
+}
@@ -0,0 +1,387 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+//
+#ifndef CORONET_AFFINITY_HPP
+#define CORONET_AFFINITY_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <fstream>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifndef CORONET_HAS_LIBNUMA
+#define CORONET_HAS_LIBNUMA 0
+#endif
+
+#if CORONET_HAS_LIBNUMA
+#include <numa.h>
+#endif
+
+#ifndef CORONET_MAX_NUMA_NODES
+#define CORONET_MAX_NUMA_NODES 64
+#endif
+
+#include <coronet/coronet.hpp>
+
+namespace coronet
+{
+    // Where an executor would prefer to run work. A negative value means
+    // "no preference". When only a core is given, executors that know the
+    // machine's topology map it to the core's node.
+    struct affinity
+    {
+        int node = -1;
+        int core = -1;
+
+        friend bool operator==(affinity a, affinity b) noexcept
+        {
+            return a.node == b.node && a.core == b.core;
+        }
+        friend bool operator!=(affinity a, affinity b) noexcept
+        {
+            return !(a == b);
+        }
+    };
+
+    // The set of CPUs belonging to each NUMA node. Use detect() for the real
+    // machine, or construct one directly to inject a fake topology (for
+    // instance, to exercise per-node scheduling on a single-node box).
+    struct topology
+    {
+    private:
+        std::vector<std::vector<int>> nodes_;
+
+        static std::vector<int> _parse_cpulist(std::string const& str)
+        {
+            // e.g., "0-3,8-11"
+            std::vector<int> cpus;
+            std::istringstream in{str};
+            std::string range;
+            while(std::getline(in, range, ','))
+            {
+                auto dash = range.find('-');
+                int first = std::stoi(range.substr(0, dash));
+                int last = dash == std::string::npos
+                               ? first
+                               : std::stoi(range.substr(dash + 1));
+                for(; first <= last; ++first)
+                    cpus.push_back(first);
+            }
+            return cpus;
+        }
+
+    public:
+        topology() = default;
+        explicit topology(std::vector<std::vector<int>> nodes)
+          : nodes_(std::move(nodes))
+        {}
+
+        // A single node with all of the machine's CPUs.
+        static topology single()
+        {
+            std::vector<int> cpus;
+            unsigned n = (std::max)(1u, std::thread::hardware_concurrency());
+            for(unsigned i = 0; i < n; ++i)
+                cpus.push_back(static_cast<int>(i));
+            return topology{{std::move(cpus)}};
+        }
+
+        // Read the topology from sysfs, falling back to single() if it is
+        // not available.
+        static topology detect()
+        {
+            std::vector<std::vector<int>> nodes;
+#ifdef __linux__
+            for(int node = 0; node < CORONET_MAX_NUMA_NODES; ++node)
+            {
+                std::ifstream file{"/sys/devices/system/node/node" +
+                                   std::to_string(node) + "/cpulist"};
+                std::string cpulist;
+                if(!file || !std::getline(file, cpulist))
+                    break;
+                nodes.push_back(_parse_cpulist(cpulist));
+            }
+#endif
+            if(nodes.empty())
+                return single();
+            return topology{std::move(nodes)};
+        }
+
+        std::size_t node_count() const noexcept
+        {
+            return nodes_.size();
+        }
+        std::vector<int> const& cpus(std::size_t node) const
+        {
+            return nodes_.at(node);
+        }
+        // The node of the given CPU, or -1 if it is unknown.
+        int node_of(int cpu) const noexcept
+        {
+            for(std::size_t node = 0; node < nodes_.size(); ++node)
+                for(int c : nodes_[node])
+                    if(c == cpu)
+                        return static_cast<int>(node);
+            return -1;
+        }
+    };
+
+    // Restrict the calling thread to the given CPUs. This is best-effort;
+    // CPUs that do not exist (as with a fake topology) are ignored.
+    inline void _pin_this_thread(std::vector<int> const& cpus) noexcept
+    {
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for(int cpu : cpus)
+            if(cpu >= 0 && cpu < CPU_SETSIZE)
+                CPU_SET(cpu, &set);
+        (void)::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set);
+#else
+        (void)cpus;
+#endif
+    }
+
+    // Get pages of memory that prefer the given NUMA node. A negative node
+    // means "no preference".
+    inline void* _numa_alloc_pages(std::size_t size, int node)
+    {
+#if CORONET_HAS_LIBNUMA
+        if(node >= 0 && ::numa_available() >= 0)
+        {
+            if(void* p = ::numa_alloc_onnode(size, node))
+                return p;
+            throw std::bad_alloc{};
+        }
+#endif
+#ifdef __linux__
+        void* p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(p == MAP_FAILED)
+            throw std::bad_alloc{};
+        if(node >= 0 && node < static_cast<int>(8 * sizeof(unsigned long)))
+        {
+            // Best-effort: if the node does not exist, the kernel's default
+            // policy applies.
+            unsigned long mask = 1ul << node;
+            (void)::syscall(SYS_mbind, p, size, MPOL_PREFERRED, &mask,
+                            8 * sizeof(mask), 0);
+        }
+        return p;
+#else
+        (void)node;
+        return ::operator new(size);
+#endif
+    }
+
+    inline void _numa_free_pages(void* p, std::size_t size) noexcept
+    {
+#if CORONET_HAS_LIBNUMA
+        if(::numa_available() >= 0)
+            return ::numa_free(p, size);
+#endif
+#ifdef __linux__
+        (void)::munmap(p, size);
+#else
+        (void)size;
+        ::operator delete(p);
+#endif
+    }
+
+    // A per-node heap of blocks of up to 64 KiB carved out of node-local
+    // chunks. Blocks are recycled through per-size-class free lists; chunks
+    // are never returned to the system. Only larger requests, for which
+    // the page faults cost more than the system calls, map pages of their
+    // own.
+    struct _numa_heap
+    {
+    private:
+        static constexpr std::size_t _min_block = 16;
+        static constexpr std::size_t _max_block = 64 * 1024;
+        static constexpr std::size_t _nclasses = 13; // 16, 32, ... 64 KiB
+        static constexpr std::size_t _chunk_size = 1u << 20;
+
+        struct _block
+        {
+            _block* next_;
+        };
+
+        std::mutex mtx_;
+        int node_ = -1;
+        _block* free_[_nclasses] = {};
+        char* cur_ = nullptr;
+        char* end_ = nullptr;
+
+        static std::size_t _size_class(std::size_t size) noexcept
+        {
+            std::size_t cls = 0;
+            for(std::size_t n = _min_block; n < size; n *= 2)
+                ++cls;
+            return cls;
+        }
+
+    public:
+        static _numa_heap& get(int node)
+        {
+            // Index 0 is the heap for "no preference".
+            static _numa_heap heaps[CORONET_MAX_NUMA_NODES + 1];
+            static std::once_flag once;
+            std::call_once(once, [] {
+                for(int i = 0; i <= CORONET_MAX_NUMA_NODES; ++i)
+                    heaps[i].node_ = i - 1;
+            });
+            if(node < 0 || node >= CORONET_MAX_NUMA_NODES)
+                node = -1;
+            return heaps[node + 1];
+        }
+
+        void* allocate(std::size_t size)
+        {
+            if(size > _max_block)
+                return _numa_alloc_pages(size, node_);
+            auto cls = _size_class(size);
+            std::lock_guard<std::mutex> lock{mtx_};
+            if(auto* b = free_[cls])
+            {
+                free_[cls] = b->next_;
+                return b;
+            }
+            std::size_t block = _min_block << cls;
+            if(static_cast<std::size_t>(end_ - cur_) < block)
+            {
+                auto* chunk = static_cast<char*>(
+                    _numa_alloc_pages(_chunk_size, node_));
+                // Hand the tail of the old chunk out in smaller blocks.
+                for(auto c = cls; c-- != 0;)
+                    if(static_cast<std::size_t>(end_ - cur_) >=
+                       (_min_block << c))
+                        free_[c] = ::new(std::exchange(
+                            cur_, cur_ + (_min_block << c))) _block{free_[c]};
+                cur_ = chunk;
+                end_ = cur_ + _chunk_size;
+            }
+            return std::exchange(cur_, cur_ + block);
+        }
+
+        void deallocate(void* p, std::size_t size) noexcept
+        {
+            if(size > _max_block)
+                return _numa_free_pages(p, size);
+            auto cls = _size_class(size);
+            std::lock_guard<std::mutex> lock{mtx_};
+            free_[cls] = ::new(p) _block{free_[cls]};
+        }
+    };
+
+    // An allocator that prefers memory local to one NUMA node. Use it as
+    // a completion token's allocator to place coroutine frames on the node
+    // of the executor that runs them:
+    //
+    //     auto token = coronet::yield(pool.get_executor(affinity{1}),
+    //                                 coronet::numa_allocator<>{1});
+    template<class T = void>
+    struct numa_allocator
+    {
+        using value_type = T;
+        int node_ = -1;
+
+        numa_allocator() = default;
+        explicit numa_allocator(int node) noexcept
+          : node_(node)
+        {}
+        template<class U>
+        numa_allocator(numa_allocator<U> const& that) noexcept
+          : node_(that.node_)
+        {}
+        T* allocate(std::size_t n)
+        {
+            return static_cast<T*>(
+                _numa_heap::get(node_).allocate(n * sizeof(T)));
+        }
+        void deallocate(T* p, std::size_t n) noexcept
+        {
+            _numa_heap::get(node_).deallocate(p, n * sizeof(T));
+        }
+        template<class U>
+        friend bool operator==(numa_allocator a, numa_allocator<U> b) noexcept
+        {
+            return a.node_ == b.node_;
+        }
+        template<class U>
+        friend bool operator!=(numa_allocator a, numa_allocator<U> b) noexcept
+        {
+            return !(a == b);
+        }
+    };
+
+    // An executor that can be told where it should prefer to run work.
+    struct CAffinityExecutor
+    {
+        template<class E>
+        auto requires_(E const& e, affinity a)
+            -> decltype(requires_<CExecutor, E>,
+                        e.with_affinity(a)->*satisfies<CExecutor>,
+                        e.get_affinity()->*satisfies<CConvertibleTo, affinity>);
+    };
+    template<class E>
+    inline constexpr bool AffinityExecutor =
+        is_satisfied_by<CAffinityExecutor, E>;
+
+    // The affinity that a completion token's executor prefers, if any.
+    CO_PP_template(class Token)(
+        requires CompletionToken<Token>)
+    affinity get_affinity(Token const& token)
+    {
+        if constexpr(AffinityExecutor<decltype(token.get_executor())>)
+            return token.get_executor().get_affinity();
+        else
+            return affinity{};
+    }
+
+    // Return a copy of the token whose executor prefers to run work
+    // according to aff. Since the awaiting coroutine's token is the one
+    // that final_suspend reposts to, the affinity is honored when resuming
+    // the caller too.
+    CO_PP_template(class E, class A)(
+        requires AffinityExecutor<E>)
+    auto with_affinity(yield_t<E, A> const& token, affinity aff)
+    {
+        return yield(token.get_executor().with_affinity(aff),
+                     token.get_allocator());
+    }
+
+    CO_PP_template(class E, class A)(
+        requires AffinityExecutor<E>)
+    auto with_affinity(via<E, A> const& token, affinity aff)
+    {
+        auto e = token.get_executor().with_affinity(aff);
+        return via<decltype(e), A>{e, token.get_allocator()};
+    }
+} // namespace coronet
+
+#endif
@@ -0,0 +1,363 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+//
+#ifndef CORONET_ANY_TASK_HPP
+#define CORONET_ANY_TASK_HPP
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include <meta/meta.hpp>
+
+#include <experimental/coroutine>
+#include <experimental/io_context> // for async_result
+
+#include <coronet/coronet.hpp>
+
+namespace coronet
+{
+    // Room for the executor and the allocator of an any_token. Enough for
+    // the executors and allocators of coronet and the Networking TS; bigger
+    // ones are rejected at compile time rather than put on the heap.
+    inline constexpr std::size_t _any_executor_size = 4 * sizeof(void*);
+    inline constexpr std::size_t _any_allocator_size = 2 * sizeof(void*);
+
+    // Copying an allocator may throw; coronet::allocator's copies allocate.
+    // Moving one may not.
+    struct _any_allocator_vtable
+    {
+        void (*copy)(void const*, void*);
+        void (*move)(void*, void*) noexcept;
+        void (*destroy)(void*) noexcept;
+        void* (*allocate)(void*, std::size_t);
+        void (*deallocate)(void*, void*, std::size_t) noexcept;
+        bool (*equal)(void const*, void const*) noexcept;
+    };
+
+    // A is a char allocator.
+    template<class A>
+    inline constexpr _any_allocator_vtable _any_allocator_vtable_for{
+        [](void const* from, void* to) {
+            ::new(to) A(*static_cast<A const*>(from));
+        },
+        [](void* from, void* to) noexcept {
+            ::new(to) A(std::move(*static_cast<A*>(from)));
+        },
+        [](void* p) noexcept { static_cast<A*>(p)->~A(); },
+        [](void* p, std::size_t n) -> void* {
+            return static_cast<A*>(p)->allocate(n);
+        },
+        [](void* p, void* q, std::size_t n) noexcept {
+            static_cast<A*>(p)->deallocate(static_cast<char*>(q), n);
+        },
+        [](void const* p, void const* q) noexcept -> bool {
+            return *static_cast<A const*>(p) == *static_cast<A const*>(q);
+        }};
+
+    template<class T>
+    struct _any_allocator;
+
+    template<class A>
+    inline constexpr bool _is_any_allocator = false;
+
+    template<class T>
+    inline constexpr bool _is_any_allocator<_any_allocator<T>> = true;
+
+    // An allocator of erased type, stored in place.
+    template<class T = void>
+    struct _any_allocator
+    {
+    private:
+        template<class>
+        friend struct _any_allocator;
+        _any_allocator_vtable const* vtbl_;
+        alignas(void*) unsigned char buf_[_any_allocator_size];
+
+    public:
+        using value_type = T;
+
+        CO_PP_template(class A)(
+            requires Allocator<A> && !_is_any_allocator<A>)
+        explicit _any_allocator(A const& a)
+          : vtbl_(&_any_allocator_vtable_for<rebind_alloc<A, char>>)
+        {
+            using A2 = rebind_alloc<A, char>;
+            static_assert(sizeof(A2) <= _any_allocator_size &&
+                              alignof(A2) <= alignof(void*),
+                          "This allocator is too big for an any_token.");
+            static_assert(std::is_nothrow_move_constructible_v<A2>,
+                          "Allocators must not throw when moved.");
+            ::new(static_cast<void*>(buf_)) A2(a);
+        }
+        _any_allocator(_any_allocator const& that)
+          : vtbl_(that.vtbl_)
+        {
+            vtbl_->copy(that.buf_, buf_);
+        }
+        CO_PP_template(class U)(
+            requires !Same<T, U>)
+        _any_allocator(_any_allocator<U> const& that)
+          : vtbl_(that.vtbl_)
+        {
+            vtbl_->copy(that.buf_, buf_);
+        }
+        _any_allocator& operator=(_any_allocator const& that)
+        {
+            if(this != &that)
+            {
+                _any_allocator copy(that);
+                vtbl_->destroy(buf_);
+                vtbl_ = copy.vtbl_;
+                vtbl_->move(copy.buf_, buf_);
+            }
+            return *this;
+        }
+        ~_any_allocator()
+        {
+            vtbl_->destroy(buf_);
+        }
+        T* allocate(std::size_t n)
+        {
+            return static_cast<T*>(vtbl_->allocate(buf_, n * sizeof(T)));
+        }
+        void deallocate(T* p, std::size_t n) noexcept
+        {
+            vtbl_->deallocate(buf_, p, n * sizeof(T));
+        }
+        // The erased allocator, rebound to char, if it came from an A.
+        template<class A>
+        rebind_alloc<A, char> const* target() const noexcept
+        {
+            if(vtbl_ != &_any_allocator_vtable_for<rebind_alloc<A, char>>)
+                return nullptr;
+            return std::launder(
+                reinterpret_cast<rebind_alloc<A, char> const*>(buf_));
+        }
+        template<class U>
+        friend bool operator==(
+            _any_allocator const& a, _any_allocator<U> const& b) noexcept
+        {
+            return a.vtbl_ == b.vtbl_ && a.vtbl_->equal(a.buf_, b.buf_);
+        }
+        template<class U>
+        friend bool operator!=(
+            _any_allocator const& a, _any_allocator<U> const& b) noexcept
+        {
+            return !(a == b);
+        }
+    };
+
+    struct _any_executor_vtable
+    {
+        void (*copy)(void const*, void*) noexcept;
+        void (*destroy)(void*) noexcept;
+        void (*post)(void const*, std::experimental::coroutine_handle<>,
+                     _any_allocator<> const&);
+        void (*post_fn)(void const*, std::function<void()>,
+                        _any_allocator<> const&);
+        bool (*equal)(void const*, void const*) noexcept;
+    };
+
+    template<class E>
+    inline constexpr _any_executor_vtable _any_executor_vtable_for{
+        [](void const* from, void* to) noexcept {
+            ::new(to) E(*static_cast<E const*>(from));
+        },
+        [](void* p) noexcept { static_cast<E*>(p)->~E(); },
+        [](void const* p, std::experimental::coroutine_handle<> h,
+           _any_allocator<> const& a) {
+            auto const& e = *static_cast<E const*>(p);
+            if constexpr(Same<E, _implicit_executor>)
+                e.resume(h);
+            else
+                e.post(h, a);
+        },
+        [](void const* p, std::function<void()> fn,
+           _any_allocator<> const& a) {
+            static_cast<E const*>(p)->post(std::move(fn), a);
+        },
+        [](void const* p, void const* q) noexcept -> bool {
+            return *static_cast<E const*>(p) == *static_cast<E const*>(q);
+        }};
+
+    // An executor of erased type, stored in place. Posting a coroutine does
+    // not allocate; posting anything else wraps it in a std::function.
+    struct _any_executor
+    {
+    private:
+        _any_executor_vtable const* vtbl_;
+        alignas(void*) unsigned char buf_[_any_executor_size];
+
+        template<class Fn>
+        void _post(Fn fn, _any_allocator<> const& a) const
+        {
+            using handle_t = std::experimental::coroutine_handle<>;
+            if constexpr(ConvertibleTo<Fn, handle_t>)
+                vtbl_->post(buf_, fn, a);
+            else
+                vtbl_->post_fn(buf_, std::function<void()>(std::move(fn)), a);
+        }
+
+    public:
+        CO_PP_template(class E)(
+            requires Executor<E> && !Same<E, _any_executor>)
+        explicit _any_executor(E const& e) noexcept
+          : vtbl_(&_any_executor_vtable_for<E>)
+        {
+            static_assert(sizeof(E) <= _any_executor_size &&
+                              alignof(E) <= alignof(void*),
+                          "This executor is too big for an any_token.");
+            ::new(static_cast<void*>(buf_)) E(e);
+        }
+        _any_executor(_any_executor const& that) noexcept
+          : vtbl_(that.vtbl_)
+        {
+            vtbl_->copy(that.buf_, buf_);
+        }
+        _any_executor& operator=(_any_executor const& that) noexcept
+        {
+            if(this != &that)
+            {
+                vtbl_->destroy(buf_);
+                vtbl_ = that.vtbl_;
+                vtbl_->copy(that.buf_, buf_);
+            }
+            return *this;
+        }
+        ~_any_executor()
+        {
+            vtbl_->destroy(buf_);
+        }
+        CO_PP_template(class Fn, class Alloc)(
+            requires Invocable<Fn&> && Allocator<Alloc>)
+        void post(Fn fn, Alloc const& a) const
+        {
+            if constexpr(Same<Alloc, _any_allocator<>>)
+                _post(std::move(fn), a);
+            else
+                _post(std::move(fn), _any_allocator<>(a));
+        }
+        // The erased executor, if it is an E.
+        template<class E>
+        E const* target() const noexcept
+        {
+            if(vtbl_ != &_any_executor_vtable_for<E>)
+                return nullptr;
+            return std::launder(reinterpret_cast<E const*>(buf_));
+        }
+        friend bool operator==(
+            _any_executor const& a, _any_executor const& b) noexcept
+        {
+            return a.vtbl_ == b.vtbl_ && a.vtbl_->equal(a.buf_, b.buf_);
+        }
+        friend bool operator!=(
+            _any_executor const& a, _any_executor const& b) noexcept
+        {
+            return !(a == b);
+        }
+    };
+
+    // A completion token of erased type, for async operations that cannot be
+    // templates, like virtual functions and functions behind an ABI
+    // boundary. Such an operation takes an any_token and returns an
+    // any_task:
+    //
+    //     struct stream
+    //     {
+    //         virtual coronet::any_task<std::size_t> async_read(
+    //             buffer buf, coronet::any_token token) = 0;
+    //
+    //         auto async_read(buffer buf)
+    //         {
+    //             return coronet::callable_with_implicit_context{
+    //                 [this, buf](auto token) {
+    //                     return this->async_read(
+    //                         buf, coronet::any_token{token});
+    //                 }};
+    //         }
+    //     };
+    //
+    // Each override is instantiated once, whatever tokens its callers use.
+    // The executor and the allocator are kept in place, so erasing them
+    // allocates nothing beyond what copying them does, and the coroutine
+    // frame is allocated with the erased allocator. When the awaiting
+    // coroutine already runs in the token's execution context, as it always
+    // does for the token-less form, the operation runs inline: that check
+    // compares vtable pointers instead of calling through them, and no post
+    // is needed on the way in or out.
+    struct any_token
+    {
+    private:
+        _any_executor exec_;
+        _any_allocator<> alloc_;
+        bool implicit_;
+
+    public:
+        CO_PP_template(class Token)(
+            requires CompletionToken<Token> && !Same<Token, any_token>)
+        explicit any_token(Token const& token)
+          : exec_(token.get_executor())
+          , alloc_(token.get_allocator())
+          , implicit_(meta::is<Token, _implicit_yield_t>::value)
+        {}
+        _any_executor const& get_executor() const noexcept
+        {
+            return exec_;
+        }
+        _any_allocator<> const& get_allocator() const noexcept
+        {
+            return alloc_;
+        }
+        template<class Token>
+        bool _same_context(Token const& that) const
+        {
+            if(implicit_)
+                return true;
+            if constexpr(Same<Token, any_token>)
+                return exec_ == that.exec_ && alloc_ == that.alloc_;
+            else
+            {
+                using E = std::decay_t<decltype(that.get_executor())>;
+                using A = std::decay_t<decltype(that.get_allocator())>;
+                auto const* e = exec_.target<E>();
+                auto const* a = alloc_.target<A>();
+                return e && a && *e == that.get_executor() &&
+                       (typename std::allocator_traits<
+                            A>::is_always_equal() ||
+                        *a == rebind_alloc<A, char>(that.get_allocator()));
+            }
+        }
+    };
+
+    // The result of an async operation that was given an any_token.
+    template<class T>
+    using any_task = task<T, any_token>;
+} // namespace coronet
+
+namespace std::experimental::net
+{
+    template<class Ret, class... Args>
+    struct async_result<coronet::any_token, Ret(Args...)>
+      : coronet::_async_result_impl_<coronet::any_token, Ret,
+                                     meta::list<std::decay_t<Args>...>,
+                                     meta::quote<coronet::task>>
+    {
+        using async_result::_async_result_impl_::_async_result_impl_;
+    };
+} // namespace std::experimental::net
+
+#endif
@@ -0,0 +1,201 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+//
+#ifndef CORONET_ARENA_ALLOCATOR_HPP
+#define CORONET_ARENA_ALLOCATOR_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+#include <coronet/detail/allocator.hpp>
+
+namespace coronet
+{
+    struct alignas(std::max_align_t) _arena_chunk
+    {
+        _arena_chunk* next_ = nullptr; // The chunk allocated before this one.
+        std::size_t size_ = 0;
+
+        char* data() noexcept
+        {
+            return reinterpret_cast<char*>(this + 1);
+        }
+    };
+
+    // A list of chunks that allocations are carved out of, front to back,
+    // and that are freed together with the arena. The arena lives at the
+    // front of its first chunk, so a request whose frames fit in that
+    // chunk costs a single call to operator new.
+    struct _arena
+    {
+        static constexpr std::size_t _align = alignof(std::max_align_t);
+        static constexpr std::size_t _max_chunk = std::size_t(1) << 20;
+
+        std::atomic<std::size_t> refs_{1};
+        char* next_;
+        char* end_;
+        std::size_t next_size_;
+        _arena_chunk* chunks_ = nullptr; // All but the first.
+        _arena_chunk first_;
+
+        explicit _arena(std::size_t size) noexcept
+          : next_(first_.data())
+          , end_(first_.data() + size)
+          , next_size_((std::min)(size * 2, _max_chunk))
+        {
+            first_.size_ = size;
+        }
+        _arena(_arena&&) = delete;
+
+        static _arena* create(std::size_t size)
+        {
+            size = (size + _align - 1) & ~(_align - 1);
+            return ::new(::operator new(sizeof(_arena) + size)) _arena(size);
+        }
+        void acquire() noexcept
+        {
+            refs_.fetch_add(1, std::memory_order_relaxed);
+        }
+        void release() noexcept
+        {
+            if(refs_.fetch_sub(1, std::memory_order_acq_rel) != 1)
+                return;
+            for(auto* c = chunks_; c;)
+                ::operator delete(std::exchange(c, c->next_));
+            this->~_arena();
+            ::operator delete(static_cast<void*>(this));
+        }
+
+        void* _allocate_slow(std::size_t n)
+        {
+            auto const size = (std::max)(n, next_size_);
+            auto* const c = ::new(::operator new(sizeof(_arena_chunk) + size))
+                _arena_chunk{chunks_, size};
+            chunks_ = c;
+            // A block too big to share a chunk gets one of its own, and
+            // what is left of the current chunk stays in use.
+            if(n > next_size_ / 4)
+                return c->data();
+            next_size_ = (std::min)(next_size_ * 2, _max_chunk);
+            next_ = c->data() + n;
+            end_ = c->data() + size;
+            return c->data();
+        }
+        void* allocate(std::size_t n, std::size_t align)
+        {
+            if(align > _align)
+                n += align - _align;
+            n = (n + _align - 1) & ~(_align - 1);
+            void* p;
+            if(static_cast<std::size_t>(end_ - next_) >= n)
+                p = std::exchange(next_, next_ + n);
+            else
+                p = _allocate_slow(n);
+            if(align > _align)
+            {
+                auto const u = reinterpret_cast<std::uintptr_t>(p);
+                p = reinterpret_cast<void*>((u + align - 1) & ~(align - 1));
+            }
+            return p;
+        }
+    };
+
+    // An allocator that carves everything it allocates out of one
+    // monotonic arena, and frees nothing until the last copy of it is
+    // gone. Default construction starts a new arena. Give one to the
+    // token of a root operation:
+    //
+    //     root(args..., coronet::yield(e, coronet::arena_allocator<>{}));
+    //
+    // and the frames of everything the root awaits without a token of its
+    // own come from the same arena, since implicit tokens carry the
+    // parent's allocator. The frames hold copies of the allocator, so the
+    // whole arena is released at once, when the root's frame is destroyed.
+    //
+    // Like std::pmr::monotonic_buffer_resource, an arena is not
+    // synchronized: the awaits in a tree of operations run one after
+    // another, handed from executor to executor, which is enough; branches
+    // that run at the same time on different threads need arenas of their
+    // own. Only the count of copies is atomic, since the caller's token
+    // and the root's frame drop theirs on different threads.
+    template<class T = void>
+    struct arena_allocator
+    {
+        using value_type = T;
+
+    private:
+        _arena* arena_;
+
+    public:
+        arena_allocator()
+          : arena_allocator(4096)
+        {}
+        // first_chunk is the room in the first chunk; each chunk after it
+        // is twice the size of the one before, up to a megabyte.
+        explicit arena_allocator(std::size_t first_chunk)
+          : arena_(_arena::create(first_chunk))
+        {}
+        // There is no move constructor: a moved-from allocator must still
+        // be usable, so a move copies, and shares the arena.
+        arena_allocator(arena_allocator const& that) noexcept
+          : arena_(that.arena_)
+        {
+            arena_->acquire();
+        }
+        template<class U>
+        arena_allocator(arena_allocator<U> const& that) noexcept
+          : arena_(that._get_arena())
+        {
+            arena_->acquire();
+        }
+        arena_allocator& operator=(arena_allocator that) noexcept
+        {
+            std::swap(arena_, that.arena_);
+            return *this;
+        }
+        ~arena_allocator()
+        {
+            arena_->release();
+        }
+
+        T* allocate(std::size_t n)
+        {
+            return static_cast<T*>(
+                arena_->allocate(n * sizeof(T), alignof(T)));
+        }
+        void deallocate(T*, std::size_t) noexcept {}
+        _arena* _get_arena() const noexcept
+        {
+            return arena_;
+        }
+
+        template<class U>
+        friend bool operator==(arena_allocator const& a,
+                               arena_allocator<U> const& b) noexcept
+        {
+            return a.arena_ == b._get_arena();
+        }
+        template<class U>
+        friend bool operator!=(arena_allocator const& a,
+                               arena_allocator<U> const& b) noexcept
+        {
+            return !(a == b);
+        }
+    };
+} // namespace coronet
+
+#endif
@@ -0,0 +1,547 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+//
+#ifndef CORONET_ASYNC_CACHE_HPP
+#define CORONET_ASYNC_CACHE_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <experimental/coroutine>
+
+#include <coronet/coronet.hpp>
+#include <coronet/detail/waiter.hpp>
+
+namespace coronet
+{
+    // The table behind async_cache and single_flight: keys are spread over
+    // shards, each an open-addressing table with linear probing under a
+    // lock of its own. A key is either loading, with the coroutines that
+    // wait for it listed in its slot, or ready, with its value and expiry.
+    // Ready keys are evicted by the CLOCK algorithm when a shard is full.
+    // With a ttl of zero, values are handed to the waiters and dropped.
+    template<class K, class V, class Hash, class Eq>
+    struct _flight_table
+    {
+        using clock_type = std::chrono::steady_clock;
+
+    private:
+        enum class _state : unsigned char
+        {
+            empty,
+            tombstone,
+            loading,
+            ready
+        };
+        struct _slot
+        {
+            _state state_ = _state::empty;
+            bool referenced_ = false;
+            std::uint64_t hash_ = 0;
+            std::optional<K> key_;
+            std::optional<V> value_;
+            clock_type::time_point expiry_{};
+            _waiter* waiters_ = nullptr; // While loading; in no order.
+        };
+        struct alignas(64) _shard
+        {
+            std::mutex mtx_;
+            std::vector<_slot> slots_;
+            std::size_t size_ = 0; // Loading and ready slots.
+            std::size_t used_ = 0; // And tombstones.
+            std::size_t hand_ = 0; // The CLOCK hand.
+        };
+
+        std::unique_ptr<_shard[]> shards_;
+        std::size_t shard_mask_;
+        std::size_t shard_capacity_;
+        clock_type::duration ttl_;
+        Hash hash_;
+        Eq eq_;
+
+        static std::size_t _pow2(std::size_t n) noexcept
+        {
+            std::size_t p = 1;
+            while(p < n)
+                p *= 2;
+            return p;
+        }
+        std::uint64_t _hash(K const& key) const
+        {
+            // Mix, so that weak hashes such as the identity spread over
+            // the shards and the slots alike.
+            auto h = static_cast<std::uint64_t>(hash_(key)) *
+                     0x9E3779B97F4A7C15ull;
+            return h ^ (h >> 32);
+        }
+        _shard& _shard_of(std::uint64_t h) const noexcept
+        {
+            return shards_[(h >> 48) & shard_mask_];
+        }
+        bool _expired(_slot const& s, clock_type::time_point now) const
+            noexcept
+        {
+            return ttl_ == clock_type::duration::zero() || s.expiry_ <= now;
+        }
+        static void _erase(_shard& sh, _slot& s) noexcept
+        {
+            s.state_ = _state::tombstone;
+            s.key_.reset();
+            s.value_.reset();
+            s.waiters_ = nullptr;
+            --sh.size_;
+        }
+        // The slot of key, or nullptr.
+        _slot* _find(_shard& sh, std::uint64_t h, K const& key) const
+        {
+            auto const mask = sh.slots_.size() - 1;
+            for(auto i = h & mask;; i = (i + 1) & mask)
+            {
+                auto& s = sh.slots_[i];
+                if(s.state_ == _state::empty)
+                    return nullptr;
+                if(s.state_ != _state::tombstone && s.hash_ == h &&
+                   eq_(*s.key_, key))
+                    return &s;
+            }
+        }
+        // Evict one ready slot, taking expired ones first and giving
+        // recently used ones a second chance.
+        bool _evict_one(_shard& sh, clock_type::time_point now) noexcept
+        {
+            auto const n = sh.slots_.size();
+            for(std::size_t step = 0; step != 2 * n; ++step)
+            {
+                auto& s = sh.slots_[sh.hand_];
+                sh.hand_ = (sh.hand_ + 1) & (n - 1);
+                if(s.state_ != _state::ready)
+                    continue;
+                if(s.referenced_ && !_expired(s, now))
+                {
+                    s.referenced_ = false;
+                    continue;
+                }
+                _erase(sh, s);
+                return true;
+            }
+            return false;
+        }
+        // Rehash in place, dropping the tombstones.
+        void _rebuild(_shard& sh)
+        {
+            std::vector<_slot> old(sh.slots_.size());
+            old.swap(sh.slots_);
+            auto const mask = sh.slots_.size() - 1;
+            for(auto& s : old)
+            {
+                if(s.state_ == _state::empty || s.state_ == _state::tombstone)
+                    continue;
+                auto i = s.hash_ & mask;
+                while(sh.slots_[i].state_ != _state::empty)
+                    i = (i + 1) & mask;
+                sh.slots_[i] = std::move(s);
+            }
+            sh.used_ = sh.size_;
+        }
+        // A new loading slot for key, or nullptr if the shard has no room.
+        _slot* _insert(_shard& sh, std::uint64_t h, K const& key,
+                       clock_type::time_point now)
+        {
+            if(sh.size_ >= shard_capacity_)
+                _evict_one(sh, now);
+            auto const limit = sh.slots_.size() / 4 * 3;
+            if(sh.size_ >= limit)
+                return nullptr;
+            if(sh.used_ >= limit)
+                _rebuild(sh);
+            auto const mask = sh.slots_.size() - 1;
+            auto i = h & mask;
+            while(sh.slots_[i].state_ == _state::loading ||
+                  sh.slots_[i].state_ == _state::ready)
+                i = (i + 1) & mask;
+            auto& s = sh.slots_[i];
+            if(s.state_ == _state::empty)
+                ++sh.used_;
+            ++sh.size_;
+            s.state_ = _state::loading;
+            s.referenced_ = false;
+            s.hash_ = h;
+            s.key_.emplace(key);
+            return &s;
+        }
+
+    public:
+        // What a lookup found.
+        enum class _found
+        {
+            value,   // A fresh value, now in value_.
+            loading, // Someone else is loading it.
+            leader,  // Nobody was; the caller must load it and publish.
+            bypass   // No room to track it; the caller must load it alone.
+        };
+
+        struct _lookup : _waiter
+        {
+            _flight_table* table_;
+            K const* key_;
+            _found found_ = _found::loading;
+            std::optional<V> value_;
+            std::exception_ptr eptr_{};
+
+            _lookup(_flight_table* table, K const& key) noexcept
+              : table_(table)
+              , key_(&key)
+            {}
+            bool await_ready()
+            {
+                return table_->_try_get(*this);
+            }
+            template<class Promise>
+            bool await_suspend(
+                std::experimental::coroutine_handle<Promise> awaiter)
+            {
+                set_coroutine(awaiter);
+                return !table_->_try_get(*this, true);
+            }
+            _lookup await_resume()
+            {
+                if(eptr_)
+                    std::rethrow_exception(std::move(eptr_));
+                return std::move(*this);
+            }
+        };
+
+        _flight_table(std::size_t capacity, clock_type::duration ttl,
+                      std::size_t shards, Hash hash, Eq eq)
+          : shard_mask_(_pow2((std::max)(std::size_t(1), shards)) - 1)
+          , ttl_((std::max)(ttl, clock_type::duration::zero()))
+          , hash_(std::move(hash))
+          , eq_(std::move(eq))
+        {
+            auto const n = shard_mask_ + 1;
+            shard_capacity_ =
+                (std::max)(std::size_t(1), (capacity + n - 1) / n);
+            shards_ = std::make_unique<_shard[]>(n);
+            for(std::size_t i = 0; i != n; ++i)
+                shards_[i].slots_.resize(_pow2(shard_capacity_ * 2 + 2));
+        }
+        _flight_table(_flight_table&&) = delete;
+
+        // Look key up. Under the lock, a fresh value is copied out, a
+        // loading key gets the waiter queued on it if wait is set, and a
+        // missing or stale key is claimed for loading. Returns false only
+        // when the lookup has to wait.
+        bool _try_get(_lookup& l, bool wait = false)
+        {
+            auto const h = _hash(*l.key_);
+            auto& sh = _shard_of(h);
+            auto const now = clock_type::now();
+            std::lock_guard<std::mutex> lock{sh.mtx_};
+            if(auto* s = _find(sh, h, *l.key_))
+            {
+                if(s->state_ == _state::loading)
+                {
+                    if(!wait)
+                        return false;
+                    l.next_ = std::exchange(s->waiters_, &l);
+                    return false;
+                }
+                if(!_expired(*s, now))
+                {
+                    s->referenced_ = true;
+                    l.value_.emplace(*s->value_);
+                    l.found_ = _found::value;
+                    return true;
+                }
+                s->state_ = _state::loading;
+                s->value_.reset();
+                l.found_ = _found::leader;
+                return true;
+            }
+            l.found_ = _insert(sh, h, *l.key_, now) ? _found::leader
+                                                   : _found::bypass;
+            return true;
+        }
+
+        // Hand the outcome of loading key, either a value or an exception,
+        // to its waiters, resuming each in its own execution context, and
+        // keep the value until its ttl runs out. If copying the value
+        // throws, the exception is handed on in its place.
+        void _publish(K const& key, V const* value, std::exception_ptr eptr)
+        {
+            auto const h = _hash(key);
+            auto& sh = _shard_of(h);
+            _waiter* waiters = nullptr;
+            {
+                std::lock_guard<std::mutex> lock{sh.mtx_};
+                auto* s = _find(sh, h, key);
+                if(!s || s->state_ != _state::loading)
+                    return;
+                // Fill the slot before detaching the waiters, so that none
+                // is left behind on a slot that stays loading.
+                if(value && ttl_ != clock_type::duration::zero())
+                {
+                    try
+                    {
+                        s->value_.emplace(*value);
+                        s->state_ = _state::ready;
+                        s->expiry_ = clock_type::now() + ttl_;
+                    }
+                    catch(...)
+                    {
+                        value = nullptr;
+                        eptr = std::current_exception();
+                    }
+                }
+                waiters = std::exchange(s->waiters_, nullptr);
+                if(s->state_ != _state::ready)
+                    _erase(sh, *s);
+            }
+            for(auto* w = waiters; w; w = w->next_)
+            {
+                auto* l = static_cast<_lookup*>(w);
+                l->found_ = _found::value;
+                if(!value)
+                    l->eptr_ = eptr;
+                else
+                {
+                    try
+                    {
+                        l->value_.emplace(*value);
+                    }
+                    catch(...)
+                    {
+                        l->eptr_ = std::current_exception();
+                    }
+                }
+            }
+            _resume_all(waiters);
+        }
+
+        // Get key's value, loading it by awaiting load(key) if there is no
+        // fresh one, and no other coroutine is already loading it.
+        template<class Load, class Token>
+        auto _get(K key, Load load, Token token) -> result_t<Token, V(K, Load)>
+        {
+            INITIAL_SUSPEND(token);
+            auto l = co_await _lookup{this, key};
+            if(l.found_ == _found::value)
+                co_return std::move(*l.value_);
+            if(l.found_ == _found::bypass)
+                co_return co_await load(key);
+            std::optional<V> value;
+            try
+            {
+                value.emplace(co_await load(key));
+            }
+            catch(...)
+            {
+                _publish(key, nullptr, std::current_exception());
+                throw;
+            }
+            _publish(key, &*value, nullptr);
+            co_return std::move(*value);
+        }
+
+        // Drop key's value, if it has one. A load in flight is left alone.
+        void erase(K const& key)
+        {
+            auto const h = _hash(key);
+            auto& sh = _shard_of(h);
+            std::lock_guard<std::mutex> lock{sh.mtx_};
+            auto* s = _find(sh, h, key);
+            if(s && s->state_ == _state::ready)
+                _erase(sh, *s);
+        }
+        // Drop every value. Loads in flight are left alone.
+        void clear()
+        {
+            for(std::size_t i = 0; i <= shard_mask_; ++i)
+            {
+                auto& sh = shards_[i];
+                std::lock_guard<std::mutex> lock{sh.mtx_};
+                for(auto& s : sh.slots_)
+                    if(s.state_ == _state::ready)
+                        _erase(sh, s);
+            }
+        }
+        // The number of keys cached or loading.
+        std::size_t size() const
+        {
+            std::size_t n = 0;
+            for(std::size_t i = 0; i <= shard_mask_; ++i)
+            {
+                std::lock_guard<std::mutex> lock{shards_[i].mtx_};
+                n += shards_[i].size_;
+            }
+            return n;
+        }
+        clock_type::duration ttl() const noexcept
+        {
+            return ttl_;
+        }
+        std::size_t capacity() const noexcept
+        {
+            return shard_capacity_ * (shard_mask_ + 1);
+        }
+    };
+
+    inline std::size_t _default_shards() noexcept
+    {
+        return 4 * (std::max)(1u, std::thread::hardware_concurrency());
+    }
+
+    // A cache of values that are expensive to get, such as the responses
+    // of a backend, that coalesces concurrent misses. The first coroutine
+    // to miss on a key loads its value; the others that ask for the key
+    // meanwhile wait for that load, and are resumed each in its own
+    // execution context with a copy of the value, or of the exception it
+    // failed with. Failures are not cached. Values are kept for ttl after
+    // they are loaded, and at most about capacity of them at once, the
+    // least recently used going first. V should be cheap to copy, since
+    // every hit copies it under a shard's lock; a shared_ptr is a good V
+    // for big values.
+    //
+    // The keys are spread over shards, each with its own lock, so that
+    // lookups of different keys seldom contend.
+    template<class K, class V, class Hash = std::hash<K>,
+             class Eq = std::equal_to<K>>
+    struct async_cache
+    {
+    private:
+        _flight_table<K, V, Hash, Eq> table_;
+
+    public:
+        using clock_type = std::chrono::steady_clock;
+
+        async_cache(std::size_t capacity, clock_type::duration ttl,
+                    std::size_t shards = _default_shards(), Hash hash = {},
+                    Eq eq = {})
+          : table_(capacity, ttl, (std::min)(shards, capacity), std::move(hash),
+                   std::move(eq))
+        {}
+
+        // Complete with key's value, getting it if need be by awaiting
+        // load(key), an async operation that has not been given its token,
+        // such as `fetch(key)`. load is called from the coroutine that
+        // missed, so it runs in that coroutine's execution context.
+        CO_PP_template(class Load, class Token)(
+            requires CompletionToken<Token>)
+        auto async_get(K key, Load load, Token token)
+            -> result_t<Token, V(K, Load)>
+        {
+            return table_._get(std::move(key), std::move(load), token);
+        }
+        template<class Load>
+        auto async_get(K key, Load load)
+        {
+            return callable_with_implicit_context{
+                [this, key = std::move(key),
+                 load = std::move(load)](auto token) mutable {
+                    return table_._get(std::move(key), std::move(load),
+                                       token);
+                }};
+        }
+
+        void erase(K const& key)
+        {
+            table_.erase(key);
+        }
+        void clear()
+        {
+            table_.clear();
+        }
+        // The number of keys cached or being loaded.
+        std::size_t size() const
+        {
+            return table_.size();
+        }
+        std::size_t capacity() const noexcept
+        {
+            return table_.capacity();
+        }
+        clock_type::duration ttl() const noexcept
+        {
+            return table_.ttl();
+        }
+    };
+
+    // Wraps an async operation that takes a key, such as a coronet::async,
+    // so that concurrent calls with equal keys share one call to it. The
+    // value is not kept once the callers have it; for that, use
+    // async_cache. For an operation of several arguments, make K a tuple.
+    // max_in_flight bounds the number of keys tracked at once; calls for
+    // keys beyond it go straight to the operation.
+    template<class K, class V, class Fn, class Hash = std::hash<K>,
+             class Eq = std::equal_to<K>>
+    struct single_flight
+    {
+    private:
+        Fn fn_;
+        _flight_table<K, V, Hash, Eq> table_;
+
+        auto _load() const
+        {
+            return [this](K const& key) { return fn_(key); };
+        }
+
+    public:
+        explicit single_flight(Fn fn, std::size_t max_in_flight = 4096,
+                               std::size_t shards = _default_shards(),
+                               Hash hash = {}, Eq eq = {})
+          : fn_(std::move(fn))
+          , table_(max_in_flight, std::chrono::steady_clock::duration::zero(),
+                   (std::min)(shards, max_in_flight), std::move(hash),
+                   std::move(eq))
+        {}
+
+        CO_PP_template(class Token)(
+            requires CompletionToken<Token>)
+        auto operator()(K key, Token token) -> result_t<Token, V(K)>
+        {
+            return table_._get(std::move(key), _load(), token);
+        }
+        auto operator()(K key)
+        {
+            return callable_with_implicit_context{
+                [this, key = std::move(key)](auto token) mutable {
+                    return table_._get(std::move(key), _load(), token);
+                }};
+        }
+        // The number of keys being loaded.
+        std::size_t size() const
+        {
+            return table_.size();
+        }
+    };
+
+    // Deduces Fn, which a single_flight cannot do from K and V alone.
+    template<class K, class V, class Fn>
+    single_flight<K, V, Fn> make_single_flight(
+        Fn fn, std::size_t max_in_flight = 4096)
+    {
+        return single_flight<K, V, Fn>{std::move(fn), max_in_flight};
+    }
+} // namespace coronet
+
+#endif
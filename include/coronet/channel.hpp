@@ -0,0 +1,243 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+//
+#ifndef CORONET_CHANNEL_HPP
+#define CORONET_CHANNEL_HPP
+
+#include <cstddef>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <experimental/coroutine>
+
+#include <coronet/coronet.hpp>
+#include <coronet/detail/waiter.hpp>
+
+namespace coronet
+{
+    struct channel_closed : std::logic_error
+    {
+        channel_closed()
+          : std::logic_error("coronet::channel is closed")
+        {}
+    };
+
+    // A bounded multi-producer, multi-consumer queue for passing values
+    // between coroutines. async_send suspends while the channel is full, and
+    // async_receive suspends while it is empty. Suspended operations are
+    // queued intrusively in their own coroutine frames, and each one is
+    // resumed on its own executor. A capacity of 0 makes every send
+    // rendezvous with a receive.
+    //
+    // Once the channel is closed, sends fail with channel_closed, and
+    // receives fail with channel_closed after the buffered values are
+    // drained.
+    template<class T>
+    struct channel
+    {
+    private:
+        struct _send_awaitable : _waiter
+        {
+            channel* chan_;
+            T* value_;
+            bool closed_ = false;
+
+            _send_awaitable(channel* chan, T* value) noexcept
+              : chan_(chan)
+              , value_(value)
+            {}
+            static constexpr bool await_ready() noexcept
+            {
+                return false;
+            }
+            template<class Promise>
+            bool await_suspend(
+                std::experimental::coroutine_handle<Promise> awaiter)
+            {
+                set_coroutine(awaiter);
+                return chan_->_send_or_enqueue(this);
+            }
+            void await_resume() const
+            {
+                if(closed_)
+                    throw channel_closed{};
+            }
+        };
+
+        struct _receive_awaitable : _waiter
+        {
+            channel* chan_;
+            std::optional<T> value_{};
+
+            explicit _receive_awaitable(channel* chan) noexcept
+              : chan_(chan)
+            {}
+            static constexpr bool await_ready() noexcept
+            {
+                return false;
+            }
+            template<class Promise>
+            bool await_suspend(
+                std::experimental::coroutine_handle<Promise> awaiter)
+            {
+                set_coroutine(awaiter);
+                return chan_->_receive_or_enqueue(this);
+            }
+            T await_resume()
+            {
+                if(!value_)
+                    throw channel_closed{};
+                return std::move(*value_);
+            }
+        };
+
+        std::mutex mtx_;
+        std::vector<std::optional<T>> ring_;
+        std::size_t head_ = 0;
+        std::size_t size_ = 0;
+        bool closed_ = false;
+        _waiter_queue senders_;
+        _waiter_queue receivers_;
+
+        void _push(T&& value)
+        {
+            ring_[(head_ + size_++) % ring_.size()].emplace(std::move(value));
+        }
+        T _pop()
+        {
+            auto& slot = ring_[head_];
+            head_ = (head_ + 1) % ring_.size();
+            --size_;
+            T value = std::move(*slot);
+            slot.reset();
+            return value;
+        }
+
+        // Returns true if the sender must wait.
+        bool _send_or_enqueue(_send_awaitable* s)
+        {
+            std::unique_lock<std::mutex> lock{mtx_};
+            if(closed_)
+            {
+                s->closed_ = true;
+                return false;
+            }
+            if(auto* w = receivers_.pop())
+            {
+                // A receiver is waiting, so the buffer is empty. Hand the
+                // value straight to it.
+                auto* r = static_cast<_receive_awaitable*>(w);
+                r->value_.emplace(std::move(*s->value_));
+                lock.unlock();
+                r->resume();
+                return false;
+            }
+            if(size_ != ring_.size())
+            {
+                _push(std::move(*s->value_));
+                return false;
+            }
+            senders_.push(s);
+            return true;
+        }
+
+        // Returns true if the receiver must wait.
+        bool _receive_or_enqueue(_receive_awaitable* r)
+        {
+            std::unique_lock<std::mutex> lock{mtx_};
+            auto* s = static_cast<_send_awaitable*>(senders_.pop());
+            if(size_ != 0)
+            {
+                r->value_.emplace(_pop());
+                // Make room for the oldest blocked sender, if any.
+                if(s)
+                    _push(std::move(*s->value_));
+            }
+            else if(s)
+            {
+                // Unbuffered channel; take the value from the sender.
+                r->value_.emplace(std::move(*s->value_));
+            }
+            else if(!closed_)
+            {
+                receivers_.push(r);
+                return true;
+            }
+            lock.unlock();
+            if(s)
+                s->resume();
+            return false;
+        }
+
+    public:
+        explicit channel(std::size_t capacity)
+          : ring_(capacity)
+        {}
+        channel(channel&&) = delete;
+        ~channel()
+        {
+            assert(senders_.empty() && receivers_.empty());
+        }
+
+        // Wake everybody who is waiting. Pending and future sends fail;
+        // receives fail once the buffer is drained.
+        void close()
+        {
+            _waiter* senders;
+            _waiter* receivers;
+            {
+                std::lock_guard<std::mutex> lock{mtx_};
+                closed_ = true;
+                senders = senders_.take_all();
+                receivers = receivers_.take_all();
+            }
+            for(auto* w = senders; w; w = w->next_)
+                static_cast<_send_awaitable*>(w)->closed_ = true;
+            _resume_all(senders);
+            _resume_all(receivers);
+        }
+
+        CO_PP_template(class Token)(
+            requires CompletionToken<Token>)
+        auto async_send(T value, Token token) -> result_t<Token, void(T)>
+        {
+            INITIAL_SUSPEND(token);
+            co_await _send_awaitable{this, &value};
+        }
+        auto async_send(T value)
+        {
+            return callable_with_implicit_context{
+                [this, value = std::move(value)](auto token) mutable {
+                    return this->async_send(std::move(value), token);
+                }};
+        }
+
+        CO_PP_template(class Token)(
+            requires CompletionToken<Token>)
+        auto async_receive(Token token) -> result_t<Token, T()>
+        {
+            INITIAL_SUSPEND(token);
+            co_return co_await _receive_awaitable{this};
+        }
+        auto async_receive()
+        {
+            return callable_with_implicit_context{
+                [this](auto token) { return this->async_receive(token); }};
+        }
+    };
+} // namespace coronet
+
+#endif
@@ -0,0 +1,336 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+//
+#ifndef CORONET_CONNECTION_POOL_HPP
+#define CORONET_CONNECTION_POOL_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include <experimental/internet>
+#include <experimental/io_context>
+#include <experimental/timer>
+
+#ifdef __unix__
+#include <cerrno>
+#include <sys/socket.h>
+#endif
+
+#include <coronet/coronet.hpp>
+#include <coronet/net.hpp>
+#include <coronet/synchronization.hpp>
+
+namespace coronet
+{
+    // A pool of outbound connections, kept per endpoint. async_acquire
+    // completes with a lease on a connected socket, reusing an idle one when
+    // possible and connecting a new one otherwise. At most max_per_endpoint
+    // connections to an endpoint are leased at once; further acquirers wait
+    // until a lease is returned.
+    //
+    // Returning a lease puts its socket back in the pool unless the lease
+    // was invalidated (say, after an I/O error). Idle sockets are checked
+    // for a closed peer before they are handed out again, and sockets idle
+    // for longer than idle_timeout are closed by reap() or async_run().
+    template<class Protocol = std::experimental::net::ip::tcp>
+    struct connection_pool
+    {
+        using socket_type = typename Protocol::socket;
+        using endpoint_type = typename Protocol::endpoint;
+        using clock_type = std::chrono::steady_clock;
+
+        struct options
+        {
+            std::size_t max_per_endpoint = 8;
+            clock_type::duration idle_timeout = std::chrono::seconds(30);
+            clock_type::duration reap_interval = std::chrono::seconds(5);
+        };
+
+    private:
+        struct _idle
+        {
+            socket_type socket_;
+            clock_type::time_point since_;
+        };
+
+        struct _bucket
+        {
+            async_semaphore slots_;
+            std::vector<_idle> idle_;
+            explicit _bucket(std::size_t max)
+              : slots_(static_cast<std::ptrdiff_t>(max))
+            {}
+        };
+
+        std::experimental::net::io_context* ctx_;
+        options opts_;
+        std::mutex mtx_;
+        std::map<endpoint_type, std::unique_ptr<_bucket>> buckets_;
+        // Armed by async_run() and cancelled by shutdown(), both under mtx_,
+        // on whatever threads they run on.
+        std::experimental::net::steady_timer timer_;
+        std::atomic<bool> stopped_{false};
+
+        _bucket& _bucket_for(endpoint_type const& ep)
+        {
+            std::lock_guard<std::mutex> lock{mtx_};
+            auto& b = buckets_[ep];
+            if(!b)
+                b = std::make_unique<_bucket>(opts_.max_per_endpoint);
+            return *b;
+        }
+
+        // Whether an idle socket is still usable. A readable socket means
+        // the peer closed the connection or sent data nobody asked for;
+        // either way, it cannot be reused.
+        static bool _healthy(socket_type& socket) noexcept
+        {
+            if(!socket.is_open())
+                return false;
+#ifdef __unix__
+            char c;
+            auto n = ::recv(socket.native_handle(), &c, 1,
+                            MSG_PEEK | MSG_DONTWAIT);
+            return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+#else
+            return true;
+#endif
+        }
+
+        std::optional<socket_type> _take_idle(_bucket& b)
+        {
+            std::unique_lock<std::mutex> lock{mtx_};
+            while(!b.idle_.empty())
+            {
+                auto socket = std::move(b.idle_.back().socket_);
+                b.idle_.pop_back();
+                lock.unlock();
+                if(_healthy(socket))
+                    return std::optional<socket_type>{std::move(socket)};
+                std::error_code ec;
+                socket.close(ec);
+                lock.lock();
+            }
+            return std::nullopt;
+        }
+
+        void _give_back(_bucket& b, socket_type socket, bool healthy)
+        {
+            {
+                std::lock_guard<std::mutex> lock{mtx_};
+                if(healthy && !stopped_ && socket.is_open())
+                    b.idle_.push_back(
+                        _idle{std::move(socket), clock_type::now()});
+            }
+            b.slots_.release();
+        }
+
+        // Give back a slot that never got a socket.
+        struct _slot_guard
+        {
+            _bucket* b_;
+            ~_slot_guard()
+            {
+                if(b_)
+                    b_->slots_.release();
+            }
+        };
+
+    public:
+        // Exclusive use of one pooled connection. Destroying the lease
+        // returns the connection to the pool.
+        struct lease
+        {
+        private:
+            friend connection_pool;
+            connection_pool* pool_ = nullptr;
+            _bucket* bucket_ = nullptr;
+            std::optional<socket_type> socket_{};
+            bool healthy_ = true;
+
+            lease(connection_pool* pool, _bucket* bucket, socket_type socket)
+              : pool_(pool)
+              , bucket_(bucket)
+              , socket_(std::move(socket))
+            {}
+
+        public:
+            lease() = default;
+            lease(lease&& that) noexcept
+              : pool_(std::exchange(that.pool_, nullptr))
+              , bucket_(std::exchange(that.bucket_, nullptr))
+              , socket_(std::move(that.socket_))
+              , healthy_(that.healthy_)
+            {}
+            lease& operator=(lease&& that) noexcept
+            {
+                reset();
+                pool_ = std::exchange(that.pool_, nullptr);
+                bucket_ = std::exchange(that.bucket_, nullptr);
+                socket_ = std::move(that.socket_);
+                healthy_ = that.healthy_;
+                return *this;
+            }
+            ~lease()
+            {
+                reset();
+            }
+            explicit operator bool() const noexcept
+            {
+                return bucket_ != nullptr;
+            }
+            socket_type& socket() noexcept
+            {
+                return *socket_;
+            }
+            // Don't return the connection to the pool; close it instead.
+            void invalidate() noexcept
+            {
+                healthy_ = false;
+            }
+            // Return the connection to the pool now.
+            void reset()
+            {
+                if(auto* b = std::exchange(bucket_, nullptr))
+                    pool_->_give_back(*b, std::move(*socket_), healthy_);
+                socket_.reset();
+            }
+        };
+
+        explicit connection_pool(
+            std::experimental::net::io_context& ctx, options opts = {})
+          : ctx_(&ctx)
+          , opts_(opts)
+          , timer_(ctx)
+        {}
+        connection_pool(connection_pool&&) = delete;
+
+        CO_PP_template(class Token)(
+            requires CompletionToken<Token>)
+        auto async_acquire(endpoint_type endpoint, Token token)
+            -> result_t<Token, lease(endpoint_type)>
+        {
+            INITIAL_SUSPEND(token);
+            auto& b = _bucket_for(endpoint);
+            co_await b.slots_.async_acquire();
+            _slot_guard guard{&b};
+            if(auto socket = _take_idle(b))
+            {
+                guard.b_ = nullptr;
+                co_return lease{this, &b, std::move(*socket)};
+            }
+            socket_type socket{*ctx_};
+            co_await coronet::async_connect(socket, endpoint);
+            guard.b_ = nullptr;
+            co_return lease{this, &b, std::move(socket)};
+        }
+        auto async_acquire(endpoint_type endpoint)
+        {
+            return callable_with_implicit_context{
+                [this, endpoint](auto token) {
+                    return this->async_acquire(endpoint, token);
+                }};
+        }
+
+        // Close every connection that has been idle for longer than
+        // idle_timeout.
+        void reap()
+        {
+            auto const cutoff = clock_type::now() - opts_.idle_timeout;
+            std::vector<_idle> expired;
+            {
+                std::lock_guard<std::mutex> lock{mtx_};
+                for(auto& kv : buckets_)
+                {
+                    auto& idle = kv.second->idle_;
+                    auto it = idle.begin();
+                    for(; it != idle.end() && it->since_ < cutoff; ++it)
+                        expired.push_back(std::move(*it));
+                    idle.erase(idle.begin(), it);
+                }
+            }
+            for(auto& i : expired)
+            {
+                std::error_code ec;
+                i.socket_.close(ec);
+            }
+        }
+
+        // Call reap() every reap_interval until shutdown() is called.
+        CO_PP_template(class Token)(
+            requires CompletionToken<Token>)
+        auto async_run(Token token) -> result_t<Token, void()>
+        {
+            INITIAL_SUSPEND(token);
+            for(;;)
+            {
+                try
+                {
+                    co_await _make_net_op([this](auto handler) {
+                        // Once stopped, arm the timer already expired, so
+                        // that a shutdown() between two waits is not lost.
+                        std::lock_guard<std::mutex> lock{mtx_};
+                        if(stopped_)
+                            timer_.expires_at(clock_type::time_point::min());
+                        else
+                            timer_.expires_after(opts_.reap_interval);
+                        timer_.async_wait(std::move(handler));
+                    });
+                }
+                catch(std::system_error const&)
+                {
+                    // Cancelled by shutdown().
+                }
+                if(stopped_)
+                    break;
+                reap();
+            }
+        }
+        auto async_run()
+        {
+            return callable_with_implicit_context{
+                [this](auto token) { return this->async_run(token); }};
+        }
+
+        // Close the idle connections and stop pooling. Leases that are
+        // still out close their connections when they are returned.
+        void shutdown()
+        {
+            std::vector<_idle> idle;
+            {
+                std::lock_guard<std::mutex> lock{mtx_};
+                stopped_ = true;
+                for(auto& kv : buckets_)
+                    for(auto& i : kv.second->idle_)
+                        idle.push_back(std::move(i));
+                for(auto& kv : buckets_)
+                    kv.second->idle_.clear();
+                timer_.cancel();
+            }
+            for(auto& i : idle)
+            {
+                std::error_code ec;
+                i.socket_.close(ec);
+            }
+        }
+    };
+} // namespace coronet
+
+#endif
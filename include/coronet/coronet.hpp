@@ -18,6 +18,7 @@
 #include <functional>
 #include <memory>
 #include <optional>
+#include <tuple>
 #include <type_traits>
 
 #include <meta/meta.hpp>
@@ -29,6 +30,8 @@
 #include <coronet/detail/concepts.hpp>
 #include <coronet/detail/noop_coroutine.hpp>
 #include <coronet/detail/utility.hpp>
+#include <coronet/expected.hpp>
+#include <coronet/trace.hpp>
 
 namespace coronet
 {
@@ -41,6 +44,42 @@ namespace coronet
     template<class E, class A = _allocator_archetype<void>>
     inline constexpr bool Executor = is_satisfied_by<CExecutor, E, A>;
 
+    // An executor that can enqueue a whole range of work items at once.
+    // This is an optional extension; see bulk_post below. Its bulk_post
+    // must be all-or-nothing: if it throws, none of the items was queued.
+    struct CBulkExecutor
+    {
+        template<class E, class A = _allocator_archetype<void>>
+        auto requires_(E& e, std::experimental::coroutine_handle<>* p, A a)
+            -> decltype(requires_<CExecutor, E, A>, e.bulk_post(p, p, a));
+    };
+    template<class E, class A = _allocator_archetype<void>>
+    inline constexpr bool BulkExecutor = is_satisfied_by<CBulkExecutor, E, A>;
+
+    // Enqueue every work item in [first, last), advancing first past the
+    // items queued, so that if a post throws, [first, last) are the items
+    // that were not. Uses the executor's bulk_post when it has one, which
+    // queues all or none; otherwise, falls back to one post per item.
+    CO_PP_template(class E, class I, class S, class A)(
+        requires Executor<E, A>)
+    void _bulk_post(E const& e, I& first, S last, A const& a)
+    {
+        if constexpr(BulkExecutor<E const, A>)
+        {
+            e.bulk_post(first, last, a);
+            first = last;
+        }
+        else
+            for(; first != last; ++first)
+                e.post(*first, a);
+    }
+    CO_PP_template(class E, class I, class S, class A)(
+        requires Executor<E, A>)
+    void bulk_post(E const& e, I first, S last, A const& a)
+    {
+        coronet::_bulk_post(e, first, std::move(last), a);
+    }
+
     struct CCompletionToken
     {
         template<class T>
@@ -79,40 +118,118 @@ namespace coronet
     inline constexpr bool HasExecutionContext =
         is_satisfied_by<CHasExecutionContext, P>;
 
+    // The execution context of a coroutine that was given an explicit
+    // completion token: the token's executor and allocator. Operations that
+    // a coroutine awaits without a token get an implicit one that refers to
+    // the nearest enclosing explicit context, so nesting them copies neither
+    // the executor nor the allocator.
+    struct _execution_context
+    {
+    private:
+        void const* token_ = nullptr;
+        void (*post_)(void const*, std::experimental::coroutine_handle<>) =
+            nullptr;
+
+        template<class Token>
+        static void _post(
+            void const* p, std::experimental::coroutine_handle<> h)
+        {
+            auto const& token = *static_cast<Token const*>(p);
+            token.get_executor().post(h, token.get_allocator());
+        }
+
+    public:
+        _execution_context() = default;
+        template<class Token>
+        explicit _execution_context(Token const& token) noexcept
+          : token_(&token)
+          , post_(&_post<Token>)
+        {}
+        void post(std::experimental::coroutine_handle<> h) const
+        {
+            post_(token_, h);
+        }
+    };
+
     struct _implicit_executor
     {
+        _execution_context const* ctx_ = nullptr;
+
+        // Resume a coroutine that was suspended in this context by posting
+        // it to the enclosing explicit context, or inline if there is none.
+        void resume(std::experimental::coroutine_handle<> h) const
+        {
+            if(ctx_)
+                ctx_->post(h);
+            else
+                h.resume();
+        }
         CO_PP_template(class Fn, class Alloc)(
             requires Invocable<Fn&> && Allocator<Alloc>)
         [[noreturn]] void post(Fn, Alloc) const
         {
             std::terminate();
         }
+        friend bool operator==(
+            _implicit_executor a, _implicit_executor b) noexcept
+        {
+            return a.ctx_ == b.ctx_;
+        }
+        friend bool operator!=(
+            _implicit_executor a, _implicit_executor b) noexcept
+        {
+            return a.ctx_ != b.ctx_;
+        }
     };
 
+    template<class A>
+    inline A const _default_allocator{};
+
     template<class A = std::allocator<void>>
     struct _implicit_yield_t
     {
+        using _frame_alloc_t = rebind_alloc<A, char>;
+
     private:
-        A alloc_;
+        // All point into the frame of an enclosing coroutine, which
+        // outlives every operation that it awaits. frame_alloc_ is the
+        // allocator that the frames of those operations borrow; without
+        // one, each frame keeps a copy of *alloc_.
+        A const* alloc_;
+        _execution_context const* ctx_;
+        _frame_alloc_t* frame_alloc_;
 
     public:
-        constexpr _implicit_yield_t(A alloc = A{})
-          : alloc_(alloc)
+        constexpr _implicit_yield_t(
+            A const& alloc = _default_allocator<A>,
+            _execution_context const* ctx = nullptr,
+            _frame_alloc_t* frame_alloc = nullptr) noexcept
+          : alloc_(&alloc)
+          , ctx_(ctx)
+          , frame_alloc_(frame_alloc)
         {}
-        _implicit_executor get_executor() const
+        _implicit_executor get_executor() const noexcept
         {
-            return {};
+            return {ctx_};
         }
-        A get_allocator() const
+        A const& get_allocator() const noexcept
         {
-            return alloc_;
+            return *alloc_;
+        }
+        _frame_alloc_t* _frame_allocator() const noexcept
+        {
+            return frame_alloc_;
         }
+        // a must outlive the operations that are given the new token.
         CO_PP_template(class A2)(
             requires Allocator<A2>)
-        constexpr auto operator()(A2 a) const
+        constexpr auto operator()(A2 const& a) const noexcept
         {
-            return _implicit_yield_t<A2>{a};
+            return _implicit_yield_t<A2>{a, ctx_};
         }
+        CO_PP_template(class A2)(
+            requires Allocator<A2>)
+        void operator()(A2 const&& a) const = delete;
     };
 
     inline constexpr _implicit_yield_t<> _implicit{};
@@ -130,7 +247,7 @@ namespace coronet
           : exec_(e)
           , alloc_(a)
         {}
-        auto get_allocator() const
+        A const& get_allocator() const noexcept
         {
             return alloc_;
         }
@@ -158,9 +275,21 @@ namespace coronet
 
     inline constexpr yield_gen_t yield{};
 
+    // An aggregate, so that the callable is built in place, not moved in.
+    // Only an rvalue can be started, since the operation may take what it
+    // needs from the callable; copy it to start the operation again.
     template<class Fn>
-    struct[[nodiscard]] callable_with_implicit_context
-      : Fn{callable_with_implicit_context(Fn fun) : Fn(std::move(fun)){}};
+    struct[[nodiscard]] callable_with_implicit_context : Fn
+    {
+        template<class Token>
+        decltype(auto) operator()(Token token) &&
+        {
+            return static_cast<Fn&&>(*this)(token);
+        }
+    };
+
+    template<class Fn>
+    callable_with_implicit_context(Fn)->callable_with_implicit_context<Fn>;
 
     template<class T>
     inline constexpr bool WantsExecutionContext =
@@ -168,18 +297,267 @@ namespace coronet
 
     CO_PP_template(class T)(
         requires CompletionToken<T>)
-    auto get_allocator(T t)
+    decltype(auto) get_allocator(T const& t)
     {
         return t.get_allocator();
     }
 
     CO_PP_template(class T)(
         requires CompletionToken<T>)
-    auto get_executor(T t)
+    auto get_executor(T const& t)
     {
         return t.get_executor();
     }
 
+    // The result of an async operation that completes with several values,
+    // such as an error code, a byte count, and a buffer. An operation that
+    // returns completion<Ts...> has the completion signature
+    // void(std::exception_ptr, Ts...), and one that returns
+    // expected<completion<Ts...>, E> has void(E, Ts...). Callbacks receive
+    // the values as separate arguments; coroutines get the completion, which
+    // supports structured bindings:
+    //
+    //     auto [n, buf] = co_await async_read_chunk(sock);
+    template<class... Ts>
+    struct completion : std::tuple<Ts...>
+    {
+        static_assert(sizeof...(Ts) > 1,
+                      "Use T instead of completion<T> for a single value.");
+        using std::tuple<Ts...>::tuple;
+        completion() = default;
+    };
+
+    template<class... Ts>
+    completion(Ts...)->completion<Ts...>;
+
+    template<class T>
+    inline constexpr bool _is_completion = false;
+
+    template<class... Ts>
+    inline constexpr bool _is_completion<completion<Ts...>> = true;
+
+    // Invoke fun with the leading argument followed by the value, or by
+    // each of the value's elements if it is a completion.
+    template<class Fn, class Arg, class T>
+    void _invoke_spread(Fn& fun, Arg&& arg, T&& value)
+    {
+        if constexpr(_is_completion<std::decay_t<T>>)
+            std::apply(
+                [&](auto&&... vs) {
+                    fun(static_cast<Arg&&>(arg), std::move(vs)...);
+                },
+                static_cast<T&&>(value));
+        else
+            fun(static_cast<Arg&&>(arg), static_cast<T&&>(value));
+    }
+
+    // Coroutine frames are allocated with the completion token's allocator,
+    // when the token is among the coroutine's arguments. A copy of the
+    // allocator is stashed after the frame so that operator delete can find
+    // it, unless the token is an implicit one that lends the allocator of
+    // an enclosing frame, in which case only a pointer to that is stashed.
+    // An empty slot means the frame came from the global operator new.
+    template<class Token>
+    struct _frame_allocator
+    {
+    private:
+        using _alloc_t = rebind_alloc<
+            std::decay_t<decltype(std::declval<Token const&>().get_allocator())>,
+            char>;
+        struct _slot_t
+        {
+            _alloc_t* borrowed_ = nullptr;
+            std::optional<_alloc_t> own_{};
+        };
+
+        static constexpr std::size_t _offset(std::size_t n) noexcept
+        {
+            return (n + alignof(_slot_t) - 1) & ~(alignof(_slot_t) - 1);
+        }
+        static _slot_t& _slot(void* p, std::size_t n) noexcept
+        {
+            return *static_cast<_slot_t*>(
+                static_cast<void*>(static_cast<char*>(p) + _offset(n)));
+        }
+
+    public:
+        CO_PP_template(class... Ts)(
+            requires Same<Token, std::decay_t<meta::back<meta::list<Ts...>>>>)
+        static void* operator new(std::size_t n, Ts const&... args)
+        {
+            auto const& token = _back(args...);
+            auto const size = _offset(n) + sizeof(_slot_t);
+            if constexpr(meta::is<Token, _implicit_yield_t>::value)
+            {
+                if(auto* alloc = token._frame_allocator())
+                {
+                    void* p = alloc->allocate(size);
+                    ::new(static_cast<void*>(&_slot(p, n))) _slot_t{alloc};
+                    return p;
+                }
+            }
+            _alloc_t alloc(token.get_allocator());
+            void* p = alloc.allocate(size);
+            ::new(static_cast<void*>(&_slot(p, n)))
+                _slot_t{nullptr, std::move(alloc)};
+            return p;
+        }
+        static void* operator new(std::size_t n)
+        {
+            void* p = ::operator new(_offset(n) + sizeof(_slot_t));
+            ::new(static_cast<void*>(&_slot(p, n))) _slot_t();
+            return p;
+        }
+        static void operator delete(void* p, std::size_t n) noexcept
+        {
+            auto& slot = _slot(p, n);
+            auto const size = _offset(n) + sizeof(_slot_t);
+            if(auto* alloc = slot.borrowed_)
+            {
+                slot.~_slot_t();
+                alloc->deallocate(static_cast<char*>(p), size);
+            }
+            else if(slot.own_)
+            {
+                auto alloc = std::move(*slot.own_);
+                slot.~_slot_t();
+                alloc.deallocate(static_cast<char*>(p), size);
+            }
+            else
+            {
+                slot.~_slot_t();
+                ::operator delete(p);
+            }
+        }
+    };
+
+    // Where a coroutine's result is kept until it is consumed, along with
+    // the return_value (or return_void) that puts it there.
+    template<class T>
+    struct _result_storage
+    {
+        std::optional<T> value_{};
+        void return_value(T value)
+        {
+            value_ = std::move(value);
+        }
+        bool _has_value() const noexcept
+        {
+            return value_.has_value();
+        }
+        T _get()
+        {
+            return std::move(*value_);
+        }
+    };
+
+    template<>
+    struct _result_storage<void>
+    {
+        bool value_ = false;
+        void return_void() noexcept
+        {
+            value_ = true;
+        }
+        bool _has_value() const noexcept
+        {
+            return value_;
+        }
+        void _get() const noexcept {}
+    };
+
+    // Where a promise keeps its completion token, along with the execution
+    // context that the implicit tokens it hands out refer to.
+    template<class Token>
+    struct _token_storage
+    {
+    private:
+        using _get_alloc_t =
+            decltype(std::declval<Token const&>().get_allocator());
+        using _alloc_t = std::decay_t<_get_alloc_t>;
+        static constexpr bool _alloc_by_value =
+            !std::is_lvalue_reference_v<_get_alloc_t>;
+
+        // Made when the first operation is awaited without a token, and
+        // lent to every one after it: the allocator, if the token hands out
+        // only copies, and the allocator that their frames come from.
+        mutable std::optional<_alloc_t> alloc_{};
+        mutable std::optional<rebind_alloc<_alloc_t, char>> frame_alloc_{};
+
+    public:
+        std::optional<Token> token_{};
+        _execution_context ctx_{};
+
+        static constexpr bool _is_implicit =
+            meta::is<Token, _implicit_yield_t>::value;
+
+        void _set_token(Token token)
+        {
+            token_.emplace(std::move(token));
+            if constexpr(!_is_implicit)
+                ctx_ = _execution_context{*token_};
+        }
+        Token const& get_token() const
+        {
+            return *token_;
+        }
+        auto get_executor() const
+        {
+            return coronet::get_executor(*token_);
+        }
+        decltype(auto) get_allocator() const
+        {
+            return coronet::get_allocator(*token_);
+        }
+        // The token for an operation that is awaited without one.
+        auto _implicit_token() const
+        {
+            if constexpr(_is_implicit)
+                return *token_;
+            else
+            {
+                if(!frame_alloc_)
+                {
+                    if constexpr(_alloc_by_value)
+                        alloc_.emplace(get_allocator());
+                    frame_alloc_.emplace(get_allocator());
+                }
+                if constexpr(_alloc_by_value)
+                    return _implicit_yield_t<_alloc_t>{*alloc_, &ctx_,
+                                                       &*frame_alloc_};
+                else
+                    return _implicit_yield_t<_alloc_t>{get_allocator(), &ctx_,
+                                                       &*frame_alloc_};
+            }
+        }
+    };
+
+    struct CSameContextQuery
+    {
+        template<class T, class U>
+        auto requires_(T const& t, U const& u)
+            -> decltype(t._same_context(u)->*satisfies<CConvertibleTo, bool>);
+    };
+
+    // Whether an operation given token t runs in the same execution context
+    // as a coroutine given token u, so that u's coroutine can run it inline.
+    // Tokens of different types may answer for themselves.
+    template<class T, class U>
+    bool _same_context(T const& t, U const& u)
+    {
+        if constexpr(is_satisfied_by<CSameContextQuery, T, U>)
+            return t._same_context(u);
+        else if constexpr(Same<T, U>)
+        {
+            using Alloc = std::decay_t<decltype(t.get_allocator())>;
+            return t.get_executor() == u.get_executor() &&
+                   (typename std::allocator_traits<Alloc>::is_always_equal() ||
+                    t.get_allocator() == u.get_allocator());
+        }
+        else
+            return false;
+    }
+
     template<class Token, class Ret, class Args, class Return>
     struct _async_result_impl_;
 
@@ -193,10 +571,11 @@ namespace coronet
         static_assert(CompletionToken<Token>);
 
         struct promise_type
+          : _frame_allocator<Token>
+          , _result_storage<T>
+          , _token_storage<Token>
         {
             std::exception_ptr eptr_{};
-            std::optional<T> value_{};
-            std::optional<Token> token_{};
             std::experimental::coroutine_handle<> awaiter_{};
             std::function<void(std::experimental::coroutine_handle<>)> repost_;
             promise_type() = default;
@@ -206,23 +585,11 @@ namespace coronet
             promise_type(Ts&&... args)
               : promise_type()
             {
-                token_.emplace(_back(std::forward<Ts>(args)...));
-            }
-            Token const& get_token() const
-            {
-                return *token_;
+                this->_set_token(_back(std::forward<Ts>(args)...));
             }
             void set_token(Token token)
             {
-                token_.emplace(std::move(token));
-            }
-            auto get_executor() const
-            {
-                return coronet::get_executor(*token_);
-            }
-            auto get_allocator() const
-            {
-                return coronet::get_allocator(*token_);
+                this->_set_token(std::move(token));
             }
             auto initial_suspend() const noexcept
             {
@@ -244,6 +611,9 @@ namespace coronet
                             awaiter) const
                     {
                         assert(awaiter.promise().awaiter_ != nullptr);
+                        CORONET_TRACE_EVENT(
+                            _trace_kind::complete, awaiter.address(),
+                            awaiter.promise().awaiter_.address());
                         if constexpr(meta::is<Token, _implicit_yield_t>::value)
                         {
                             return awaiter.promise().awaiter_;
@@ -269,10 +639,6 @@ namespace coronet
             {
                 eptr_ = std::current_exception();
             }
-            void return_value(T value)
-            {
-                value_ = std::move(value);
-            }
             task get_return_object() noexcept
             {
                 return task{*this};
@@ -281,7 +647,7 @@ namespace coronet
             auto await_transform(U t)
             {
                 if constexpr(WantsExecutionContext<U>)
-                    return t(_implicit(get_allocator()));
+                    return std::move(t)(this->_implicit_token());
                 else
                     return t;
             }
@@ -292,7 +658,7 @@ namespace coronet
             std::experimental::coroutine_handle<promise_type> coro_;
             bool await_ready() const
             {
-                return coro_.promise().value_.has_value();
+                return coro_.promise()._has_value();
             }
             template<class Promise>
             std::experimental::coroutine_handle<> await_suspend(
@@ -307,6 +673,8 @@ namespace coronet
                 {
                     // We're already in the correct execution context, just
                     // execute the coroutine.
+                    CORONET_TRACE_EVENT(_trace_kind::await_inline,
+                                        awaiter.address(), coro_.address());
                     return coro_;
                 }
                 // We're about to post this coroutine to another execution
@@ -316,40 +684,52 @@ namespace coronet
                 else if constexpr(HasExecutionContext<Promise>)
                 {
                     auto const& calling_token = awaiter.promise().get_token();
-                    if constexpr(Same<decltype(token), decltype(calling_token)>)
+                    if(_same_context(token, calling_token))
                     {
-                        using Alloc =
-                            std::decay_t<decltype(token.get_allocator())>;
-                        // Do the execution contexts compare equal?
-                        if(token.get_executor() ==
-                               calling_token.get_executor() &&
-                           (typename std::allocator_traits<
-                                Alloc>::is_always_equal() ||
-                            token.get_allocator() ==
-                                calling_token.get_allocator()))
-                        {
-                            // We're in the same execution context as our
-                            // caller; just execute the coroutine.
-                            return coro_;
-                        }
+                        // We're in the same execution context as our
+                        // caller; just execute the coroutine.
+                        CORONET_TRACE_EVENT(_trace_kind::await_inline,
+                                            awaiter.address(), coro_.address());
+                        return coro_;
                     }
                     // This lambda gets called with awaiter in final_suspend
                     coro_.promise().repost_ =
                         [calling_token](
                             std::experimental::coroutine_handle<> h) {
+                            CORONET_TRACE_EVENT(
+                                _trace_kind::repost, h.address(), nullptr,
+                                typeid(coronet::get_executor(calling_token))
+                                    .name());
                             coronet::get_executor(calling_token)
                                 .post(h, coronet::get_allocator(calling_token));
                         };
                 }
+                CORONET_TRACE_EVENT(
+                    _trace_kind::await_posted, awaiter.address(),
+                    coro_.address(),
+                    typeid(coronet::get_executor(token)).name());
                 coronet::get_executor(token).post(
                     coro_, coronet::get_allocator(token));
                 return noop_coroutine();
             }
             T await_resume() const
             {
-                if(coro_.promise().eptr_)
-                    std::rethrow_exception(coro_.promise().eptr_);
-                return *coro_.promise().value_;
+                CORONET_TRACE_EVENT(_trace_kind::resume,
+                                    coro_.promise().awaiter_.address());
+                if(auto const& eptr = coro_.promise().eptr_)
+                {
+                    // As for a callback, an exception that escapes an
+                    // operation returning an expected becomes its error.
+                    if constexpr(_is_expected<T>)
+                    {
+                        using E = typename T::error_type;
+                        if constexpr(_can_report_exception<E>)
+                            return T{unexpected{
+                                _error_from_exception<E>(eptr)}};
+                    }
+                    std::rethrow_exception(eptr);
+                }
+                return coro_.promise()._get();
             }
         };
 
@@ -376,6 +756,35 @@ namespace coronet
         }
     };
 
+    // Invoke a callback with an error and no value of type T to go with it:
+    // with value-initialized values if T has them, and otherwise without.
+    template<class T, class Fn, class Arg>
+    void _invoke_error(Fn& fun, Arg&& arg)
+    {
+        if constexpr(std::is_default_constructible_v<T>)
+            _invoke_spread(fun, static_cast<Arg&&>(arg), T{});
+        else
+            fun(static_cast<Arg&&>(arg));
+    }
+
+    // Invoke a callback with the (error, value) arguments of the void(E, T)
+    // or void(E) completion signature that corresponds to an expected.
+    template<class Fn, class T, class E>
+    void _complete_expected(Fn& fun, expected<T, E> result)
+    {
+        if constexpr(std::is_void_v<T>)
+        {
+            if(result)
+                fun(E{});
+            else
+                fun(result.error());
+        }
+        else if(result)
+            _invoke_spread(fun, E{}, std::move(*result));
+        else
+            _invoke_error<T>(fun, result.error());
+    }
+
     template<class T, class Token>
     struct void_
     {
@@ -387,10 +796,11 @@ namespace coronet
         static_assert(CompletionToken<Token>);
 
         struct promise_type
+          : _frame_allocator<Token>
+          , _result_storage<T>
+          , _token_storage<Token>
         {
             std::exception_ptr eptr_{};
-            T value_{};
-            std::optional<Token> token_{};
             promise_type() = default;
             CO_PP_template(class... Ts)(
                 requires Same<Token,
@@ -398,27 +808,18 @@ namespace coronet
                 promise_type(Ts&&... args)
               : promise_type()
             {
-                token_.emplace(_back(std::forward<Ts>(args)...));
-            }
-            auto get_executor() const
-            {
-                return coronet::get_executor(*token_);
-            }
-            auto get_allocator() const
-            {
-                return coronet::get_allocator(*token_);
-            }
-            Token const& get_token() const
-            {
-                return *token_;
+                this->_set_token(_back(std::forward<Ts>(args)...));
             }
             void set_token(Token token)
             {
-                token_.emplace(std::move(token));
+                this->_set_token(std::move(token));
                 auto coro = std::experimental::coroutine_handle<
                     promise_type>::from_promise(*this);
                 // Enque this asynchronous operation (detached)
-                get_executor().post(coro, get_allocator());
+                CORONET_TRACE_EVENT(_trace_kind::spawn, coro.address(),
+                                    nullptr,
+                                    typeid(this->get_executor()).name());
+                this->get_executor().post(coro, this->get_allocator());
             }
             auto initial_suspend() const noexcept
             {
@@ -444,9 +845,33 @@ namespace coronet
                         auto token = std::move(awaiter.promise().token_);
                         auto value = std::move(awaiter.promise().value_);
                         auto eptr = awaiter.promise().eptr_;
+                        CORONET_TRACE_EVENT(_trace_kind::callback,
+                                            awaiter.address());
                         awaiter.destroy();
-                        if constexpr(!std::is_void_v<T>)
-                            (*token)(eptr, value);
+                        if constexpr(_is_expected<T>)
+                        {
+                            using E = typename T::error_type;
+                            if(eptr)
+                            {
+                                // An error type that cannot hold an
+                                // error_code leaves nobody to report it
+                                // to.
+                                if constexpr(_can_report_exception<E>)
+                                    value.emplace(unexpected{
+                                        _error_from_exception<E>(eptr)});
+                                else
+                                    std::terminate();
+                            }
+                            _complete_expected(*token, std::move(*value));
+                        }
+                        else if constexpr(!std::is_void_v<T>)
+                        {
+                            if(value)
+                                _invoke_spread(*token, eptr,
+                                               std::move(*value));
+                            else
+                                _invoke_error<T>(*token, eptr);
+                        }
                         else
                             (*token)(eptr);
                     }
@@ -458,10 +883,6 @@ namespace coronet
             {
                 eptr_ = std::current_exception();
             }
-            void return_value(T value)
-            {
-                value_ = std::move(value);
-            }
             void_ get_return_object() noexcept
             {
                 return void_{};
@@ -470,7 +891,7 @@ namespace coronet
             auto await_transform(U t)
             {
                 if constexpr(WantsExecutionContext<U>)
-                    return t(_implicit(get_allocator()));
+                    return std::move(t)(this->_implicit_token());
                 else
                     return t;
             }
@@ -520,28 +941,42 @@ namespace coronet
           : fn_(std::move(fun))
         {}
 
+        // The arguments are forwarded, so each is copied or moved just once
+        // on its way into the coroutine frame.
         CO_PP_template(class... Ts)(
             requires Invocable<const Fn&, Ts...>)
-        auto operator()(Ts... ts) const
+        auto operator()(Ts&&... ts) const
         {
-            using Ret = decltype(fn_(std::move(ts)...));
+            using Ret = decltype(fn_(std::forward<Ts>(ts)...));
             // If this async operation returns coronet::void_, just return void.
             if constexpr(meta::is<Ret, void_>::value)
             {
-                (void)fn_(std::move(ts)...);
+                (void)fn_(std::forward<Ts>(ts)...);
             }
             else
             {
-                return fn_(std::move(ts)...);
+                return fn_(std::forward<Ts>(ts)...);
             }
         }
 
+        // The arguments are decay-copied, or moved, into the callable, and
+        // moved from it into the operation, which is why the callable can
+        // only be started as an rvalue. Move-only arguments are fine.
         CO_PP_template(class... Ts)(
-            requires Invocable<const Fn&, const Ts&..., _implicit_yield_t<>>)
-        auto operator()(Ts... ts) const
+            requires Invocable<const Fn&, std::decay_t<Ts>...,
+                               _implicit_yield_t<>>)
+        auto operator()(Ts&&... ts) const
         {
             return callable_with_implicit_context{
-                [ts..., this](auto token) { return fn_(ts..., token); }};
+                [args = std::tuple<std::decay_t<Ts>...>(
+                     std::forward<Ts>(ts)...),
+                 this](auto token) mutable {
+                    return std::apply(
+                        [&](std::decay_t<Ts>&... as) {
+                            return fn_(std::move(as)..., token);
+                        },
+                        args);
+                }};
         }
     };
 
@@ -576,7 +1011,7 @@ namespace coronet
           : exec_(e)
           , alloc_(a)
         {}
-        auto get_allocator() const
+        A const& get_allocator() const noexcept
         {
             return alloc_;
         }
@@ -592,6 +1027,45 @@ namespace coronet
         }
     };
 
+    // The completion signature of an async operation that returns Ret.
+    template<class Ret>
+    struct _completion_signature_
+    {
+        using type = void(std::exception_ptr, Ret);
+    };
+
+    template<>
+    struct _completion_signature_<void>
+    {
+        using type = void(std::exception_ptr);
+    };
+
+    // Operations that return expected<T, E> report errors through an error
+    // code rather than an exception_ptr.
+    template<class T, class E>
+    struct _completion_signature_<expected<T, E>>
+    {
+        using type = void(E, T);
+    };
+
+    template<class E>
+    struct _completion_signature_<expected<void, E>>
+    {
+        using type = void(E);
+    };
+
+    template<class... Ts>
+    struct _completion_signature_<completion<Ts...>>
+    {
+        using type = void(std::exception_ptr, Ts...);
+    };
+
+    template<class... Ts, class E>
+    struct _completion_signature_<expected<completion<Ts...>, E>>
+    {
+        using type = void(E, Ts...);
+    };
+
     template<class Token, class Sig>
     struct _result_;
 
@@ -599,25 +1073,59 @@ namespace coronet
     struct _result_<Token, Ret(Args...)>
     {
         using type = typename std::experimental::net::async_result<
-            Token, meta::if_<std::is_void<Ret>, void(std::exception_ptr),
-                             void(std::exception_ptr, Ret)>>::return_type;
+            Token, meta::_t<_completion_signature_<Ret>>>::return_type;
     };
 
     template<class Token, class Sig>
     using result_t = meta::_t<_result_<Token, Sig>>;
 
+    // The type of value produced by an async operation with the completion
+    // signature void(Args...). A leading exception_ptr is the usual error
+    // channel; any other leading argument is an error code, and the result
+    // is an expected. Several values after the leading argument are
+    // gathered into a completion.
+    template<class... Ts>
+    struct _async_values_
+    {
+        using type = completion<std::decay_t<Ts>...>;
+    };
+
+    template<class T>
+    struct _async_values_<T>
+    {
+        using type = std::decay_t<T>;
+    };
+
+    template<>
+    struct _async_values_<>
+    {
+        using type = void;
+    };
+
+    template<class Args>
+    struct _async_value_;
+
+    template<class E, class... Ts>
+    struct _async_value_<meta::list<E, Ts...>>
+    {
+        using type =
+            expected<meta::_t<_async_values_<Ts...>>, std::decay_t<E>>;
+    };
+
+    template<class... Ts>
+    struct _async_value_<meta::list<std::exception_ptr, Ts...>>
+      : _async_values_<Ts...>
+    {};
+
     // The completion token stores a callback
     template<class Token, class Ret, class Args, class Return>
     struct _async_result_impl_
     {
     private:
         static_assert(std::is_void_v<Ret>);
-        static_assert(meta::size<Args>::value < 3u &&
-                      meta::size<Args>::value != 0);
-        static_assert(
-            Same<std::exception_ptr, std::decay_t<meta::front<Args>>>);
-        using _result_type =
-            meta::if_c<1 == meta::size<Args>::value, void, meta::back<Args>>;
+        static_assert(meta::size<Args>::value != 0,
+                      "The completion signature needs an error argument.");
+        using _result_type = meta::_t<_async_value_<Args>>;
 
     public:
         using return_type = meta::invoke<Return, _result_type, Token>;
@@ -641,20 +1149,17 @@ namespace std::experimental::net
     template<class Token, class Fn, class Ret, class... Args>
     struct async_result<coronet::_callback_token<Token, Fn>, Ret(Args...)>
       : coronet::_async_result_impl_<coronet::_callback_token<Token, Fn>, Ret,
-                                     meta::list<Args...>,
+                                     meta::list<std::decay_t<Args>...>,
                                      meta::quote<coronet::void_>>
     {
-        static_assert((1 == sizeof...(Args) &&
-                       coronet::Invocable<Fn&, std::exception_ptr>) ||
-                      coronet::Invocable<Fn&, std::exception_ptr,
-                                         meta::back<meta::list<Args...>>>);
+        static_assert(coronet::Invocable<Fn&, Args...>);
         using async_result::_async_result_impl_::_async_result_impl_;
     };
 
     template<class Executor, class Allocator, class Ret, class... Args>
     struct async_result<coronet::yield_t<Executor, Allocator>, Ret(Args...)>
       : coronet::_async_result_impl_<coronet::yield_t<Executor, Allocator>, Ret,
-                                     meta::list<Args...>,
+                                     meta::list<std::decay_t<Args>...>,
                                      meta::quote<coronet::task>>
     {
         using async_result::_async_result_impl_::_async_result_impl_;
@@ -675,13 +1180,26 @@ namespace std::experimental::net
     template<class Allocator, class Ret, class... Args>
     struct async_result<coronet::_implicit_yield_t<Allocator>, Ret(Args...)>
       : coronet::_async_result_impl_<coronet::_implicit_yield_t<Allocator>, Ret,
-                                     meta::list<Args...>,
+                                     meta::list<std::decay_t<Args>...>,
                                      meta::quote<coronet::task>>
     {
         using async_result::_async_result_impl_::_async_result_impl_;
     };
 } // namespace std::experimental::net
 
+namespace std
+{
+    template<class... Ts>
+    struct tuple_size<coronet::completion<Ts...>>
+      : integral_constant<size_t, sizeof...(Ts)>
+    {};
+
+    template<size_t I, class... Ts>
+    struct tuple_element<I, coronet::completion<Ts...>>
+      : tuple_element<I, tuple<Ts...>>
+    {};
+} // namespace std
+
 namespace std::experimental
 {
     template<class T, class Token, class... Args>
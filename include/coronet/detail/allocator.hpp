@@ -104,7 +104,7 @@ namespace coronet
         allocator_base() = default;
         allocator_base(allocator_base&&) = default;
         allocator_base(allocator_base const& that)
-          : impl_(that.impl_ ? nullptr : that.impl_->clone())
+          : impl_(that.impl_ ? that.impl_->clone() : nullptr)
         {}
         template<class T_, class T = rebind_alloc<std::decay_t<T_>, char>>
         allocator_base(T_&& t)
@@ -114,7 +114,7 @@ namespace coronet
         allocator_base& operator=(allocator_base&&) = default;
         allocator_base& operator=(allocator_base const& that)
         {
-            impl_ = that.impl_ ? nullptr : that.impl_->clone();
+            impl_ = that.impl_ ? that.impl_->clone() : nullptr;
             return *this;
         }
         template<class T_, class T = rebind_alloc<std::decay_t<T_>, char>>
@@ -134,7 +134,9 @@ namespace coronet
         }
         friend bool operator==(allocator_base const& a, allocator_base const& b)
         {
-            return (!a.impl_ && !b.impl_) || a.impl_->equal_to(a.impl_.get());
+            if(!a.impl_ || !b.impl_)
+                return !a.impl_ && !b.impl_;
+            return a.impl_->equal_to(b.impl_.get());
         }
         friend bool operator!=(allocator_base const& a, allocator_base const& b)
         {
@@ -145,20 +147,26 @@ namespace coronet
     template<class T = void>
     struct allocator : private allocator_base
     {
+        template<class U>
+        friend struct allocator;
+
         using value_type = T;
 
         using allocator_base::allocator_base;
         allocator() = default;
+        // Rebinding shares the erased allocator rather than wrapping the
+        // other allocator in a new one.
         CO_PP_template(class U)(
             requires !Same<T, U>)
         allocator(allocator<U> other)
-          : allocator_base(std::move(other))
+          : allocator_base(static_cast<allocator_base&&>(other))
         {}
         CO_PP_template(class U)(
             requires !Same<T, U>)
         allocator& operator=(allocator<U> other)
         {
-            static_cast<allocator_base&>(*this) = std::move(other);
+            static_cast<allocator_base&>(*this) =
+                static_cast<allocator_base&&>(other);
             return *this;
         }
         T* allocate(std::size_t n)
@@ -169,6 +177,16 @@ namespace coronet
         {
             allocator_base::deallocate(p, n * sizeof(T));
         }
+        // The base's are out of reach through the private base.
+        friend bool operator==(allocator const& a, allocator const& b)
+        {
+            return static_cast<allocator_base const&>(a) ==
+                   static_cast<allocator_base const&>(b);
+        }
+        friend bool operator!=(allocator const& a, allocator const& b)
+        {
+            return !(a == b);
+        }
     };
 }
 
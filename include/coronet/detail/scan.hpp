@@ -0,0 +1,191 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+//
+#ifndef CORONET_DETAIL_SCAN_HPP
+#define CORONET_DETAIL_SCAN_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#if(defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define CORONET_HAS_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define CORONET_HAS_X86_SIMD 0
+#endif
+
+namespace coronet
+{
+    // Find the first occurrence of delim in [first, last), or return last.
+    using _scan_fn = char const* (*)(char const*, char const*,
+                                     std::string_view) noexcept;
+
+    inline char const* _find_delimiter_scalar(
+        char const* first, char const* last, std::string_view delim) noexcept
+    {
+        auto const k = delim.size();
+        if(k == 0)
+            return first;
+        if(static_cast<std::size_t>(last - first) < k)
+            return last;
+        char const* const stop = last - (k - 1);
+        for(auto* p = first; p != stop; ++p)
+        {
+            p = static_cast<char const*>(
+                std::memchr(p, delim[0], static_cast<std::size_t>(stop - p)));
+            if(!p)
+                break;
+            if(std::memcmp(p + 1, delim.data() + 1, k - 1) == 0)
+                return p;
+        }
+        return last;
+    }
+
+#if CORONET_HAS_X86_SIMD
+    // The vector scanners look for positions where both the first and the
+    // last byte of the delimiter match, which rules out nearly every false
+    // candidate that a memchr for the first byte would stop at, and compare
+    // the middle bytes of the survivors. They test 64 positions per step,
+    // and leave the short tail to the scanner below them.
+    inline char const* _find_candidates(char const* first, std::uint64_t mask,
+                                        std::string_view delim) noexcept
+    {
+        auto const k = delim.size();
+        for(; mask != 0; mask &= mask - 1)
+        {
+            auto const p = first + __builtin_ctzll(mask);
+            if(k <= 2 || std::memcmp(p + 1, delim.data() + 1, k - 2) == 0)
+                return p;
+        }
+        return nullptr;
+    }
+
+    __attribute__((target("sse2"))) inline __m128i _match_sse2(
+        char const* p, std::size_t k, __m128i f, __m128i l) noexcept
+    {
+        __m128i const a = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p));
+        __m128i const b =
+            _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + k - 1));
+        return _mm_and_si128(_mm_cmpeq_epi8(a, f), _mm_cmpeq_epi8(b, l));
+    }
+
+    __attribute__((target("sse2"))) inline char const* _find_delimiter_sse2(
+        char const* first, char const* last, std::string_view delim) noexcept
+    {
+        auto const k = delim.size();
+        if(k == 0 || static_cast<std::size_t>(last - first) < k)
+            return k == 0 ? first : last;
+        auto const n = static_cast<std::size_t>(last - first) - (k - 1);
+        __m128i const f = _mm_set1_epi8(delim[0]);
+        __m128i const l = _mm_set1_epi8(delim[k - 1]);
+        std::size_t i = 0;
+        for(; i + 64 <= n; i += 64)
+        {
+            __m128i m[4];
+            for(int j = 0; j != 4; ++j)
+                m[j] = _match_sse2(first + i + 16 * j, k, f, l);
+            if(!_mm_movemask_epi8(_mm_or_si128(
+                   _mm_or_si128(m[0], m[1]), _mm_or_si128(m[2], m[3]))))
+                continue;
+            std::uint64_t mask = 0;
+            for(int j = 0; j != 4; ++j)
+                mask |= static_cast<std::uint64_t>(
+                            static_cast<unsigned>(_mm_movemask_epi8(m[j])))
+                    << (16 * j);
+            if(auto const p = _find_candidates(first + i, mask, delim))
+                return p;
+        }
+        return _find_delimiter_scalar(first + i, last, delim);
+    }
+
+    __attribute__((target("avx2"))) inline __m256i _match_avx2(
+        char const* p, std::size_t k, __m256i f, __m256i l) noexcept
+    {
+        __m256i const a =
+            _mm256_loadu_si256(reinterpret_cast<__m256i const*>(p));
+        __m256i const b =
+            _mm256_loadu_si256(reinterpret_cast<__m256i const*>(p + k - 1));
+        return _mm256_and_si256(
+            _mm256_cmpeq_epi8(a, f), _mm256_cmpeq_epi8(b, l));
+    }
+
+    __attribute__((target("avx2"))) inline char const* _find_delimiter_avx2(
+        char const* first, char const* last, std::string_view delim) noexcept
+    {
+        auto const k = delim.size();
+        if(k == 0 || static_cast<std::size_t>(last - first) < k)
+            return k == 0 ? first : last;
+        auto const n = static_cast<std::size_t>(last - first) - (k - 1);
+        __m256i const f = _mm256_set1_epi8(delim[0]);
+        __m256i const l = _mm256_set1_epi8(delim[k - 1]);
+        std::size_t i = 0;
+        for(; i + 64 <= n; i += 64)
+        {
+            __m256i const lo = _match_avx2(first + i, k, f, l);
+            __m256i const hi = _match_avx2(first + i + 32, k, f, l);
+            if(_mm256_testz_si256(_mm256_or_si256(lo, hi),
+                                  _mm256_or_si256(lo, hi)))
+                continue;
+            auto const mask =
+                static_cast<std::uint64_t>(
+                    static_cast<unsigned>(_mm256_movemask_epi8(lo))) |
+                static_cast<std::uint64_t>(
+                    static_cast<unsigned>(_mm256_movemask_epi8(hi)))
+                    << 32;
+            if(auto const p = _find_candidates(first + i, mask, delim))
+                return p;
+        }
+        return _find_delimiter_sse2(first + i, last, delim);
+    }
+#endif
+
+    inline _scan_fn _select_scanner() noexcept
+    {
+#if CORONET_HAS_X86_SIMD
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx2"))
+            return &_find_delimiter_avx2;
+        if(__builtin_cpu_supports("sse2"))
+            return &_find_delimiter_sse2;
+#endif
+        return &_find_delimiter_scalar;
+    }
+
+    // memchr is hard to beat at finding a byte that is rare in the data,
+    // which the first byte of a delimiter usually is. Once that byte has
+    // started a false match, hand over to the fastest vector scanner this CPU
+    // supports, picked on first use.
+    inline char const* _find_delimiter(
+        char const* first, char const* last, std::string_view delim) noexcept
+    {
+        static _scan_fn const scan = _select_scanner();
+        auto const k = delim.size();
+        if(k < 2)
+            return _find_delimiter_scalar(first, last, delim);
+        if(static_cast<std::size_t>(last - first) < k)
+            return last;
+        char const* const stop = last - (k - 1);
+        first = static_cast<char const*>(std::memchr(
+            first, delim[0], static_cast<std::size_t>(stop - first)));
+        if(!first)
+            return last;
+        if(std::memcmp(first + 1, delim.data() + 1, k - 1) == 0)
+            return first;
+        return scan(first + 1, last, delim);
+    }
+} // namespace coronet
+
+#endif
@@ -0,0 +1,117 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+//
+#ifndef CORONET_DETAIL_WAITER_HPP
+#define CORONET_DETAIL_WAITER_HPP
+
+#include <experimental/coroutine>
+
+#include <coronet/coronet.hpp>
+
+namespace coronet
+{
+    struct CHasExecutor
+    {
+        template<class P>
+        auto requires_(P& p)
+            -> decltype(p.get_executor()->*satisfies<CExecutor>,
+                        p.get_allocator()->*satisfies<CAllocator>);
+    };
+    template<class P>
+    inline constexpr bool HasExecutor = is_satisfied_by<CHasExecutor, P>;
+
+    // Resume a suspended coroutine in its own execution context: post it to
+    // its promise's executor when it has one, otherwise resume it inline. A
+    // coroutine running in an implicit context is posted to the executor of
+    // the nearest enclosing coroutine that was given an explicit token.
+    template<class Promise>
+    void _resume_in_context(void* addr)
+    {
+        auto coro =
+            std::experimental::coroutine_handle<Promise>::from_address(addr);
+        if constexpr(HasExecutor<Promise>)
+        {
+            auto& p = coro.promise();
+            if constexpr(Same<std::decay_t<decltype(p.get_executor())>,
+                              _implicit_executor>)
+                return p.get_executor().resume(coro);
+            else
+                return p.get_executor().post(coro, p.get_allocator());
+        }
+        coro.resume();
+    }
+
+    // An intrusive list node for a coroutine suspended on one of coronet's
+    // synchronization objects. It lives in the suspended coroutine's frame
+    // (usually as part of the awaitable), so suspending does not allocate.
+    struct _waiter
+    {
+        _waiter* next_ = nullptr;
+        void* coro_ = nullptr;
+        void (*resume_)(void*) = nullptr;
+
+        template<class Promise>
+        void set_coroutine(std::experimental::coroutine_handle<Promise> coro)
+        {
+            coro_ = coro.address();
+            resume_ = &_resume_in_context<Promise>;
+        }
+        void resume()
+        {
+            resume_(coro_);
+        }
+    };
+
+    // A FIFO queue of waiters. Not thread-safe on its own; the object that
+    // owns it guards it.
+    struct _waiter_queue
+    {
+    private:
+        _waiter* head_ = nullptr;
+        _waiter** tail_ = &head_;
+
+    public:
+        bool empty() const noexcept
+        {
+            return head_ == nullptr;
+        }
+        void push(_waiter* w) noexcept
+        {
+            w->next_ = nullptr;
+            *tail_ = w;
+            tail_ = &w->next_;
+        }
+        _waiter* pop() noexcept
+        {
+            _waiter* w = head_;
+            if(w && !(head_ = w->next_))
+                tail_ = &head_;
+            return w;
+        }
+        // Detach the whole list, leaving this queue empty.
+        _waiter* take_all() noexcept
+        {
+            tail_ = &head_;
+            return std::exchange(head_, nullptr);
+        }
+    };
+
+    // Resume every waiter in a list detached with take_all.
+    inline void _resume_all(_waiter* w)
+    {
+        while(w)
+            std::exchange(w, w->next_)->resume();
+    }
+} // namespace coronet
+
+#endif
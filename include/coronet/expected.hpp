@@ -0,0 +1,209 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+//
+#ifndef CORONET_EXPECTED_HPP
+#define CORONET_EXPECTED_HPP
+
+#include <exception>
+#include <new>
+#include <optional>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+#include <coronet/detail/concepts.hpp>
+
+namespace coronet
+{
+    template<class E>
+    struct unexpected
+    {
+        E error_;
+
+        constexpr explicit unexpected(E e)
+          : error_(std::move(e))
+        {}
+        constexpr E const& error() const noexcept
+        {
+            return error_;
+        }
+    };
+
+    template<class E>
+    unexpected(E)->unexpected<E>;
+
+    template<class E>
+    [[noreturn]] void _throw_error(E const& e)
+    {
+        if constexpr(ConvertibleTo<E const&, std::error_code>)
+            throw std::system_error(e);
+        else
+            throw e;
+    }
+
+    // Either a value or an error, for operations that report routine
+    // failures without throwing. An async operation that returns
+    // expected<T, E> has the completion signature void(E, T), and one that
+    // returns expected<void, E> has void(E). A callback is given a
+    // value-initialized T along with an error, or if T has no default
+    // constructor, just the error. An exception that escapes such an
+    // operation is turned into an error, as _error_from_exception says.
+    //
+    // E cannot be std::exception_ptr. void(std::exception_ptr, T) is the
+    // signature of an operation that returns plain T, so awaiting one
+    // would give back T, not the expected; return T and throw instead.
+    template<class E>
+    inline constexpr bool _valid_expected_error =
+        !Same<std::decay_t<E>, std::exception_ptr>;
+
+    template<class T, class E = std::error_code>
+    struct expected
+    {
+        static_assert(_valid_expected_error<E>,
+                      "Return T rather than expected<T, std::exception_ptr>.");
+
+    private:
+        std::variant<T, E> v_;
+
+    public:
+        using value_type = T;
+        using error_type = E;
+
+        expected()
+          : v_(std::in_place_index<0>)
+        {}
+        expected(T value)
+          : v_(std::in_place_index<0>, std::move(value))
+        {}
+        template<class G>
+        expected(unexpected<G> e)
+          : v_(std::in_place_index<1>, std::move(e.error_))
+        {}
+        bool has_value() const noexcept
+        {
+            return v_.index() == 0;
+        }
+        explicit operator bool() const noexcept
+        {
+            return has_value();
+        }
+        T& value() &
+        {
+            if(!has_value())
+                _throw_error(error());
+            return *std::get_if<0>(&v_);
+        }
+        T const& value() const&
+        {
+            if(!has_value())
+                _throw_error(error());
+            return *std::get_if<0>(&v_);
+        }
+        T&& value() &&
+        {
+            return std::move(value());
+        }
+        T& operator*() & noexcept
+        {
+            return *std::get_if<0>(&v_);
+        }
+        T&& operator*() && noexcept
+        {
+            return std::move(*std::get_if<0>(&v_));
+        }
+        T* operator->() noexcept
+        {
+            return std::get_if<0>(&v_);
+        }
+        E const& error() const noexcept
+        {
+            return *std::get_if<1>(&v_);
+        }
+    };
+
+    template<class E>
+    struct expected<void, E>
+    {
+        static_assert(_valid_expected_error<E>,
+                      "Return void rather than "
+                      "expected<void, std::exception_ptr>.");
+
+    private:
+        std::optional<E> error_;
+
+    public:
+        using value_type = void;
+        using error_type = E;
+
+        expected() = default;
+        template<class G>
+        expected(unexpected<G> e)
+          : error_(std::move(e.error_))
+        {}
+        bool has_value() const noexcept
+        {
+            return !error_.has_value();
+        }
+        explicit operator bool() const noexcept
+        {
+            return has_value();
+        }
+        void value() const
+        {
+            if(!has_value())
+                _throw_error(error());
+        }
+        E const& error() const noexcept
+        {
+            return *error_;
+        }
+    };
+
+    // The error that reports an exception escaping an operation that
+    // returns expected<T, E>, where E can hold an error_code: the code of a
+    // std::system_error, not_enough_memory for std::bad_alloc, and
+    // state_not_recoverable for anything else.
+    template<class E>
+    inline constexpr bool _can_report_exception =
+        ConvertibleTo<std::error_code, E>;
+
+    template<class E>
+    E _error_from_exception(std::exception_ptr eptr)
+    {
+        try
+        {
+            std::rethrow_exception(std::move(eptr));
+        }
+        catch(std::system_error const& e)
+        {
+            return e.code();
+        }
+        catch(std::bad_alloc const&)
+        {
+            return std::make_error_code(std::errc::not_enough_memory);
+        }
+        catch(...)
+        {
+            return std::make_error_code(std::errc::state_not_recoverable);
+        }
+    }
+
+    template<class T>
+    inline constexpr bool _is_expected = false;
+
+    template<class T, class E>
+    inline constexpr bool _is_expected<expected<T, E>> = true;
+} // namespace coronet
+
+#endif
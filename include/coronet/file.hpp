@@ -0,0 +1,575 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+//
+#ifndef CORONET_FILE_HPP
+#define CORONET_FILE_HPP
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+
+#include <experimental/buffer>
+#include <experimental/coroutine>
+
+#include <unistd.h>
+
+#include <coronet/coronet.hpp>
+#include <coronet/detail/waiter.hpp>
+#include <coronet/thread_pool.hpp>
+
+// io_uring is used when the headers have it and the kernel allows it.
+#ifndef CORONET_HAS_IO_URING
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define CORONET_HAS_IO_URING 1
+#else
+#define CORONET_HAS_IO_URING 0
+#endif
+#endif
+
+#if CORONET_HAS_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace coronet
+{
+    // One positional read or write, with pread/pwrite semantics. The
+    // backend resumes the waiting coroutine when it finishes.
+    struct _file_request : _waiter
+    {
+        int fd_ = -1;
+        std::uint64_t offset_ = 0;
+        void* data_ = nullptr;
+        std::size_t size_ = 0;
+        bool write_ = false;
+        std::size_t result_ = 0;
+        std::error_code ec_{};
+        // Links in the io_uring backend's list of requests in flight.
+        _file_request* prev_in_flight_ = nullptr;
+        _file_request* next_in_flight_ = nullptr;
+    };
+
+    struct _file_backend
+    {
+        virtual ~_file_backend() = default;
+        // Start req, and resume it when it finishes. Never throws; a
+        // failure to start is reported through req.ec_.
+        virtual void submit(_file_request& req) noexcept = 0;
+    };
+
+    // Blocking pread and pwrite on a dedicated pool of threads, so that a
+    // slow disk stalls those threads and not the caller's executor.
+    struct _blocking_file_backend final : _file_backend
+    {
+        thread_pool pool_;
+
+        explicit _blocking_file_backend(std::size_t threads)
+          : pool_(threads)
+        {}
+        static void _run(_file_request& req) noexcept
+        {
+            ::ssize_t n;
+            do
+                n = req.write_ ? ::pwrite(req.fd_, req.data_, req.size_,
+                                          static_cast<::off_t>(req.offset_))
+                               : ::pread(req.fd_, req.data_, req.size_,
+                                         static_cast<::off_t>(req.offset_));
+            while(n < 0 && errno == EINTR);
+            if(n < 0)
+                req.ec_ = std::error_code(errno, std::system_category());
+            else
+                req.result_ = static_cast<std::size_t>(n);
+            req.resume();
+        }
+        void submit(_file_request& req) noexcept override
+        {
+            try
+            {
+                pool_.get_executor().post([&req] { _run(req); },
+                                          std::allocator<void>{});
+            }
+            catch(...)
+            {
+                req.ec_ = std::make_error_code(std::errc::not_enough_memory);
+                req.resume();
+            }
+        }
+    };
+
+#if CORONET_HAS_IO_URING
+    // A raw io_uring: submitters fill a submission queue entry under a
+    // lock and submit it themselves, and one reaper thread waits for
+    // completions and resumes their coroutines. If waiting fails other
+    // than for a moment, the ring is dead: every request in flight fails
+    // with that error, and so does every later one, at once.
+    struct _uring_file_backend final : _file_backend
+    {
+    private:
+        int fd_ = -1;
+        unsigned sq_entries_ = 0;
+        unsigned* sq_head_ = nullptr;
+        unsigned* sq_tail_ = nullptr;
+        unsigned* sq_mask_ = nullptr;
+        unsigned* sq_array_ = nullptr;
+        ::io_uring_sqe* sqes_ = nullptr;
+        unsigned* cq_head_ = nullptr;
+        unsigned* cq_tail_ = nullptr;
+        unsigned* cq_mask_ = nullptr;
+        ::io_uring_cqe* cqes_ = nullptr;
+        void* sq_ring_ = MAP_FAILED;
+        void* cq_ring_ = MAP_FAILED;
+        std::size_t sq_ring_size_ = 0;
+        std::size_t cq_ring_size_ = 0;
+        std::size_t sqes_size_ = 0;
+        std::mutex mtx_;
+        _file_request* in_flight_ = nullptr;
+        std::error_code error_{};
+        std::thread reaper_;
+
+        static int _enter(int fd, unsigned submit, unsigned wait,
+                          unsigned flags) noexcept
+        {
+            return static_cast<int>(::syscall(__NR_io_uring_enter, fd, submit,
+                                              wait, flags, nullptr, 0));
+        }
+        static std::system_error _error(char const* what)
+        {
+            return std::system_error(errno, std::system_category(), what);
+        }
+        void _release() noexcept
+        {
+            if(sqes_)
+                ::munmap(sqes_, sqes_size_);
+            if(cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_)
+                ::munmap(cq_ring_, cq_ring_size_);
+            if(sq_ring_ != MAP_FAILED)
+                ::munmap(sq_ring_, sq_ring_size_);
+            if(fd_ >= 0)
+                ::close(fd_);
+        }
+
+        // Called with mtx_ held.
+        void _link(_file_request* req) noexcept
+        {
+            req->prev_in_flight_ = nullptr;
+            req->next_in_flight_ = in_flight_;
+            if(in_flight_)
+                in_flight_->prev_in_flight_ = req;
+            in_flight_ = req;
+        }
+        void _unlink(_file_request* req) noexcept
+        {
+            if(req->prev_in_flight_)
+                req->prev_in_flight_->next_in_flight_ = req->next_in_flight_;
+            else
+                in_flight_ = req->next_in_flight_;
+            if(req->next_in_flight_)
+                req->next_in_flight_->prev_in_flight_ = req->prev_in_flight_;
+        }
+
+        // Queue one entry and submit it, or return false if the submission
+        // queue is full. A null req stops the reaper.
+        bool _push(std::uint8_t op, _file_request* req) noexcept
+        {
+            {
+                std::unique_lock<std::mutex> lock{mtx_};
+                if(error_)
+                {
+                    // The reaper is gone, and the ring with it.
+                    if(req)
+                    {
+                        req->ec_ = error_;
+                        lock.unlock();
+                        req->resume();
+                    }
+                    return true;
+                }
+                auto const tail = *sq_tail_;
+                if(tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) ==
+                   sq_entries_)
+                    return false;
+                auto const i = tail & *sq_mask_;
+                auto& sqe = sqes_[i];
+                sqe = {};
+                sqe.opcode = op;
+                if(req)
+                {
+                    sqe.fd = req->fd_;
+                    sqe.off = req->offset_;
+                    sqe.addr = reinterpret_cast<std::uintptr_t>(req->data_);
+                    // The kernel caps a single read or write at this much
+                    // anyway.
+                    sqe.len = static_cast<unsigned>(
+                        (std::min)(req->size_, std::size_t(0x7ffff000)));
+                }
+                sqe.user_data = reinterpret_cast<std::uintptr_t>(req);
+                if(req)
+                    _link(req);
+                sq_array_[i] = i;
+                __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+            }
+            // Whoever enters first submits every entry queued so far, and
+            // those after it may find nothing left to submit.
+            while(_enter(fd_, sq_entries_, 0, 0) < 0 &&
+                  (errno == EINTR || errno == EAGAIN || errno == EBUSY))
+                std::this_thread::yield();
+            return true;
+        }
+
+        void _fail_all(std::error_code ec) noexcept
+        {
+            _waiter_queue failed;
+            {
+                std::lock_guard<std::mutex> lock{mtx_};
+                error_ = ec;
+                for(; in_flight_; in_flight_ = in_flight_->next_in_flight_)
+                {
+                    in_flight_->ec_ = ec;
+                    failed.push(in_flight_);
+                }
+            }
+            _resume_all(failed.take_all());
+        }
+
+        void _reap() noexcept
+        {
+            for(;;)
+            {
+                // EBUSY is a completion queue overflow, which reaping ends.
+                if(_enter(fd_, 0, 1, IORING_ENTER_GETEVENTS) < 0 &&
+                   errno != EINTR && errno != EAGAIN && errno != EBUSY)
+                    return _fail_all(
+                        std::error_code(errno, std::system_category()));
+                auto head = *cq_head_;
+                auto const tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+                bool stop = false;
+                _waiter_queue done;
+                {
+                    std::lock_guard<std::mutex> lock{mtx_};
+                    for(; head != tail; ++head)
+                    {
+                        auto const& cqe = cqes_[head & *cq_mask_];
+                        auto* req = reinterpret_cast<_file_request*>(
+                            static_cast<std::uintptr_t>(cqe.user_data));
+                        if(!req)
+                        {
+                            stop = true;
+                            continue;
+                        }
+                        if(cqe.res < 0)
+                            req->ec_ = std::error_code(
+                                -cqe.res, std::system_category());
+                        else
+                            req->result_ = static_cast<std::size_t>(cqe.res);
+                        _unlink(req);
+                        done.push(req);
+                    }
+                }
+                __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+                _resume_all(done.take_all());
+                if(stop)
+                    return;
+            }
+        }
+
+        // IORING_OP_READ and IORING_OP_WRITE need Linux 5.6, as does the
+        // probe; older kernels fail it.
+        bool _supports_read_write() const noexcept
+        {
+            constexpr unsigned ops = 256;
+            alignas(::io_uring_probe) unsigned char buf[
+                sizeof(::io_uring_probe) + ops * sizeof(::io_uring_probe_op)]{};
+            auto* probe = reinterpret_cast<::io_uring_probe*>(buf);
+            if(::syscall(__NR_io_uring_register, fd_, IORING_REGISTER_PROBE,
+                         probe, ops) < 0)
+                return false;
+            auto const supported = [probe](unsigned op) {
+                return op <= probe->last_op && op < probe->ops_len &&
+                       (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+            };
+            return supported(IORING_OP_READ) && supported(IORING_OP_WRITE);
+        }
+
+    public:
+        explicit _uring_file_backend(unsigned entries)
+        {
+            ::io_uring_params p{};
+            p.flags = IORING_SETUP_CQSIZE;
+            p.cq_entries = 4 * entries;
+            fd_ = static_cast<int>(
+                ::syscall(__NR_io_uring_setup, entries, &p));
+            if(fd_ < 0)
+                throw _error("io_uring_setup");
+            if(!_supports_read_write())
+            {
+                _release();
+                throw std::system_error(
+                    std::make_error_code(std::errc::function_not_supported),
+                    "io_uring read and write");
+            }
+            sq_entries_ = p.sq_entries;
+            sq_ring_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+            cq_ring_size_ =
+                p.cq_off.cqes + p.cq_entries * sizeof(::io_uring_cqe);
+            if(p.features & IORING_FEAT_SINGLE_MMAP)
+                sq_ring_size_ = cq_ring_size_ =
+                    (std::max)(sq_ring_size_, cq_ring_size_);
+            sq_ring_ = ::mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_POPULATE, fd_,
+                              IORING_OFF_SQ_RING);
+            if(sq_ring_ == MAP_FAILED)
+            {
+                auto e = _error("mmap");
+                _release();
+                throw e;
+            }
+            cq_ring_ = sq_ring_;
+            if(!(p.features & IORING_FEAT_SINGLE_MMAP))
+                cq_ring_ = ::mmap(nullptr, cq_ring_size_,
+                                  PROT_READ | PROT_WRITE,
+                                  MAP_SHARED | MAP_POPULATE, fd_,
+                                  IORING_OFF_CQ_RING);
+            sqes_size_ = p.sq_entries * sizeof(::io_uring_sqe);
+            void* sqes = ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_POPULATE, fd_,
+                                IORING_OFF_SQES);
+            if(cq_ring_ == MAP_FAILED || sqes == MAP_FAILED)
+            {
+                auto e = _error("mmap");
+                if(sqes != MAP_FAILED)
+                    sqes_ = static_cast<::io_uring_sqe*>(sqes);
+                _release();
+                throw e;
+            }
+            sqes_ = static_cast<::io_uring_sqe*>(sqes);
+            auto* sq = static_cast<char*>(sq_ring_);
+            auto* cq = static_cast<char*>(cq_ring_);
+            sq_head_ = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+            sq_tail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+            sq_mask_ = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+            sq_array_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+            cq_head_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+            cq_tail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+            cq_mask_ = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+            cqes_ = reinterpret_cast<::io_uring_cqe*>(cq + p.cq_off.cqes);
+            reaper_ = std::thread{[this] { _reap(); }};
+        }
+        ~_uring_file_backend()
+        {
+            while(!_push(IORING_OP_NOP, nullptr))
+                std::this_thread::yield();
+            reaper_.join();
+            _release();
+        }
+        void submit(_file_request& req) noexcept override
+        {
+            auto const op = req.write_ ? IORING_OP_WRITE : IORING_OP_READ;
+            // The submission queue is only full while other threads are
+            // between queueing and entering; wait them out.
+            while(!_push(op, &req))
+                std::this_thread::yield();
+        }
+    };
+#endif
+
+    // Where file reads and writes run. The io_uring backend has the kernel
+    // do the I/O, with one thread to collect completions. The thread-pool
+    // backend does blocking I/O on threads of its own. Either way, the
+    // operation completes in its caller's execution context.
+    struct file_service
+    {
+        enum class backend
+        {
+            io_uring,
+            thread_pool
+        };
+
+    private:
+        std::unique_ptr<_file_backend> impl_;
+        backend kind_;
+
+        struct _op : _file_request
+        {
+            _file_backend* backend_;
+
+            static constexpr bool await_ready() noexcept
+            {
+                return false;
+            }
+            template<class Promise>
+            void await_suspend(
+                std::experimental::coroutine_handle<Promise> awaiter)
+            {
+                this->set_coroutine(awaiter);
+                backend_->submit(*this);
+            }
+            std::size_t await_resume() const
+            {
+                if(ec_)
+                    throw std::system_error(ec_);
+                return result_;
+            }
+        };
+        _op _make_op(int fd, std::uint64_t offset, void* data,
+                     std::size_t size, bool write)
+        {
+            _op op;
+            op.fd_ = fd;
+            op.offset_ = offset;
+            op.data_ = data;
+            op.size_ = size;
+            op.write_ = write;
+            op.backend_ = impl_.get();
+            return op;
+        }
+
+        static std::unique_ptr<_file_backend> _make(backend b, std::size_t n)
+        {
+            if(b == backend::thread_pool)
+                return std::make_unique<_blocking_file_backend>(n ? n : 4);
+#if CORONET_HAS_IO_URING
+            return std::make_unique<_uring_file_backend>(
+                n ? static_cast<unsigned>(n) : 256u);
+#else
+            throw std::system_error(
+                std::make_error_code(std::errc::function_not_supported));
+#endif
+        }
+
+    public:
+        // io_uring if the kernel allows it and is Linux 5.6 or later, and
+        // otherwise a pool of threads.
+        file_service()
+        {
+            try
+            {
+                impl_ = _make(kind_ = backend::io_uring, 0);
+            }
+            catch(std::system_error const&)
+            {
+                impl_ = _make(kind_ = backend::thread_pool, 0);
+            }
+        }
+        // The given backend, with size as the io_uring queue depth or the
+        // number of threads; zero picks a default. Throws std::system_error
+        // if io_uring is unavailable.
+        explicit file_service(backend b, std::size_t size = 0)
+          : impl_(_make(b, size))
+          , kind_(b)
+        {}
+        file_service(file_service&&) = delete;
+
+        backend get_backend() const noexcept
+        {
+            return kind_;
+        }
+        // The service that async_read_file_at and async_write_file_at use.
+        static file_service& get_default()
+        {
+            static file_service service;
+            return service;
+        }
+
+        // Read into buffer from offset in the file fd, completing with the
+        // number of bytes read. Like pread, that may be fewer than asked
+        // for, and is zero at end of file.
+        CO_PP_template(class Token)(
+            requires CompletionToken<Token>)
+        auto async_read_at(int fd, std::uint64_t offset,
+                           std::experimental::net::mutable_buffer buffer,
+                           Token token)
+            -> result_t<Token, std::size_t(
+                                   int, std::uint64_t,
+                                   std::experimental::net::mutable_buffer)>
+        {
+            INITIAL_SUSPEND(token);
+            co_return co_await _make_op(fd, offset, buffer.data(),
+                                        buffer.size(), false);
+        }
+        auto async_read_at(int fd, std::uint64_t offset,
+                           std::experimental::net::mutable_buffer buffer)
+        {
+            return callable_with_implicit_context{
+                [this, fd, offset, buffer](auto token) {
+                    return this->async_read_at(fd, offset, buffer, token);
+                }};
+        }
+
+        // Write buffer at offset in the file fd, completing with the number
+        // of bytes written, which like pwrite may be fewer than asked for.
+        CO_PP_template(class Token)(
+            requires CompletionToken<Token>)
+        auto async_write_at(int fd, std::uint64_t offset,
+                            std::experimental::net::const_buffer buffer,
+                            Token token)
+            -> result_t<Token, std::size_t(
+                                   int, std::uint64_t,
+                                   std::experimental::net::const_buffer)>
+        {
+            INITIAL_SUSPEND(token);
+            co_return co_await _make_op(fd, offset,
+                                        const_cast<void*>(buffer.data()),
+                                        buffer.size(), true);
+        }
+        auto async_write_at(int fd, std::uint64_t offset,
+                            std::experimental::net::const_buffer buffer)
+        {
+            return callable_with_implicit_context{
+                [this, fd, offset, buffer](auto token) {
+                    return this->async_write_at(fd, offset, buffer, token);
+                }};
+        }
+    };
+
+    // Read from the file fd at offset through the default file_service.
+    CO_PP_template(class Token)(
+        requires CompletionToken<Token>)
+    auto async_read_file_at(int fd, std::uint64_t offset,
+                            std::experimental::net::mutable_buffer buffer,
+                            Token token)
+    {
+        return file_service::get_default().async_read_at(
+            fd, offset, buffer, std::move(token));
+    }
+    inline auto async_read_file_at(
+        int fd, std::uint64_t offset,
+        std::experimental::net::mutable_buffer buffer)
+    {
+        return file_service::get_default().async_read_at(fd, offset, buffer);
+    }
+
+    // Write to the file fd at offset through the default file_service.
+    CO_PP_template(class Token)(
+        requires CompletionToken<Token>)
+    auto async_write_file_at(int fd, std::uint64_t offset,
+                             std::experimental::net::const_buffer buffer,
+                             Token token)
+    {
+        return file_service::get_default().async_write_at(
+            fd, offset, buffer, std::move(token));
+    }
+    inline auto async_write_file_at(
+        int fd, std::uint64_t offset,
+        std::experimental::net::const_buffer buffer)
+    {
+        return file_service::get_default().async_write_at(fd, offset, buffer);
+    }
+} // namespace coronet
+
+#endif
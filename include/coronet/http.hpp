@@ -0,0 +1,473 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+//
+#ifndef CORONET_HTTP_HPP
+#define CORONET_HTTP_HPP
+
+#include <atomic>
+#include <charconv>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <meta/meta.hpp>
+
+#include <experimental/buffer>
+#include <experimental/internet>
+#include <experimental/io_context>
+#include <experimental/timer>
+
+#include <coronet/coronet.hpp>
+#include <coronet/net.hpp>
+
+namespace coronet
+{
+    struct http_header
+    {
+        std::string_view name;
+        std::string_view value;
+    };
+
+    inline bool _iequals(std::string_view a, std::string_view b) noexcept
+    {
+        if(a.size() != b.size())
+            return false;
+        for(std::size_t i = 0; i != a.size(); ++i)
+            if((a[i] | 0x20) != (b[i] | 0x20))
+                return false;
+        return true;
+    }
+
+    inline std::string_view _trim(std::string_view s) noexcept
+    {
+        while(!s.empty() && (s.front() == ' ' || s.front() == '\t'))
+            s.remove_prefix(1);
+        while(!s.empty() && (s.back() == ' ' || s.back() == '\t'))
+            s.remove_suffix(1);
+        return s;
+    }
+
+    // A parsed request. Its views point into the buffer it was parsed from.
+    struct http_request
+    {
+        static constexpr std::size_t max_headers = 64;
+
+        std::string_view method;
+        std::string_view target;
+        int minor_version = 1;
+        bool keep_alive = true;
+        std::string_view body;
+        std::size_t header_count = 0;
+        http_header headers[max_headers];
+
+        // The value of the first header with this name, or an empty view.
+        std::string_view header(std::string_view name) const noexcept
+        {
+            for(std::size_t i = 0; i != header_count; ++i)
+                if(_iequals(headers[i].name, name))
+                    return headers[i].value;
+            return {};
+        }
+    };
+
+    enum class http_parse_result
+    {
+        complete,
+        incomplete,
+        error
+    };
+
+    // An incremental HTTP/1.x request parser that does not copy. Call parse
+    // with the unconsumed bytes of a connection, starting at the beginning
+    // of a request, each time more arrive. It picks up the search for the
+    // end of the headers where the last call left off. Requests with a
+    // Transfer-Encoding are rejected; bodies need a Content-Length.
+    struct http_parser
+    {
+    private:
+        // How much of the current request has been searched for the blank
+        // line that ends its headers.
+        std::size_t scanned_ = 0;
+
+    public:
+        // On complete, req refers into data and consumed is the size of the
+        // request.
+        http_parse_result parse(std::string_view data, http_request& req,
+                                std::size_t& consumed) noexcept
+        {
+            auto const end =
+                data.find("\r\n\r\n", scanned_ < 3 ? 0 : scanned_ - 3);
+            if(end == std::string_view::npos)
+            {
+                scanned_ = data.size();
+                return http_parse_result::incomplete;
+            }
+            // If the body is incomplete, find the end of the headers again
+            // right away next time.
+            scanned_ = end;
+            auto head = data.substr(0, end + 2);
+
+            auto eol = head.find("\r\n");
+            auto const line = head.substr(0, eol);
+            auto const sp1 = line.find(' ');
+            auto const sp2 = line.find(' ', sp1 + 1);
+            if(sp1 == 0 || sp2 == std::string_view::npos || sp2 == sp1 + 1)
+                return http_parse_result::error;
+            auto const version = line.substr(sp2 + 1);
+            if(version.size() != 8 || version.substr(0, 7) != "HTTP/1." ||
+               version[7] < '0' || version[7] > '9')
+                return http_parse_result::error;
+            req.method = line.substr(0, sp1);
+            req.target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+            req.minor_version = version[7] - '0';
+            req.header_count = 0;
+            bool keep_alive = req.minor_version != 0;
+            std::size_t content_length = 0;
+
+            for(head.remove_prefix(eol + 2); !head.empty();
+                head.remove_prefix(eol + 2))
+            {
+                eol = head.find("\r\n");
+                auto const field = head.substr(0, eol);
+                auto const colon = field.find(':');
+                // No name, or an obsolete line folding
+                if(colon == std::string_view::npos || colon == 0 ||
+                   field[0] == ' ' || field[0] == '\t' ||
+                   req.header_count == http_request::max_headers)
+                    return http_parse_result::error;
+                auto const name = field.substr(0, colon);
+                auto const value = _trim(field.substr(colon + 1));
+                req.headers[req.header_count++] = {name, value};
+                if(_iequals(name, "content-length"))
+                {
+                    auto const r = std::from_chars(
+                        value.data(), value.data() + value.size(),
+                        content_length);
+                    if(r.ec != std::errc{} ||
+                       r.ptr != value.data() + value.size() ||
+                       content_length >
+                           (std::numeric_limits<std::size_t>::max)() / 2)
+                        return http_parse_result::error;
+                }
+                else if(_iequals(name, "transfer-encoding"))
+                    return http_parse_result::error;
+                else if(_iequals(name, "connection"))
+                {
+                    if(_iequals(value, "close"))
+                        keep_alive = false;
+                    else if(_iequals(value, "keep-alive"))
+                        keep_alive = true;
+                }
+            }
+
+            auto const size = end + 4 + content_length;
+            if(data.size() < size)
+                return http_parse_result::incomplete;
+            req.keep_alive = keep_alive;
+            req.body = data.substr(end + 4, content_length);
+            consumed = size;
+            scanned_ = 0;
+            return http_parse_result::complete;
+        }
+    };
+
+    struct http_response
+    {
+        int status = 200;
+        std::string_view content_type = "text/plain";
+        std::vector<http_header> headers{};
+        std::string body{};
+    };
+
+    inline std::string_view _reason_phrase(int status) noexcept
+    {
+        switch(status)
+        {
+        case 200: return "OK";
+        case 201: return "Created";
+        case 204: return "No Content";
+        case 301: return "Moved Permanently";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 413: return "Payload Too Large";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 501: return "Not Implemented";
+        case 503: return "Service Unavailable";
+        default: return "Unknown";
+        }
+    }
+
+    inline void _append_number(std::string& out, std::size_t n)
+    {
+        char digits[24];
+        auto const r = std::to_chars(digits, digits + sizeof(digits), n);
+        out.append(digits, r.ptr);
+    }
+
+    inline void _serialize(
+        std::string& out, http_response const& res, bool keep_alive)
+    {
+        out += "HTTP/1.1 ";
+        _append_number(out, static_cast<std::size_t>(res.status));
+        out += ' ';
+        out += _reason_phrase(res.status);
+        out += "\r\nContent-Length: ";
+        _append_number(out, res.body.size());
+        if(!res.content_type.empty())
+        {
+            out += "\r\nContent-Type: ";
+            out += res.content_type;
+        }
+        if(!keep_alive)
+            out += "\r\nConnection: close";
+        for(auto const& h : res.headers)
+        {
+            out += "\r\n";
+            out += h.name;
+            out += ": ";
+            out += h.value;
+        }
+        out += "\r\n\r\n";
+        out += res.body;
+    }
+
+    // A minimal HTTP/1.1 server. Connections are kept alive, and pipelined
+    // requests are answered in order with one write per batch. handler is
+    // called as handler(http_request const&) and returns an http_response.
+    // The request's views point into the connection's read buffer, which
+    // comes from a pool shared by all connections, so a request is parsed
+    // without copying or allocating.
+    //
+    // async_run accepts connections and serves each of them concurrently,
+    // in the execution context of the token that async_run was given.
+    template<class Handler>
+    struct http_server
+    {
+        struct options
+        {
+            // Also the largest request that can be handled.
+            std::size_t buffer_size = 16 * 1024;
+            std::size_t max_pooled_buffers = 1024;
+        };
+
+    private:
+        using _tcp = std::experimental::net::ip::tcp;
+
+        struct _buffer_pool
+        {
+            std::size_t size_;
+            std::size_t max_;
+            std::mutex mtx_;
+            std::vector<std::unique_ptr<char[]>> free_;
+
+            std::unique_ptr<char[]> acquire()
+            {
+                {
+                    std::lock_guard<std::mutex> lock{mtx_};
+                    if(!free_.empty())
+                    {
+                        auto p = std::move(free_.back());
+                        free_.pop_back();
+                        return p;
+                    }
+                }
+                return std::unique_ptr<char[]>(new char[size_]);
+            }
+            void release(std::unique_ptr<char[]> p)
+            {
+                std::lock_guard<std::mutex> lock{mtx_};
+                if(free_.size() < max_)
+                    free_.push_back(std::move(p));
+            }
+        };
+
+        struct _pooled_buffer
+        {
+            _buffer_pool* pool_;
+            std::unique_ptr<char[]> p_;
+            ~_pooled_buffer()
+            {
+                pool_->release(std::move(p_));
+            }
+        };
+
+        std::experimental::net::io_context* ctx_;
+        _tcp::acceptor acceptor_;
+        std::experimental::net::steady_timer timer_;
+        Handler handler_;
+        options opts_;
+        _buffer_pool pool_;
+        std::atomic<bool> stopped_{false};
+
+    public:
+        http_server(std::experimental::net::io_context& ctx,
+                    _tcp::endpoint endpoint, Handler handler,
+                    options opts = {})
+          : ctx_(&ctx)
+          , acceptor_(ctx, endpoint)
+          , timer_(ctx)
+          , handler_(std::move(handler))
+          , opts_(opts)
+          , pool_{opts.buffer_size, opts.max_pooled_buffers, {}, {}}
+        {}
+        http_server(http_server&&) = delete;
+
+        _tcp::endpoint local_endpoint() const
+        {
+            return acceptor_.local_endpoint();
+        }
+
+        // Accept connections until close() is called.
+        CO_PP_template(class Token)(
+            requires CompletionToken<Token>)
+        auto async_run(Token token) -> result_t<Token, void()>
+        {
+            static_assert(!meta::is<Token, _implicit_yield_t>::value,
+                          "http_server::async_run needs an explicit token to "
+                          "serve connections with.");
+            INITIAL_SUSPEND(token);
+            _accept_backoff backoff;
+            while(!stopped_)
+            {
+                _tcp::socket socket{*ctx_};
+                std::error_code ec;
+                try
+                {
+                    co_await coronet::async_accept(acceptor_, socket);
+                }
+                catch(std::system_error const& e)
+                {
+                    ec = e.code();
+                }
+                if(ec)
+                {
+                    auto const delay = backoff.next(ec);
+                    if(delay.count() != 0 && !stopped_)
+                    {
+                        timer_.expires_after(delay);
+                        try
+                        {
+                            co_await coronet::async_wait(timer_);
+                        }
+                        catch(std::system_error const&)
+                        {
+                            // close() cancelled the wait.
+                        }
+                    }
+                    continue;
+                }
+                backoff.reset();
+                this->async_serve(
+                    std::move(socket),
+                    [](std::exception_ptr) {} |
+                        via(token.get_executor(), token.get_allocator()));
+            }
+        }
+
+        // Serve one connection until either side closes it.
+        CO_PP_template(class Token)(
+            requires CompletionToken<Token>)
+        auto async_serve(_tcp::socket socket, Token token)
+            -> result_t<Token, void(_tcp::socket)>
+        {
+            INITIAL_SUSPEND(token);
+            _pooled_buffer buf{&pool_, pool_.acquire()};
+            char* const data = buf.p_.get();
+            std::size_t const size = opts_.buffer_size;
+            std::size_t begin = 0, end = 0;
+            http_parser parser;
+            http_request req;
+            std::string out;
+            bool open = true;
+            try
+            {
+                while(open)
+                {
+                    end += co_await coronet::async_read_some(
+                        socket,
+                        std::experimental::net::buffer(
+                            data + end, size - end));
+                    for(std::size_t used = 0; open;)
+                    {
+                        auto const r = parser.parse(
+                            std::string_view(data + begin, end - begin), req,
+                            used);
+                        if(r == http_parse_result::incomplete)
+                            break;
+                        if(r == http_parse_result::error)
+                        {
+                            _serialize(out, http_response{400}, false);
+                            open = false;
+                            break;
+                        }
+                        _serialize(out, handler_(std::as_const(req)),
+                                   req.keep_alive);
+                        begin += used;
+                        open = req.keep_alive;
+                    }
+                    if(open && begin == 0 && end == size)
+                    {
+                        // If the headers fit, it is the body that does not.
+                        auto const headers_fit =
+                            std::string_view(data, end).find("\r\n\r\n") !=
+                            std::string_view::npos;
+                        _serialize(out, http_response{headers_fit ? 413 : 431},
+                                   false);
+                        open = false;
+                    }
+                    if(!out.empty())
+                    {
+                        co_await coronet::async_write(
+                            socket, std::experimental::net::buffer(out));
+                        out.clear();
+                    }
+                    // Move the start of the next request to the front.
+                    std::memmove(data, data + begin, end - begin);
+                    end -= begin;
+                    begin = 0;
+                }
+            }
+            catch(std::system_error const&)
+            {
+                // The peer closed or reset the connection.
+            }
+            std::error_code ec;
+            socket.close(ec);
+        }
+
+        // Stop accepting connections. Open connections are served until
+        // their clients close them.
+        void close()
+        {
+            stopped_ = true;
+            std::experimental::net::post(*ctx_, [this] {
+                std::error_code ec;
+                acceptor_.close(ec);
+                timer_.cancel();
+            });
+        }
+    };
+} // namespace coronet
+
+#endif
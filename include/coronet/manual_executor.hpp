@@ -0,0 +1,237 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+//
+#ifndef CORONET_MANUAL_EXECUTOR_HPP
+#define CORONET_MANUAL_EXECUTOR_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <optional>
+#include <queue>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include <coronet/coronet.hpp>
+
+namespace coronet
+{
+    // A work queue that runs only when told to, on the calling thread, with
+    // a virtual clock. Work runs in the order it was posted or, given a
+    // seed, in a random order that the seed determines, so a schedule that
+    // exposes a bug can be replayed exactly. Timers fire when the clock is
+    // advanced past them, never on their own.
+    //
+    // Nothing here is thread-safe: post only from the thread that drives
+    // the queue, or from the work it runs.
+    struct manual_executor
+    {
+        using duration = std::chrono::nanoseconds;
+        // Virtual time since the executor was created.
+        using time_point = duration;
+
+    private:
+        struct _timer
+        {
+            time_point due_;
+            std::uint64_t seq_;
+            std::function<void()> fun_;
+
+            friend bool operator>(_timer const& a, _timer const& b) noexcept
+            {
+                return a.due_ != b.due_ ? a.due_ > b.due_ : a.seq_ > b.seq_;
+            }
+        };
+
+        std::deque<std::function<void()>> ready_;
+        std::priority_queue<_timer, std::vector<_timer>, std::greater<>>
+            timers_;
+        std::optional<std::mt19937_64> rng_;
+        time_point now_{};
+        std::uint64_t seq_ = 0;
+        std::uint64_t executed_ = 0;
+
+        static manual_executor*& _current() noexcept
+        {
+            static thread_local manual_executor* cur = nullptr;
+            return cur;
+        }
+
+        void _fire_due_timers()
+        {
+            while(!timers_.empty() && timers_.top().due_ <= now_)
+            {
+                // priority_queue only hands out const references.
+                ready_.push_back(
+                    std::move(const_cast<_timer&>(timers_.top()).fun_));
+                timers_.pop();
+            }
+        }
+
+    public:
+        struct executor_type
+        {
+        private:
+            friend manual_executor;
+            manual_executor* ex_;
+            explicit executor_type(manual_executor* ex) noexcept
+              : ex_(ex)
+            {}
+
+        public:
+            CO_PP_template(class F, class A)(
+                requires Invocable<F&> && Allocator<A>)
+            void post(F fun, A const&) const
+            {
+                ex_->ready_.emplace_back(std::move(fun));
+            }
+            // Run fun once the virtual clock reaches due.
+            CO_PP_template(class F, class A)(
+                requires Invocable<F&> && Allocator<A>)
+            void post_at(time_point due, F fun, A const&) const
+            {
+                ex_->timers_.push({due, ex_->seq_++, std::move(fun)});
+            }
+            CO_PP_template(class F, class A)(
+                requires Invocable<F&> && Allocator<A>)
+            void post_after(duration delay, F fun, A const& a) const
+            {
+                post_at(ex_->now_ + delay, std::move(fun), a);
+            }
+            manual_executor& context() const noexcept
+            {
+                return *ex_;
+            }
+            friend bool operator==(executor_type a, executor_type b) noexcept
+            {
+                return a.ex_ == b.ex_;
+            }
+            friend bool operator!=(executor_type a, executor_type b) noexcept
+            {
+                return !(a == b);
+            }
+        };
+
+        // Run work in the order it was posted.
+        manual_executor() = default;
+        // Run whichever ready work the seeded generator picks.
+        explicit manual_executor(std::uint64_t seed)
+          : rng_(std::in_place, seed)
+        {}
+        manual_executor(manual_executor&&) = delete;
+
+        executor_type get_executor() noexcept
+        {
+            return executor_type{this};
+        }
+        time_point now() const noexcept
+        {
+            return now_;
+        }
+        // Work items run so far.
+        std::uint64_t executed() const noexcept
+        {
+            return executed_;
+        }
+        std::size_t ready() const noexcept
+        {
+            return ready_.size();
+        }
+        std::size_t pending_timers() const noexcept
+        {
+            return timers_.size();
+        }
+        // The executor whose work is running on this thread, if any.
+        static manual_executor* current() noexcept
+        {
+            return _current();
+        }
+
+        // Run one ready work item. Returns false if there was none.
+        bool step()
+        {
+            if(ready_.empty())
+                return false;
+            if(rng_ && ready_.size() > 1)
+            {
+                std::uniform_int_distribution<std::size_t> pick{
+                    0, ready_.size() - 1};
+                std::swap(ready_.front(), ready_[pick(*rng_)]);
+            }
+            auto fun = std::move(ready_.front());
+            ready_.pop_front();
+            ++executed_;
+            // Restored even if fun throws, so that the exception does not
+            // leave current() naming this executor.
+            struct _restore
+            {
+                manual_executor* outer_;
+                ~_restore()
+                {
+                    _current() = outer_;
+                }
+            } const restore{std::exchange(_current(), this)};
+            fun();
+            return true;
+        }
+        // Run ready work, including work it posts, until there is none.
+        // The clock does not move. Returns the number of items run.
+        std::size_t run_until_idle()
+        {
+            std::size_t n = 0;
+            while(step())
+                ++n;
+            return n;
+        }
+        // Move the clock forward by d, running the work that is ready and
+        // the timers that fall due along the way, in order.
+        std::size_t advance(duration d)
+        {
+            auto const until = now_ + d;
+            std::size_t n = run_until_idle();
+            while(!timers_.empty() && timers_.top().due_ <= until)
+            {
+                now_ = (std::max)(now_, timers_.top().due_);
+                _fire_due_timers();
+                n += run_until_idle();
+            }
+            now_ = until;
+            return n;
+        }
+        // Run until there is no ready work and no timer left, jumping the
+        // clock to each timer in turn.
+        std::size_t run()
+        {
+            std::size_t n = run_until_idle();
+            while(!timers_.empty())
+            {
+                now_ = (std::max)(now_, timers_.top().due_);
+                _fire_due_timers();
+                n += run_until_idle();
+            }
+            return n;
+        }
+        // Drop all queued work and timers without running them.
+        void clear()
+        {
+            ready_.clear();
+            timers_ = {};
+        }
+    };
+} // namespace coronet
+
+#endif
@@ -0,0 +1,467 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+//
+#ifndef CORONET_METRICS_HPP
+#define CORONET_METRICS_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <coronet/coronet.hpp>
+
+// Define as 0 to compile executor metrics out; snapshots then read zero.
+#ifndef CORONET_EXECUTOR_METRICS
+#define CORONET_EXECUTOR_METRICS 1
+#endif
+
+namespace coronet
+{
+    // A snapshot of an executor's counters. Counts are totals since the
+    // executor was created; rates come from comparing two snapshots.
+    // Post-to-run latency is sampled from one post in _metrics_sample_period
+    // per thread.
+    struct executor_metrics
+    {
+        std::uint64_t posted = 0;
+        std::uint64_t started = 0;
+        // Posted but not yet started.
+        std::uint64_t queue_depth = 0;
+        // Posted by a worker of one node to another node's queue.
+        std::uint64_t remote_posts = 0;
+        std::uint64_t wait_samples = 0;
+        std::chrono::nanoseconds total_wait{};
+        std::chrono::nanoseconds max_wait{};
+        // Summed over worker threads, for executors that own their threads.
+        std::chrono::nanoseconds idle_time{};
+        // Idle spells that ended, that is, times a worker was woken.
+        std::uint64_t wakeups = 0;
+        std::chrono::steady_clock::time_point taken_at{};
+
+        std::chrono::nanoseconds mean_wait() const noexcept
+        {
+            if(wait_samples == 0)
+                return {};
+            return total_wait / static_cast<std::int64_t>(wait_samples);
+        }
+        double posts_per_second(executor_metrics const& earlier) const
+            noexcept
+        {
+            std::chrono::duration<double> const t = taken_at - earlier.taken_at;
+            return t.count() > 0
+                ? static_cast<double>(posted - earlier.posted) / t.count()
+                : 0.0;
+        }
+    };
+
+    inline constexpr std::uint64_t _metrics_sample_period = 64;
+
+    // Carried by a work item from post to run. It holds the post time of
+    // sampled items, and nothing when metrics are compiled out.
+    struct _post_stamp
+    {
+#if CORONET_EXECUTOR_METRICS
+        std::chrono::steady_clock::time_point at_{};
+
+        explicit operator bool() const noexcept
+        {
+            return at_ != std::chrono::steady_clock::time_point{};
+        }
+#else
+        explicit operator bool() const noexcept
+        {
+            return false;
+        }
+#endif
+    };
+
+    inline std::size_t _metrics_thread_index() noexcept
+    {
+        static std::atomic<std::size_t> next{0};
+        static thread_local std::size_t const index = next++;
+        return index;
+    }
+
+    // One cache line of counters per thread. The first threads to touch
+    // the counters each own a slot, and update it with plain relaxed loads
+    // and stores; any later threads share the rest and pay for atomic
+    // adds. Readers add up the slots.
+    struct _executor_counters
+    {
+#if CORONET_EXECUTOR_METRICS
+    private:
+        struct alignas(64) _slot
+        {
+            std::atomic<std::uint64_t> posted_{0};
+            std::atomic<std::uint64_t> started_{0};
+            std::atomic<std::uint64_t> remote_{0};
+            std::atomic<std::uint64_t> stamped_{0};
+            std::atomic<std::uint64_t> samples_{0};
+            std::atomic<std::uint64_t> wait_ns_{0};
+            std::atomic<std::uint64_t> max_wait_ns_{0};
+            std::atomic<std::uint64_t> idle_ns_{0};
+            std::atomic<std::uint64_t> wakeups_{0};
+            // When an owning thread went idle, so that snapshots count an
+            // idle spell in progress; zero while it is busy.
+            std::atomic<std::uint64_t> idle_since_ns_{0};
+        };
+        std::vector<_slot> slots_;
+        std::size_t owned_;
+
+        struct _local_slot
+        {
+            _slot& slot_;
+            bool owned_;
+        };
+        _local_slot _local() noexcept
+        {
+            auto const i = _metrics_thread_index();
+            if(i < owned_)
+                return {slots_[i], true};
+            return {slots_[owned_ + i % (slots_.size() - owned_)], false};
+        }
+        static std::uint64_t _add(_local_slot s,
+                                  std::atomic<std::uint64_t> _slot::*c,
+                                  std::uint64_t n) noexcept
+        {
+            auto& a = s.slot_.*c;
+            if(!s.owned_)
+                return a.fetch_add(n, std::memory_order_relaxed);
+            auto const old = a.load(std::memory_order_relaxed);
+            a.store(old + n, std::memory_order_relaxed);
+            return old;
+        }
+        static std::uint64_t _ns(
+            std::chrono::steady_clock::duration d) noexcept
+        {
+            return static_cast<std::uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(d)
+                    .count());
+        }
+        static std::uint64_t _now_ns() noexcept
+        {
+            return _ns(std::chrono::steady_clock::now().time_since_epoch());
+        }
+
+    public:
+        _executor_counters()
+          : slots_((std::max)(64u, 4 * std::thread::hardware_concurrency()))
+          , owned_(slots_.size() - 8)
+        {}
+        _post_stamp on_post(std::size_t n = 1, bool remote = false) noexcept
+        {
+            auto const s = _local();
+            auto const before = _add(s, &_slot::posted_, n);
+            if(remote)
+                _add(s, &_slot::remote_, n);
+            if(before % _metrics_sample_period != 0)
+                return {};
+            _add(s, &_slot::stamped_, 1);
+            return {std::chrono::steady_clock::now()};
+        }
+        void on_start(_post_stamp stamp) noexcept
+        {
+            auto const s = _local();
+            _add(s, &_slot::started_, 1);
+            if(!stamp)
+                return;
+            auto const ns = _ns(std::chrono::steady_clock::now() - stamp.at_);
+            _add(s, &_slot::samples_, 1);
+            _add(s, &_slot::wait_ns_, ns);
+            auto& max_wait = s.slot_.max_wait_ns_;
+            auto max = max_wait.load(std::memory_order_relaxed);
+            while(ns > max &&
+                  !max_wait.compare_exchange_weak(
+                      max, ns, std::memory_order_relaxed))
+            {
+            }
+        }
+        std::uint64_t idle_begin() noexcept
+        {
+            auto const s = _local();
+            auto const now = _now_ns();
+            if(s.owned_)
+                s.slot_.idle_since_ns_.store(now, std::memory_order_relaxed);
+            return now;
+        }
+        void idle_end(std::uint64_t begin) noexcept
+        {
+            auto const s = _local();
+            _add(s, &_slot::idle_ns_, _now_ns() - begin);
+            _add(s, &_slot::wakeups_, 1);
+            if(s.owned_)
+                s.slot_.idle_since_ns_.store(0, std::memory_order_relaxed);
+        }
+        // With sampled_starts, only the starts of stamped items were
+        // counted, and the starts and queue depth are estimated from them.
+        executor_metrics snapshot(bool sampled_starts = false) const
+        {
+            executor_metrics m;
+            std::uint64_t stamped = 0, wait = 0, max = 0, idle = 0;
+            auto const now = _now_ns();
+            for(auto& s : slots_)
+            {
+                m.posted += s.posted_.load(std::memory_order_relaxed);
+                m.started += s.started_.load(std::memory_order_relaxed);
+                m.remote_posts += s.remote_.load(std::memory_order_relaxed);
+                stamped += s.stamped_.load(std::memory_order_relaxed);
+                m.wait_samples += s.samples_.load(std::memory_order_relaxed);
+                wait += s.wait_ns_.load(std::memory_order_relaxed);
+                max = (std::max)(
+                    max, s.max_wait_ns_.load(std::memory_order_relaxed));
+                idle += s.idle_ns_.load(std::memory_order_relaxed);
+                m.wakeups += s.wakeups_.load(std::memory_order_relaxed);
+                auto const since =
+                    s.idle_since_ns_.load(std::memory_order_relaxed);
+                if(since != 0 && since < now)
+                    idle += now - since;
+            }
+            if(sampled_starts)
+            {
+                auto const behind = stamped > m.started
+                    ? (stamped - m.started) * _metrics_sample_period
+                    : 0;
+                m.started = m.posted - (std::min)(behind, m.posted);
+            }
+            // The slots are read one at a time, so a start can be counted
+            // before its post.
+            m.queue_depth = m.posted > m.started ? m.posted - m.started : 0;
+            m.total_wait = std::chrono::nanoseconds(wait);
+            m.max_wait = std::chrono::nanoseconds(max);
+            m.idle_time = std::chrono::nanoseconds(idle);
+            m.taken_at = std::chrono::steady_clock::now();
+            return m;
+        }
+#else
+        _post_stamp on_post(std::size_t = 1, bool = false) noexcept
+        {
+            return {};
+        }
+        void on_start(_post_stamp) noexcept
+        {}
+        std::uint64_t idle_begin() noexcept
+        {
+            return 0;
+        }
+        void idle_end(std::uint64_t) noexcept
+        {}
+        executor_metrics snapshot(bool = false) const
+        {
+            executor_metrics m;
+            m.taken_at = std::chrono::steady_clock::now();
+            return m;
+        }
+#endif
+    };
+
+    template<class Executor>
+    struct instrumented_context;
+
+    // Forwards to Executor, counting the work that passes through.
+    template<class Executor>
+    struct instrumented_executor
+    {
+    private:
+        friend instrumented_context<Executor>;
+        Executor ex_;
+        _executor_counters* counters_;
+
+        instrumented_executor(Executor ex, _executor_counters* counters)
+          : ex_(std::move(ex))
+          , counters_(counters)
+        {}
+        // Only the work sampled for its wait is wrapped, to see it start;
+        // the rest goes through untouched.
+        template<class F>
+        auto _timed(F fun, _post_stamp stamp) const
+        {
+            return [fun = std::move(fun), counters = counters_,
+                    stamp]() mutable {
+                counters->on_start(stamp);
+                fun();
+            };
+        }
+
+    public:
+        Executor const& inner_executor() const noexcept
+        {
+            return ex_;
+        }
+        decltype(auto) context() const noexcept
+        {
+            return ex_.context();
+        }
+        void on_work_started() const noexcept
+        {
+            ex_.on_work_started();
+        }
+        void on_work_finished() const noexcept
+        {
+            ex_.on_work_finished();
+        }
+        CO_PP_template(class F, class A)(
+            requires Invocable<F&> && Allocator<A>)
+        void post(F fun, A const& a) const
+        {
+            if(auto const stamp = counters_->on_post())
+                ex_.post(_timed(std::move(fun), stamp), a);
+            else
+                ex_.post(std::move(fun), a);
+        }
+        CO_PP_template(class F, class A)(
+            requires Invocable<F&> && Allocator<A>)
+        void defer(F fun, A const& a) const
+        {
+            if(auto const stamp = counters_->on_post())
+                ex_.defer(_timed(std::move(fun), stamp), a);
+            else
+                ex_.defer(std::move(fun), a);
+        }
+        CO_PP_template(class F, class A)(
+            requires Invocable<F&> && Allocator<A>)
+        void dispatch(F fun, A const& a) const
+        {
+            if(auto const stamp = counters_->on_post())
+                ex_.dispatch(_timed(std::move(fun), stamp), a);
+            else
+                ex_.dispatch(std::move(fun), a);
+        }
+        friend bool operator==(instrumented_executor const& a,
+                               instrumented_executor const& b) noexcept
+        {
+            return a.counters_ == b.counters_ && a.ex_ == b.ex_;
+        }
+        friend bool operator!=(instrumented_executor const& a,
+                               instrumented_executor const& b) noexcept
+        {
+            return !(a == b);
+        }
+    };
+
+    // Counts the work posted through its executors to an executor that
+    // keeps no metrics of its own, such as an io_context's or a strand.
+    // Idle time is not visible from outside, so it reads zero. Only the
+    // sampled work is seen to start, so the start count and queue depth
+    // are estimated from it, to within a sample period per thread.
+    template<class Executor>
+    struct instrumented_context
+    {
+    private:
+        Executor ex_;
+        std::unique_ptr<_executor_counters> counters_;
+
+    public:
+        explicit instrumented_context(Executor ex)
+          : ex_(std::move(ex))
+          , counters_(std::make_unique<_executor_counters>())
+        {}
+        instrumented_executor<Executor> get_executor() const noexcept
+        {
+            return {ex_, counters_.get()};
+        }
+        executor_metrics metrics() const
+        {
+            return counters_->snapshot(true);
+        }
+    };
+
+    // One line per report: the queue depth, the post rate and mean wait
+    // since the earlier snapshot, the worst wait so far, posts that left
+    // their node, how many workers were idle on average, and how often
+    // they were woken.
+    inline void print_metrics(std::FILE* out, std::string const& name,
+                              executor_metrics const& now,
+                              executor_metrics const& earlier)
+    {
+        using us = std::chrono::duration<double, std::micro>;
+        using seconds = std::chrono::duration<double>;
+        auto const samples = now.wait_samples - earlier.wait_samples;
+        auto const wait = us(now.total_wait - earlier.total_wait).count();
+        auto const idle = seconds(now.idle_time - earlier.idle_time).count();
+        auto const t = seconds(now.taken_at - earlier.taken_at).count();
+        std::fprintf(
+            out,
+            "%s: depth %llu, %.0f posts/s, wait %.1f us mean %.1f us max, "
+            "%llu remote, %.1f idle, %llu wakeups\n",
+            name.c_str(), static_cast<unsigned long long>(now.queue_depth),
+            now.posts_per_second(earlier),
+            samples ? wait / static_cast<double>(samples) : 0.0,
+            us(now.max_wait).count(),
+            static_cast<unsigned long long>(
+                now.remote_posts - earlier.remote_posts),
+            t > 0 ? idle / t : 0.0,
+            static_cast<unsigned long long>(now.wakeups - earlier.wakeups));
+    }
+
+    // Takes a snapshot from source every period on a thread of its own,
+    // and hands it to sink along with the previous one. The default sink
+    // prints to stderr.
+    struct metrics_reporter
+    {
+        using source_type = std::function<executor_metrics()>;
+        using sink_type = std::function<void(
+            executor_metrics const& now, executor_metrics const& earlier)>;
+
+    private:
+        std::mutex mtx_;
+        std::condition_variable cv_;
+        bool stop_ = false;
+        std::thread thread_;
+
+    public:
+        metrics_reporter(std::string name, std::chrono::milliseconds period,
+                         source_type source, sink_type sink = {})
+        {
+            if(!sink)
+                sink = [name = std::move(name)](auto const& now,
+                                                auto const& earlier) {
+                    print_metrics(stderr, name, now, earlier);
+                };
+            thread_ = std::thread{[this, period, source = std::move(source),
+                                   sink = std::move(sink)] {
+                auto earlier = source();
+                std::unique_lock<std::mutex> lock{mtx_};
+                while(!cv_.wait_for(lock, period, [this] { return stop_; }))
+                {
+                    lock.unlock();
+                    auto now = source();
+                    sink(now, earlier);
+                    earlier = std::move(now);
+                    lock.lock();
+                }
+            }};
+        }
+        metrics_reporter(metrics_reporter&&) = delete;
+        ~metrics_reporter()
+        {
+            {
+                std::lock_guard<std::mutex> lock{mtx_};
+                stop_ = true;
+            }
+            cv_.notify_one();
+            thread_.join();
+        }
+    };
+} // namespace coronet
+
+#endif
@@ -0,0 +1,369 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+//
+#ifndef CORONET_MULTIPLEXED_CLIENT_HPP
+#define CORONET_MULTIPLEXED_CLIENT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <experimental/buffer>
+#include <experimental/coroutine>
+#include <experimental/internet>
+#include <experimental/io_context>
+
+#include <coronet/coronet.hpp>
+#include <coronet/detail/waiter.hpp>
+#include <coronet/net.hpp>
+#include <coronet/synchronization.hpp>
+
+namespace coronet
+{
+    // Many concurrent request/response calls over one stream connection.
+    // Each call is sent as a frame with a fresh ID, and the peer answers
+    // with a frame carrying the same ID, in any order. A frame is a 4-byte
+    // payload length and an 8-byte ID, both big-endian, then the payload.
+    //
+    // Requests that are issued while a write is in progress are gathered
+    // into the next write, so a burst of calls costs a few large writes.
+    // The caller that finds no write in progress does the writing. One
+    // reader, async_run, dispatches replies to their callers through an
+    // open-addressed table indexed by ID. The bookkeeping for a call lives
+    // in the caller's coroutine frame, so a call allocates nothing beyond
+    // its request and reply strings.
+    //
+    // At most max_in_flight calls are outstanding at once; further calls
+    // wait for a free slot. When the connection fails or is closed, every
+    // outstanding and future call fails with a std::system_error.
+    template<class Protocol = std::experimental::net::ip::tcp>
+    struct multiplexed_client
+    {
+        using socket_type = typename Protocol::socket;
+
+        struct options
+        {
+            std::size_t max_in_flight = 1024;
+            std::size_t max_frame_size = 16 * 1024 * 1024;
+            std::size_t read_buffer_size = 64 * 1024;
+        };
+
+        static constexpr std::size_t header_size = 12;
+
+    private:
+        struct _call : _waiter
+        {
+            std::uint64_t id_ = 0;
+            std::string reply_{};
+            std::error_code ec_{};
+            bool done_ = false;
+        };
+
+        struct _reply_awaitable
+        {
+            multiplexed_client* client_;
+            _call* call_;
+
+            static constexpr bool await_ready() noexcept
+            {
+                return false;
+            }
+            template<class Promise>
+            bool await_suspend(
+                std::experimental::coroutine_handle<Promise> awaiter)
+            {
+                std::lock_guard<std::mutex> lock{client_->mtx_};
+                if(call_->done_)
+                    return false;
+                call_->set_coroutine(awaiter);
+                return true;
+            }
+            std::string await_resume()
+            {
+                if(call_->ec_)
+                    throw std::system_error(call_->ec_);
+                return std::move(call_->reply_);
+            }
+        };
+
+        struct _slot_guard
+        {
+            async_semaphore* slots_;
+            ~_slot_guard()
+            {
+                slots_->release();
+            }
+        };
+
+        socket_type socket_;
+        options opts_;
+        async_semaphore slots_;
+        std::mutex mtx_;
+        // Guarded by mtx_:
+        std::vector<_call*> table_;
+        std::uint64_t next_id_ = 0;
+        std::string pending_;
+        bool writing_ = false;
+        std::error_code failed_{};
+
+        static void _put(char* p, std::uint64_t v, std::size_t n) noexcept
+        {
+            for(std::size_t i = n; i != 0; --i, v >>= 8)
+                p[i - 1] = static_cast<char>(v & 0xff);
+        }
+        static std::uint64_t _get(char const* p, std::size_t n) noexcept
+        {
+            std::uint64_t v = 0;
+            for(std::size_t i = 0; i != n; ++i)
+                v = (v << 8) | static_cast<unsigned char>(p[i]);
+            return v;
+        }
+
+        std::size_t _mask() const noexcept
+        {
+            return table_.size() - 1;
+        }
+        // IDs are handed out in order and at most max_in_flight of them
+        // are live, so the table is at most half full and the low bits of
+        // an ID are nearly always its slot.
+        void _insert(_call* c) noexcept
+        {
+            auto i = c->id_ & _mask();
+            while(table_[i])
+                i = (i + 1) & _mask();
+            table_[i] = c;
+        }
+        _call* _erase(std::uint64_t id) noexcept
+        {
+            auto i = id & _mask();
+            for(; table_[i]; i = (i + 1) & _mask())
+                if(table_[i]->id_ == id)
+                    break;
+            _call* c = std::exchange(table_[i], nullptr);
+            if(!c)
+                return nullptr;
+            // Shift the rest of the probe run back so lookups still find
+            // every entry.
+            for(auto j = (i + 1) & _mask(); table_[j]; j = (j + 1) & _mask())
+            {
+                auto k = table_[j]->id_ & _mask();
+                if(((j - k) & _mask()) >= ((j - i) & _mask()))
+                {
+                    table_[i] = std::exchange(table_[j], nullptr);
+                    i = j;
+                }
+            }
+            return c;
+        }
+
+        // Register a call and queue its request. Returns true if the caller
+        // must write out the queued requests.
+        bool _enqueue(_call& c, std::string_view request)
+        {
+            if(request.size() > opts_.max_frame_size)
+                throw std::system_error(
+                    std::make_error_code(std::errc::message_size));
+            std::lock_guard<std::mutex> lock{mtx_};
+            if(failed_)
+                throw std::system_error(failed_);
+            c.id_ = next_id_++;
+            _insert(&c);
+            char header[header_size];
+            _put(header, request.size(), 4);
+            _put(header + 4, c.id_, 8);
+            pending_.append(header, header_size);
+            pending_.append(request.data(), request.size());
+            return !std::exchange(writing_, true);
+        }
+
+        // Swap the queued requests into out, or give up the writer's role
+        // if there are none.
+        bool _take_pending(std::string& out)
+        {
+            std::lock_guard<std::mutex> lock{mtx_};
+            out.clear();
+            if(pending_.empty() || failed_)
+                return writing_ = false;
+            out.swap(pending_);
+            return true;
+        }
+
+        void _complete(std::uint64_t id, std::string reply)
+        {
+            std::unique_lock<std::mutex> lock{mtx_};
+            _call* c = _erase(id);
+            if(!c)
+                return; // Not ours; ignore it.
+            c->reply_ = std::move(reply);
+            c->done_ = true;
+            bool const waiting = c->coro_ != nullptr;
+            lock.unlock();
+            if(waiting)
+                c->resume();
+        }
+
+        void _fail(std::error_code ec)
+        {
+            _waiter_queue woken;
+            {
+                std::lock_guard<std::mutex> lock{mtx_};
+                if(!failed_)
+                    failed_ = ec;
+                for(auto& c : table_)
+                {
+                    if(!c)
+                        continue;
+                    c->ec_ = failed_;
+                    c->done_ = true;
+                    if(c->coro_)
+                        woken.push(c);
+                    c = nullptr;
+                }
+                pending_.clear();
+            }
+            _resume_all(woken.take_all());
+        }
+
+    public:
+        explicit multiplexed_client(socket_type socket, options opts = {})
+          : socket_(std::move(socket))
+          , opts_(opts)
+          , slots_(static_cast<std::ptrdiff_t>(opts.max_in_flight))
+        {
+            std::size_t n = 2;
+            while(n < 2 * opts_.max_in_flight)
+                n *= 2;
+            table_.resize(n);
+        }
+        multiplexed_client(multiplexed_client&&) = delete;
+
+        socket_type& socket() noexcept
+        {
+            return socket_;
+        }
+
+        // Send request and complete with the peer's reply to it.
+        CO_PP_template(class Token)(
+            requires CompletionToken<Token>)
+        auto async_call(std::string request, Token token)
+            -> result_t<Token, std::string(std::string)>
+        {
+            INITIAL_SUSPEND(token);
+            co_await slots_.async_acquire();
+            _slot_guard guard{&slots_};
+            _call c;
+            if(_enqueue(c, request))
+            {
+                std::string out;
+                while(_take_pending(out))
+                {
+                    try
+                    {
+                        co_await coronet::async_write(
+                            socket_, std::experimental::net::buffer(out));
+                    }
+                    catch(std::system_error const& e)
+                    {
+                        _fail(e.code());
+                    }
+                }
+            }
+            co_return co_await _reply_awaitable{this, &c};
+        }
+        auto async_call(std::string request)
+        {
+            return callable_with_implicit_context{
+                [this, request = std::move(request)](auto token) mutable {
+                    return this->async_call(std::move(request), token);
+                }};
+        }
+
+        // Read replies and hand them to their callers until the connection
+        // fails or is closed. Run exactly one of these per client.
+        CO_PP_template(class Token)(
+            requires CompletionToken<Token>)
+        auto async_run(Token token) -> result_t<Token, void()>
+        {
+            INITIAL_SUSPEND(token);
+            std::vector<char> buf(
+                opts_.read_buffer_size < 2 * header_size
+                    ? 2 * header_size
+                    : opts_.read_buffer_size);
+            std::size_t begin = 0, end = 0;
+            try
+            {
+                for(;;)
+                {
+                    std::size_t need = header_size;
+                    while(end - begin >= header_size)
+                    {
+                        auto const size = _get(&buf[begin], 4);
+                        if(size > opts_.max_frame_size)
+                            throw std::system_error(
+                                std::make_error_code(std::errc::message_size));
+                        need = header_size + size;
+                        if(end - begin < need)
+                            break;
+                        _complete(
+                            _get(&buf[begin + 4], 8),
+                            std::string(&buf[begin + header_size], size));
+                        begin += need;
+                        need = header_size;
+                    }
+                    if(begin == end)
+                        begin = end = 0;
+                    else if(begin + need > buf.size())
+                    {
+                        std::memmove(buf.data(), &buf[begin], end - begin);
+                        end -= begin;
+                        begin = 0;
+                    }
+                    if(need > buf.size())
+                        buf.resize(need);
+                    end += co_await coronet::async_read_some(
+                        socket_,
+                        std::experimental::net::buffer(
+                            &buf[end], buf.size() - end));
+                }
+            }
+            catch(std::system_error const& e)
+            {
+                _fail(e.code());
+            }
+        }
+        auto async_run()
+        {
+            return callable_with_implicit_context{
+                [this](auto token) { return this->async_run(token); }};
+        }
+
+        // Close the connection. Outstanding calls fail, and async_run
+        // completes.
+        void close()
+        {
+            _fail(std::make_error_code(std::errc::operation_canceled));
+            std::experimental::net::post(socket_.get_executor(), [this] {
+                std::error_code ec;
+                socket_.close(ec);
+            });
+        }
+    };
+} // namespace coronet
+
+#endif
@@ -0,0 +1,430 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+//
+#ifndef CORONET_NET_HPP
+#define CORONET_NET_HPP
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <tuple>
+#include <utility>
+
+#include <experimental/buffer>
+#include <experimental/coroutine>
+#include <experimental/internet>
+#include <experimental/socket>
+#include <experimental/timer>
+
+#include <unistd.h>
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#endif
+
+#include <coronet/coronet.hpp>
+#include <coronet/detail/scan.hpp>
+#include <coronet/detail/waiter.hpp>
+
+namespace coronet
+{
+    // Awaits a Networking TS asynchronous operation from inside a coronet
+    // coroutine. init_ is called with a completion handler, which it passes
+    // to the operation. When the operation completes, the coroutine is
+    // resumed in its own execution context, and a non-zero error code is
+    // thrown as a std::system_error.
+    template<class Init, class... Results>
+    struct _net_op
+    {
+        Init init_;
+        std::error_code ec_{};
+        std::tuple<Results...> results_{};
+        void* coro_ = nullptr;
+        void (*resume_)(void*) = nullptr;
+
+        static constexpr bool await_ready() noexcept
+        {
+            return false;
+        }
+        template<class Promise>
+        void await_suspend(std::experimental::coroutine_handle<Promise> awaiter)
+        {
+            coro_ = awaiter.address();
+            resume_ = &_resume_in_context<Promise>;
+            init_([this](std::error_code ec, Results... results) {
+                ec_ = ec;
+                results_ = std::tuple<Results...>{std::move(results)...};
+                resume_(coro_);
+            });
+        }
+        auto await_resume()
+        {
+            if(ec_)
+                throw std::system_error(ec_);
+            if constexpr(sizeof...(Results) == 1)
+                return std::get<0>(std::move(results_));
+            else if constexpr(sizeof...(Results) != 0)
+                return std::make_from_tuple<completion<Results...>>(
+                    std::move(results_));
+        }
+    };
+
+    template<class... Results, class Init>
+    _net_op<Init, Results...> _make_net_op(Init init)
+    {
+        return {std::move(init)};
+    }
+
+    CO_PP_template(class Socket, class Endpoint, class Token)(
+        requires CompletionToken<Token>)
+    auto async_connect(Socket& socket, Endpoint endpoint, Token token)
+        -> result_t<Token, void(Socket&, Endpoint)>
+    {
+        INITIAL_SUSPEND(token);
+        co_await _make_net_op([&](auto handler) {
+            socket.async_connect(endpoint, std::move(handler));
+        });
+    }
+    template<class Socket, class Endpoint>
+    auto async_connect(Socket& socket, Endpoint endpoint)
+    {
+        return callable_with_implicit_context{
+            [&socket, endpoint](auto token) {
+                return coronet::async_connect(socket, endpoint, token);
+            }};
+    }
+
+    CO_PP_template(class Acceptor, class Socket, class Token)(
+        requires CompletionToken<Token>)
+    auto async_accept(Acceptor& acceptor, Socket& socket, Token token)
+        -> result_t<Token, void(Acceptor&, Socket&)>
+    {
+        INITIAL_SUSPEND(token);
+        co_await _make_net_op([&](auto handler) {
+            acceptor.async_accept(socket, std::move(handler));
+        });
+    }
+    template<class Acceptor, class Socket>
+    auto async_accept(Acceptor& acceptor, Socket& socket)
+    {
+        return callable_with_implicit_context{
+            [&acceptor, &socket](auto token) {
+                return coronet::async_accept(acceptor, socket, token);
+            }};
+    }
+
+    // How long an accept loop waits after a failed accept. A failure that
+    // concerns only the connection being accepted is retried at once. Any
+    // other, such as running out of file descriptors, persists until
+    // something else changes, so the wait doubles from 1ms up to 1s. A
+    // successful accept resets it.
+    struct _accept_backoff
+    {
+        std::chrono::milliseconds delay_{0};
+
+        std::chrono::milliseconds next(std::error_code const& ec) noexcept
+        {
+            if(ec == std::errc::connection_aborted ||
+               ec == std::errc::interrupted)
+                return std::chrono::milliseconds{0};
+            delay_ = (std::clamp)(delay_ * 2, std::chrono::milliseconds{1},
+                                  std::chrono::milliseconds{1000});
+            return delay_;
+        }
+        void reset() noexcept
+        {
+            delay_ = std::chrono::milliseconds{0};
+        }
+    };
+
+    // Completes with the number of bytes read, which is never zero. End of
+    // stream is reported as an error.
+    CO_PP_template(class Socket, class Buffer, class Token)(
+        requires CompletionToken<Token>)
+    auto async_read_some(Socket& socket, Buffer buffer, Token token)
+        -> result_t<Token, std::size_t(Socket&, Buffer)>
+    {
+        INITIAL_SUSPEND(token);
+        co_return co_await _make_net_op<std::size_t>([&](auto handler) {
+            socket.async_read_some(buffer, std::move(handler));
+        });
+    }
+    template<class Socket, class Buffer>
+    auto async_read_some(Socket& socket, Buffer buffer)
+    {
+        return callable_with_implicit_context{
+            [&socket, buffer](auto token) {
+                return coronet::async_read_some(socket, buffer, token);
+            }};
+    }
+
+    // Reads into buffer until it contains delimiter, then completes with the
+    // size of the data up to and including the first delimiter. Whatever
+    // follows the delimiter stays in buffer for the next call. Each read
+    // scans only the new bytes, plus the few before them that could start
+    // a delimiter. The delimiter must outlive the operation.
+    CO_PP_template(class Socket, class Token)(
+        requires CompletionToken<Token>)
+    auto async_read_until(Socket& socket, std::string& buffer,
+                          std::string_view delimiter, Token token)
+        -> result_t<Token,
+                    std::size_t(Socket&, std::string&, std::string_view)>
+    {
+        INITIAL_SUSPEND(token);
+        std::size_t scanned = 0;
+        for(;;)
+        {
+            auto const* const data = buffer.data();
+            auto const* const last = data + buffer.size();
+            auto const* const p =
+                _find_delimiter(data + scanned, last, delimiter);
+            if(p != last)
+                co_return static_cast<std::size_t>(p - data) +
+                    delimiter.size();
+            auto const size = buffer.size();
+            if(size >= delimiter.size())
+                scanned = size - delimiter.size() + 1;
+            buffer.resize((std::max)(size + 4096, buffer.capacity()));
+            std::size_t n = 0;
+            try
+            {
+                n = co_await _make_net_op<std::size_t>([&](auto handler) {
+                    socket.async_read_some(
+                        std::experimental::net::buffer(
+                            &buffer[size], buffer.size() - size),
+                        std::move(handler));
+                });
+            }
+            catch(...)
+            {
+                // Leave only the data that was read.
+                buffer.resize(size);
+                throw;
+            }
+            buffer.resize(size + n);
+        }
+    }
+    template<class Socket>
+    auto async_read_until(
+        Socket& socket, std::string& buffer, std::string_view delimiter)
+    {
+        return callable_with_implicit_context{
+            [&socket, &buffer, delimiter](auto token) {
+                return coronet::async_read_until(
+                    socket, buffer, delimiter, token);
+            }};
+    }
+
+    // Writes all of buffer before completing with its size.
+    CO_PP_template(class Socket, class Buffer, class Token)(
+        requires CompletionToken<Token>)
+    auto async_write(Socket& socket, Buffer buffer, Token token)
+        -> result_t<Token, std::size_t(Socket&, Buffer)>
+    {
+        INITIAL_SUSPEND(token);
+        std::size_t const size = buffer.size();
+        while(buffer.size() != 0)
+            buffer += co_await _make_net_op<std::size_t>([&](auto handler) {
+                socket.async_write_some(buffer, std::move(handler));
+            });
+        co_return size;
+    }
+    template<class Socket, class Buffer>
+    auto async_write(Socket& socket, Buffer buffer)
+    {
+        return callable_with_implicit_context{
+            [&socket, buffer](auto token) {
+                return coronet::async_write(socket, buffer, token);
+            }};
+    }
+
+    // Closes both ends of a pipe on destruction.
+    struct _pipe
+    {
+        int fds_[2] = {-1, -1};
+
+        _pipe() = default;
+        _pipe(_pipe&&) = delete;
+        ~_pipe()
+        {
+            for(int fd : fds_)
+                if(fd != -1)
+                    ::close(fd);
+        }
+        void open()
+        {
+#if defined(__linux__)
+            if(::pipe2(fds_, O_CLOEXEC) != 0)
+#else
+            if(::pipe(fds_) != 0)
+#endif
+                throw std::system_error(errno, std::system_category());
+        }
+    };
+
+    // Puts a socket in non-blocking mode for as long as it lives.
+    template<class Socket>
+    struct _non_blocking_scope
+    {
+        Socket& socket_;
+        bool const was_;
+
+        explicit _non_blocking_scope(Socket& socket)
+          : socket_(socket), was_(socket.native_non_blocking())
+        {
+            if(!was_)
+                socket_.native_non_blocking(true);
+        }
+        _non_blocking_scope(_non_blocking_scope&&) = delete;
+        ~_non_blocking_scope()
+        {
+            if(!was_)
+            {
+                std::error_code ec;
+                socket_.native_non_blocking(false, ec);
+            }
+        }
+    };
+
+    // Sends size bytes of the file fd, starting at offset, on a connected
+    // stream socket, then completes with the number of bytes sent, which is
+    // less than size only if the file ends first. On Linux the kernel
+    // copies the data with sendfile, or with splice through a pipe for a
+    // file that sendfile refuses; elsewhere it is read into a buffer and
+    // written. Whenever the socket's send buffer fills up, the coroutine
+    // waits for it to drain and resumes in its own execution context. The
+    // file position of fd is neither used nor changed.
+    CO_PP_template(class Socket, class Token)(
+        requires CompletionToken<Token>)
+    auto async_send_file(Socket& socket, int fd, std::uint64_t offset,
+                         std::size_t size, Token token)
+        -> result_t<Token,
+                    std::size_t(Socket&, int, std::uint64_t, std::size_t)>
+    {
+        INITIAL_SUSPEND(token);
+        _non_blocking_scope<Socket> const non_blocking{socket};
+        auto const writable = [&socket] {
+            return _make_net_op([&socket](auto handler) {
+                socket.async_wait(Socket::wait_write, std::move(handler));
+            });
+        };
+        int const out = socket.native_handle();
+        std::size_t sent = 0;
+#if defined(__linux__)
+        _pipe pipe;
+        std::size_t piped = 0; // Spliced into the pipe but not yet sent.
+        while(sent < size)
+        {
+            ::ssize_t n;
+            if(pipe.fds_[0] == -1)
+            {
+                auto off = static_cast<::off_t>(offset + sent);
+                n = ::sendfile(out, fd, &off, size - sent);
+                if(n < 0 && sent == 0 && (errno == EINVAL || errno == ENOSYS))
+                {
+                    pipe.open();
+                    continue;
+                }
+            }
+            else
+            {
+                if(piped == 0)
+                {
+                    auto off = static_cast<::loff_t>(offset + sent);
+                    n = ::splice(fd, &off, pipe.fds_[1], nullptr,
+                                 (std::min)(size - sent, std::size_t(1) << 16),
+                                 SPLICE_F_MOVE);
+                    if(n == 0)
+                        break;
+                    if(n < 0)
+                        throw std::system_error(errno, std::system_category());
+                    piped = static_cast<std::size_t>(n);
+                }
+                n = ::splice(pipe.fds_[0], nullptr, out, nullptr, piped,
+                             SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+                if(n > 0)
+                    piped -= static_cast<std::size_t>(n);
+            }
+            if(n > 0)
+                sent += static_cast<std::size_t>(n);
+            else if(n == 0)
+                break;
+            else if(errno == EAGAIN || errno == EWOULDBLOCK)
+                co_await writable();
+            else if(errno != EINTR)
+                throw std::system_error(errno, std::system_category());
+        }
+#else
+        char buffer[1 << 14];
+        while(sent < size)
+        {
+            auto const n = ::pread(
+                fd, buffer, (std::min)(size - sent, sizeof(buffer)),
+                static_cast<::off_t>(offset + sent));
+            if(n == 0)
+                break;
+            if(n < 0)
+            {
+                if(errno == EINTR)
+                    continue;
+                throw std::system_error(errno, std::system_category());
+            }
+            auto data = std::experimental::net::buffer(
+                buffer, static_cast<std::size_t>(n));
+            while(data.size() != 0)
+                data += co_await _make_net_op<std::size_t>([&](auto handler) {
+                    socket.async_write_some(data, std::move(handler));
+                });
+            sent += static_cast<std::size_t>(n);
+        }
+        (void)writable;
+        (void)out;
+#endif
+        co_return sent;
+    }
+    template<class Socket>
+    auto async_send_file(
+        Socket& socket, int fd, std::uint64_t offset, std::size_t size)
+    {
+        return callable_with_implicit_context{
+            [&socket, fd, offset, size](auto token) {
+                return coronet::async_send_file(
+                    socket, fd, offset, size, token);
+            }};
+    }
+
+    // Waits for the timer to expire. Cancelling the timer completes the
+    // wait with std::errc::operation_canceled.
+    CO_PP_template(class Timer, class Token)(
+        requires CompletionToken<Token>)
+    auto async_wait(Timer& timer, Token token) -> result_t<Token, void(Timer&)>
+    {
+        INITIAL_SUSPEND(token);
+        co_await _make_net_op(
+            [&](auto handler) { timer.async_wait(std::move(handler)); });
+    }
+    template<class Timer>
+    auto async_wait(Timer& timer)
+    {
+        return callable_with_implicit_context{[&timer](auto token) {
+            return coronet::async_wait(timer, token);
+        }};
+    }
+} // namespace coronet
+
+#endif
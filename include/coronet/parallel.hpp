@@ -0,0 +1,346 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+//
+#ifndef CORONET_PARALLEL_HPP
+#define CORONET_PARALLEL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <experimental/coroutine>
+
+#include <coronet/coronet.hpp>
+#include <coronet/detail/waiter.hpp>
+
+namespace coronet
+{
+    // How a loop of n elements is split: the first `done` elements have
+    // already been run inline, and the rest go in `count` chunks of `size`
+    // elements, the last one possibly shorter. `error` is the first
+    // exception that an element run inline threw.
+    struct _chunk_plan
+    {
+        std::size_t done = 0;
+        std::size_t size = 0;
+        std::size_t count = 0;
+        std::exception_ptr error{};
+    };
+
+    // Run elements inline, timing them in doubling batches, for long enough
+    // to estimate their cost. An element that throws does not end the
+    // probe; the exception is kept in the plan, to be rethrown once the
+    // chunks have run. A loop that ends within the probe never leaves the
+    // calling thread. Otherwise the remaining elements are cut
+    // into chunks that each take about _chunk_time, so that each post is
+    // worth its overhead, but no more than four per hardware thread, so
+    // that the posts stay few however cheap the elements are.
+    template<class RunOne>
+    _chunk_plan _plan_chunks(std::size_t n, RunOne&& run_one)
+    {
+        using clock_type = std::chrono::steady_clock;
+        constexpr std::chrono::nanoseconds _probe_time{5000};
+        constexpr std::chrono::nanoseconds _chunk_time{50000};
+        auto const t0 = clock_type::now();
+        std::chrono::nanoseconds elapsed{};
+        std::exception_ptr error;
+        std::size_t i = 0;
+        for(std::size_t batch = 1; i != n && elapsed < _probe_time;
+            batch *= 2)
+        {
+            for(auto const end = (std::min)(n, i + batch); i != end; ++i)
+            {
+                try
+                {
+                    run_one(i);
+                }
+                catch(...)
+                {
+                    if(!error)
+                        error = std::current_exception();
+                }
+            }
+            elapsed = clock_type::now() - t0;
+        }
+        _chunk_plan plan{i};
+        plan.error = std::move(error);
+        auto const rest = n - i;
+        if(rest == 0)
+            return plan;
+        auto const per = (std::max)(std::chrono::nanoseconds::rep(1),
+                                    elapsed.count() / std::ptrdiff_t(i));
+        plan.size = (std::max)(
+            std::size_t(1),
+            static_cast<std::size_t>(_chunk_time.count() / per));
+        auto const most = (std::max)(
+            std::size_t(1),
+            std::size_t(4) * std::thread::hardware_concurrency());
+        plan.count = (std::min)((rest + plan.size - 1) / plan.size, most);
+        plan.size = (rest + plan.count - 1) / plan.count;
+        plan.count = (rest + plan.size - 1) / plan.size;
+        return plan;
+    }
+
+    // A detached coroutine that starts suspended, so that it can be posted,
+    // and destroys itself when it completes.
+    struct _chunk_coro
+    {
+        struct promise_type
+        {
+            _chunk_coro get_return_object() noexcept
+            {
+                return _chunk_coro{std::experimental::coroutine_handle<
+                    promise_type>::from_promise(*this)};
+            }
+            std::experimental::suspend_always initial_suspend() const noexcept
+            {
+                return {};
+            }
+            std::experimental::suspend_never final_suspend() const noexcept
+            {
+                return {};
+            }
+            [[noreturn]] void unhandled_exception() noexcept
+            {
+                // Chunk bodies catch their own exceptions.
+                std::terminate();
+            }
+            void return_void() noexcept {}
+        };
+        std::experimental::coroutine_handle<promise_type> coro_;
+    };
+
+    // Awaiting this runs body(i) for each chunk i in [0, count) on the
+    // awaiting coroutine's executor, all posted at once, and resumes the
+    // coroutine in its own context when the last chunk is done. The body
+    // must not throw. If the chunks cannot all be posted, the ones that
+    // were still run to the end before the posting error is rethrown.
+    struct _fork_join : _waiter
+    {
+        void (*run_)(void*, std::size_t);
+        void* body_;
+        std::size_t count_;
+        std::atomic<std::size_t> pending_{0};
+        std::exception_ptr eptr_{};
+
+        template<class Body>
+        _fork_join(Body& body, std::size_t count) noexcept
+          : run_([](void* b, std::size_t i) { (*static_cast<Body*>(b))(i); })
+          , body_(&body)
+          , count_(count)
+        {}
+        // Moved only on its way into co_await, before anything is pending.
+        _fork_join(_fork_join&& that) noexcept
+          : _waiter(that)
+          , run_(that.run_)
+          , body_(that.body_)
+          , count_(that.count_)
+        {}
+
+        // The poster holds one count too, so that the awaiting frame is
+        // not resumed, and this object destroyed, while it is still
+        // posting.
+        bool _arrive() noexcept
+        {
+            return pending_.fetch_sub(1, std::memory_order_acq_rel) == 1;
+        }
+        static _chunk_coro _chunk(_fork_join* self, std::size_t i)
+        {
+            self->run_(self->body_, i);
+            if(self->_arrive())
+                self->resume();
+            co_return;
+        }
+
+        bool await_ready() const noexcept
+        {
+            return count_ == 0;
+        }
+        template<class Promise>
+        bool await_suspend(std::experimental::coroutine_handle<Promise> awaiter)
+        {
+            using handle_t = std::experimental::coroutine_handle<>;
+            set_coroutine(awaiter);
+            std::vector<handle_t> coros;
+            coros.reserve(count_);
+            try
+            {
+                for(std::size_t i = 0; i != count_; ++i)
+                    coros.push_back(_chunk(this, i).coro_);
+            }
+            catch(...)
+            {
+                for(auto coro : coros)
+                    coro.destroy();
+                throw;
+            }
+            pending_.store(count_ + 1, std::memory_order_relaxed);
+            auto& p = awaiter.promise();
+            auto first = coros.begin();
+            try
+            {
+                if constexpr(Same<std::decay_t<decltype(p.get_executor())>,
+                                  _implicit_executor>)
+                    for(; first != coros.end(); ++first)
+                        p.get_executor().resume(*first);
+                else
+                    coronet::_bulk_post(p.get_executor(), first, coros.end(),
+                                        p.get_allocator());
+            }
+            catch(...)
+            {
+                // The chunks already posted still use this object and the
+                // body, so wait for them rather than throw from here.
+                eptr_ = std::current_exception();
+                auto const unposted =
+                    static_cast<std::size_t>(coros.end() - first);
+                for(; first != coros.end(); ++first)
+                    first->destroy();
+                pending_.fetch_sub(unposted, std::memory_order_relaxed);
+            }
+            return !_arrive();
+        }
+        void await_resume() const
+        {
+            if(eptr_)
+                std::rethrow_exception(eptr_);
+        }
+    };
+
+    // Calls fn with each element of range, which must be random access and
+    // outlive the operation, spread over the executor of the token. The
+    // first few elements run inline while their cost is measured, and the
+    // rest are cut into chunks sized from it. If fn throws, the other
+    // chunks still run to the end, and the first exception in the order of
+    // the range is rethrown.
+    CO_PP_template(class Range, class Fn, class Token)(
+        requires CompletionToken<Token>)
+    auto async_parallel_for(Range& range, Fn fn, Token token)
+        -> result_t<Token, void(Range&, Fn)>
+    {
+        INITIAL_SUSPEND(token);
+        auto const first = std::begin(range);
+        auto const n = static_cast<std::size_t>(std::end(range) - first);
+        auto const plan =
+            _plan_chunks(n, [&](std::size_t i) { fn(first[i]); });
+        using alloc_t = rebind_alloc<
+            std::decay_t<decltype(coronet::get_allocator(token))>,
+            std::exception_ptr>;
+        std::vector<std::exception_ptr, alloc_t> errors(
+            plan.count, alloc_t(coronet::get_allocator(token)));
+        auto body = [&](std::size_t c) noexcept {
+            auto const begin = plan.done + c * plan.size;
+            auto const end = (std::min)(n, begin + plan.size);
+            try
+            {
+                for(auto i = begin; i != end; ++i)
+                    fn(first[i]);
+            }
+            catch(...)
+            {
+                errors[c] = std::current_exception();
+            }
+        };
+        co_await _fork_join{body, plan.count};
+        if(plan.error)
+            std::rethrow_exception(plan.error);
+        for(auto& e : errors)
+            if(e)
+                std::rethrow_exception(e);
+    }
+    template<class Range, class Fn>
+    auto async_parallel_for(Range& range, Fn fn)
+    {
+        return callable_with_implicit_context{
+            [&range, fn = std::move(fn)](auto token) {
+                return coronet::async_parallel_for(range, fn, token);
+            }};
+    }
+
+    // Completes with init combined, by reduce, with transform applied to
+    // each element of range, which must be random access and outlive the
+    // operation. The work is split as by async_parallel_for. Each chunk
+    // folds its elements into a slot of its own, and the slots are folded
+    // into init in the order of the range, so reduce need only be
+    // associative.
+    CO_PP_template(class Range, class T, class Reduce, class Transform,
+                   class Token)(
+        requires CompletionToken<Token>)
+    auto async_transform_reduce(Range& range, T init, Reduce reduce,
+                                Transform transform, Token token)
+        -> result_t<Token, T(Range&, T, Reduce, Transform)>
+    {
+        INITIAL_SUSPEND(token);
+        auto const first = std::begin(range);
+        auto const n = static_cast<std::size_t>(std::end(range) - first);
+        T acc = std::move(init);
+        auto const plan = _plan_chunks(n, [&](std::size_t i) {
+            acc = reduce(std::move(acc), transform(first[i]));
+        });
+        struct alignas(64) slot
+        {
+            std::optional<T> value_;
+            std::exception_ptr eptr_;
+        };
+        using alloc_t = rebind_alloc<
+            std::decay_t<decltype(coronet::get_allocator(token))>, slot>;
+        std::vector<slot, alloc_t> slots(
+            plan.count, alloc_t(coronet::get_allocator(token)));
+        auto body = [&](std::size_t c) noexcept {
+            auto const begin = plan.done + c * plan.size;
+            auto const end = (std::min)(n, begin + plan.size);
+            try
+            {
+                T part = transform(first[begin]);
+                for(auto i = begin + 1; i != end; ++i)
+                    part = reduce(std::move(part), transform(first[i]));
+                slots[c].value_.emplace(std::move(part));
+            }
+            catch(...)
+            {
+                slots[c].eptr_ = std::current_exception();
+            }
+        };
+        co_await _fork_join{body, plan.count};
+        if(plan.error)
+            std::rethrow_exception(plan.error);
+        for(auto& s : slots)
+        {
+            if(s.eptr_)
+                std::rethrow_exception(s.eptr_);
+            acc = reduce(std::move(acc), std::move(*s.value_));
+        }
+        co_return acc;
+    }
+    template<class Range, class T, class Reduce, class Transform>
+    auto async_transform_reduce(
+        Range& range, T init, Reduce reduce, Transform transform)
+    {
+        return callable_with_implicit_context{
+            [&range, init = std::move(init), reduce = std::move(reduce),
+             transform = std::move(transform)](auto token) {
+                return coronet::async_transform_reduce(
+                    range, init, reduce, transform, token);
+            }};
+    }
+} // namespace coronet
+
+#endif
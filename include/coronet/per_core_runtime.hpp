@@ -0,0 +1,682 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+//
+#ifndef CORONET_PER_CORE_RUNTIME_HPP
+#define CORONET_PER_CORE_RUNTIME_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <sys/socket.h>
+
+#include <experimental/executor>
+#include <experimental/internet>
+#include <experimental/io_context>
+#include <experimental/socket>
+#include <experimental/timer>
+
+#include <coronet/affinity.hpp>
+#include <coronet/coronet.hpp>
+#include <coronet/net.hpp>
+
+namespace coronet
+{
+    // A bounded queue with one producer thread and one consumer thread.
+    // Each side keeps its own index on a cache line of its own, along with
+    // the last value it saw of the other's, so that in the steady state
+    // neither reads the line that the other writes.
+    template<class T>
+    struct _spsc_ring
+    {
+    private:
+        std::unique_ptr<T[]> slots_;
+        std::size_t const mask_;
+        alignas(64) std::atomic<std::size_t> head_{0};
+        std::size_t tail_seen_ = 0;
+        alignas(64) std::atomic<std::size_t> tail_{0};
+        std::size_t head_seen_ = 0;
+
+    public:
+        // capacity must be a power of two.
+        explicit _spsc_ring(std::size_t capacity)
+          : slots_(new T[capacity])
+          , mask_(capacity - 1)
+        {
+            assert(capacity != 0 && (capacity & mask_) == 0);
+        }
+        _spsc_ring(_spsc_ring&&) = delete;
+
+        // Producer only. Moves from value only if there is room.
+        bool try_push(T& value)
+        {
+            auto const tail = tail_.load(std::memory_order_relaxed);
+            if(tail - head_seen_ > mask_)
+            {
+                head_seen_ = head_.load(std::memory_order_acquire);
+                if(tail - head_seen_ > mask_)
+                    return false;
+            }
+            slots_[tail & mask_] = std::move(value);
+            tail_.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+        // Consumer only. Pops and calls fun with each item that was in the
+        // queue on entry, and returns how many there were.
+        template<class Fn>
+        std::size_t consume(Fn fun)
+        {
+            auto head = head_.load(std::memory_order_relaxed);
+            if(head == tail_seen_)
+            {
+                tail_seen_ = tail_.load(std::memory_order_acquire);
+                if(head == tail_seen_)
+                    return 0;
+            }
+            auto const start = head, end = tail_seen_;
+            for(; head != end; ++head)
+            {
+                T item = std::move(slots_[head & mask_]);
+                head_.store(head + 1, std::memory_order_release);
+                fun(item);
+            }
+            return end - start;
+        }
+        // Consumer only.
+        bool empty() const noexcept
+        {
+            return head_.load(std::memory_order_relaxed) ==
+                   tail_.load(std::memory_order_acquire);
+        }
+    };
+
+    // A pool of small blocks for the coroutine frames of one core, recycled
+    // through per-size-class free lists without locks. Each block starts
+    // with a header that names the heap it came from. Blocks freed on
+    // another thread are pushed onto a lock-free list that the owning core
+    // takes back when a free list runs dry. Blocks allocated off the core,
+    // and big ones, come from the global operator new.
+    struct _core_heap
+    {
+    private:
+        static constexpr std::size_t _min_block = 32;
+        static constexpr std::size_t _max_block = 4096;
+        static constexpr std::size_t _nclasses = 8; // 32, 64, ... 4096
+        static constexpr std::size_t _chunk_size = std::size_t(1) << 16;
+
+        // link_ is the owning heap while the block is in use, and the next
+        // free block while it is on a free list. cls_ is the size class,
+        // or the size of a block that has no heap.
+        struct alignas(16) _block
+        {
+            void* link_;
+            std::size_t cls_;
+        };
+
+        _block* free_[_nclasses] = {};
+        char* cur_ = nullptr;
+        char* end_ = nullptr;
+        std::vector<void*> chunks_;
+        std::atomic<_block*> remote_{nullptr};
+
+        static std::size_t _size_class(std::size_t size) noexcept
+        {
+            std::size_t cls = 0;
+            for(std::size_t n = _min_block; n < size; n *= 2)
+                ++cls;
+            return cls;
+        }
+        void _reclaim() noexcept
+        {
+            auto* b = remote_.exchange(nullptr, std::memory_order_acquire);
+            while(b)
+            {
+                auto* const next = static_cast<_block*>(b->link_);
+                b->link_ = free_[b->cls_];
+                free_[b->cls_] = b;
+                b = next;
+            }
+        }
+        void* _allocate_global(std::size_t size)
+        {
+            auto* b = ::new(::operator new(sizeof(_block) + size))
+                _block{nullptr, size};
+            return b + 1;
+        }
+
+    public:
+        _core_heap() = default;
+        _core_heap(_core_heap&&) = delete;
+        ~_core_heap()
+        {
+            for(void* chunk : chunks_)
+                ::operator delete(chunk);
+        }
+
+        // The heap of the core that the calling thread runs, if any.
+        static _core_heap*& current() noexcept
+        {
+            static thread_local _core_heap* cur = nullptr;
+            return cur;
+        }
+
+        void* allocate(std::size_t size)
+        {
+            auto const total = sizeof(_block) + size;
+            if(total > _max_block || current() != this)
+                return _allocate_global(size);
+            auto const cls = _size_class(total);
+            if(!free_[cls])
+                _reclaim();
+            _block* b = free_[cls];
+            if(b)
+                free_[cls] = static_cast<_block*>(b->link_);
+            else
+            {
+                auto const block = _min_block << cls;
+                if(static_cast<std::size_t>(end_ - cur_) < block)
+                {
+                    // The tail of the old chunk is abandoned.
+                    chunks_.reserve(chunks_.size() + 1);
+                    cur_ = static_cast<char*>(::operator new(_chunk_size));
+                    chunks_.push_back(cur_);
+                    end_ = cur_ + _chunk_size;
+                }
+                b = reinterpret_cast<_block*>(
+                    std::exchange(cur_, cur_ + block));
+            }
+            b->link_ = this;
+            b->cls_ = cls;
+            return b + 1;
+        }
+        static void deallocate(void* p) noexcept
+        {
+            auto* const b = static_cast<_block*>(p) - 1;
+            auto* const heap = static_cast<_core_heap*>(b->link_);
+            if(!heap)
+                return ::operator delete(b);
+            if(heap == current())
+            {
+                b->link_ = heap->free_[b->cls_];
+                heap->free_[b->cls_] = b;
+                return;
+            }
+            auto* head = heap->remote_.load(std::memory_order_relaxed);
+            do
+                b->link_ = head;
+            while(!heap->remote_.compare_exchange_weak(
+                head, b, std::memory_order_release,
+                std::memory_order_relaxed));
+        }
+    };
+
+    // An allocator for the frames of the operations that run on one core
+    // of a per_core_runtime. It can be used from any thread; only
+    // allocations made on the core itself come from the core's pool. A
+    // default-constructed one uses the global operator new.
+    template<class T = void>
+    struct core_allocator
+    {
+        using value_type = T;
+        _core_heap* heap_ = nullptr;
+
+        core_allocator() = default;
+        explicit core_allocator(_core_heap* heap) noexcept
+          : heap_(heap)
+        {}
+        template<class U>
+        core_allocator(core_allocator<U> const& that) noexcept
+          : heap_(that.heap_)
+        {}
+        T* allocate(std::size_t n)
+        {
+            static_assert(alignof(T) <= 16, "core_allocator does not support "
+                                            "over-aligned types.");
+            if(!heap_)
+                return static_cast<T*>(::operator new(n * sizeof(T)));
+            return static_cast<T*>(heap_->allocate(n * sizeof(T)));
+        }
+        void deallocate(T* p, std::size_t) noexcept
+        {
+            if(!heap_)
+                return ::operator delete(p);
+            _core_heap::deallocate(p);
+        }
+        template<class U>
+        friend bool operator==(core_allocator a, core_allocator<U> b) noexcept
+        {
+            return a.heap_ == b.heap_;
+        }
+        template<class U>
+        friend bool operator!=(core_allocator a, core_allocator<U> b) noexcept
+        {
+            return !(a == b);
+        }
+    };
+
+    // SO_REUSEPORT, which the Networking TS has no option for.
+    struct _reuse_port
+    {
+        int value_ = 1;
+
+        template<class Protocol>
+        int level(Protocol const&) const noexcept
+        {
+            return SOL_SOCKET;
+        }
+        template<class Protocol>
+        int name(Protocol const&) const noexcept
+        {
+            return SO_REUSEPORT;
+        }
+        template<class Protocol>
+        void const* data(Protocol const&) const noexcept
+        {
+            return &value_;
+        }
+        template<class Protocol>
+        std::size_t size(Protocol const&) const noexcept
+        {
+            return sizeof(value_);
+        }
+    };
+
+    // One event loop per core, sharing nothing on the hot paths. Each core
+    // has a thread pinned to one CPU, an io_context of its own for its
+    // sockets and timers, a queue for the work it posts to itself, a pool
+    // for its frames, and a mailbox for every other core.
+    //
+    // Where work posted through a core's executor goes depends on who
+    // posts it: work from the core itself goes on its local queue, which
+    // needs no synchronization; work from another core goes through the
+    // lock-free single-producer mailbox between the two; and work from any
+    // other thread goes through the core's io_context. A core asleep in
+    // its reactor is woken only when its mailboxes were empty.
+    //
+    // get_executor(), get_allocator() and context() with no arguments
+    // answer for the core that the calling thread runs, so tokens made
+    // from them on a core keep everything on that core, and an operation
+    // awaited with such a token runs inline. listen() shards incoming
+    // connections across the cores with one SO_REUSEPORT listener each.
+    struct per_core_runtime
+    {
+    private:
+        using _tcp = std::experimental::net::ip::tcp;
+        using _work = std::function<void()>;
+        static constexpr std::size_t _mailbox_size = 256;
+
+        // A listening socket, and the timer its accept loop backs off with.
+        struct _listener
+        {
+            _tcp::acceptor acceptor_;
+            std::experimental::net::steady_timer timer_;
+
+            explicit _listener(std::experimental::net::io_context& ctx)
+              : acceptor_(ctx)
+              , timer_(ctx)
+            {}
+            void _close()
+            {
+                std::error_code ec;
+                acceptor_.close(ec);
+                timer_.cancel();
+            }
+        };
+
+        struct _core
+        {
+            per_core_runtime* rt_;
+            std::size_t index_;
+            _core_heap heap_;
+            std::experimental::net::io_context ctx_{1};
+            // inbox_[i] is the mailbox from core i; there is none from
+            // this core to itself.
+            std::vector<std::unique_ptr<_spsc_ring<_work>>> inbox_;
+            std::vector<_work> local_, running_;
+            std::atomic<bool> sleeping_{false};
+            bool stopped_ = false;
+            std::mutex mtx_;
+            std::vector<std::unique_ptr<_listener>> listeners_;
+
+            _core(per_core_runtime* rt, std::size_t index, std::size_t cores)
+              : rt_(rt)
+              , index_(index)
+              , inbox_(cores)
+            {
+                for(std::size_t i = 0; i < cores; ++i)
+                    if(i != index)
+                        inbox_[i] = std::make_unique<_spsc_ring<_work>>(
+                            _mailbox_size);
+            }
+            _core(_core&&) = delete;
+
+            std::size_t _drain()
+            {
+                std::size_t n = 0;
+                for(auto& mailbox : inbox_)
+                    if(mailbox)
+                        n += mailbox->consume([](_work& work) { work(); });
+                // Work that this runs and posts to this core waits for the
+                // next round, after the mailboxes and the reactor.
+                running_.swap(local_);
+                for(auto& work : running_)
+                    work();
+                n += running_.size();
+                running_.clear();
+                return n;
+            }
+            bool _mailboxes_empty() const noexcept
+            {
+                for(auto& mailbox : inbox_)
+                    if(mailbox && !mailbox->empty())
+                        return false;
+                return true;
+            }
+            void _wake()
+            {
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if(sleeping_.exchange(false, std::memory_order_relaxed))
+                    std::experimental::net::post(ctx_, [] {});
+            }
+            void _run()
+            {
+                auto guard = std::experimental::net::make_work_guard(ctx_);
+                while(!stopped_)
+                {
+                    if(_drain() + ctx_.poll() != 0)
+                        continue;
+                    // Sleep in the reactor until there is I/O, a timer, or a
+                    // wake-up. Announce it before looking at the mailboxes
+                    // once more, so that a core posting in between sees it.
+                    sleeping_.store(true, std::memory_order_relaxed);
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                    if(_mailboxes_empty())
+                        ctx_.run_one();
+                    sleeping_.store(false, std::memory_order_relaxed);
+                }
+                // Let the accept loops see their listeners closed.
+                while(_drain() + ctx_.poll() != 0)
+                    ;
+            }
+            void _stop()
+            {
+                std::lock_guard<std::mutex> lock{mtx_};
+                for(auto& listener : listeners_)
+                    listener->_close();
+                stopped_ = true;
+            }
+        };
+
+        static _core*& _current() noexcept
+        {
+            static thread_local _core* cur = nullptr;
+            return cur;
+        }
+
+        // Cores hold a pointer to the runtime, and executors to the cores,
+        // so neither must move.
+        std::vector<std::unique_ptr<_core>> cores_;
+        std::vector<std::thread> threads_;
+
+        template<class Fn, class Token>
+        static auto _accept_loop(_core* core, _listener* listener,
+                                 Fn on_accept, Token token)
+            -> result_t<Token, void(_core*, _listener*, Fn)>
+        {
+            INITIAL_SUSPEND(token);
+            auto& acceptor = listener->acceptor_;
+            _accept_backoff backoff;
+            while(acceptor.is_open())
+            {
+                _tcp::socket socket{core->ctx_};
+                std::error_code ec;
+                try
+                {
+                    co_await coronet::async_accept(acceptor, socket);
+                }
+                catch(std::system_error const& e)
+                {
+                    ec = e.code();
+                }
+                if(ec)
+                {
+                    auto const delay = backoff.next(ec);
+                    if(delay.count() != 0 && acceptor.is_open())
+                    {
+                        listener->timer_.expires_after(delay);
+                        try
+                        {
+                            co_await coronet::async_wait(listener->timer_);
+                        }
+                        catch(std::system_error const&)
+                        {
+                            // The listener was closed.
+                        }
+                    }
+                    continue;
+                }
+                backoff.reset();
+                on_accept(std::move(socket), core->index_);
+            }
+        }
+
+    public:
+        struct executor_type
+        {
+        private:
+            friend per_core_runtime;
+            _core* core_;
+            explicit executor_type(_core* core) noexcept
+              : core_(core)
+            {}
+
+        public:
+            CO_PP_template(class F, class A)(
+                requires Invocable<F&> && Allocator<A>)
+            void post(F fun, A const&) const
+            {
+                auto* const here = _current();
+                if(here == core_)
+                {
+                    core_->local_.emplace_back(std::move(fun));
+                    return;
+                }
+                if(here && here->rt_ == core_->rt_)
+                {
+                    _work work{std::move(fun)};
+                    if(core_->inbox_[here->index_]->try_push(work))
+                        return core_->_wake();
+                    // The mailbox is full; take the slow road.
+                    return std::experimental::net::post(core_->ctx_,
+                                                        std::move(work));
+                }
+                std::experimental::net::post(core_->ctx_, std::move(fun));
+            }
+            // The index of the core that this executor runs work on.
+            std::size_t core() const noexcept
+            {
+                return core_->index_;
+            }
+            friend bool operator==(executor_type a, executor_type b) noexcept
+            {
+                return a.core_ == b.core_;
+            }
+            friend bool operator!=(executor_type a, executor_type b) noexcept
+            {
+                return !(a == b);
+            }
+        };
+
+        // One core per CPU of the machine, or the given number of cores,
+        // each pinned to a CPU of its own when there are enough.
+        explicit per_core_runtime(
+            std::size_t cores = (std::max)(
+                1u, std::thread::hardware_concurrency()),
+            bool pin = true)
+        {
+            std::vector<int> cpus;
+            auto const topo = topology::detect();
+            for(std::size_t node = 0; node < topo.node_count(); ++node)
+                for(int cpu : topo.cpus(node))
+                    cpus.push_back(cpu);
+            pin = pin && cores <= cpus.size();
+            cores_.reserve(cores);
+            for(std::size_t i = 0; i < cores; ++i)
+                cores_.push_back(std::make_unique<_core>(this, i, cores));
+            threads_.reserve(cores);
+            for(std::size_t i = 0; i < cores; ++i)
+                threads_.emplace_back([core = cores_[i].get(),
+                                       cpu = pin ? cpus[i] : -1] {
+                    if(cpu >= 0)
+                        _pin_this_thread({cpu});
+                    _current() = core;
+                    _core_heap::current() = &core->heap_;
+                    core->_run();
+                });
+        }
+        per_core_runtime(per_core_runtime&&) = delete;
+        ~per_core_runtime()
+        {
+            join();
+        }
+
+        std::size_t size() const noexcept
+        {
+            return cores_.size();
+        }
+        // The core that the calling thread runs, or -1 if it runs none of
+        // this runtime's.
+        int current_core() const noexcept
+        {
+            auto* const core = _current();
+            return core && core->rt_ == this ? static_cast<int>(core->index_)
+                                             : -1;
+        }
+
+        executor_type get_executor(std::size_t core) const noexcept
+        {
+            return executor_type{cores_[core].get()};
+        }
+        core_allocator<> get_allocator(std::size_t core) const noexcept
+        {
+            return core_allocator<>{&cores_[core]->heap_};
+        }
+        std::experimental::net::io_context& context(std::size_t core) const
+            noexcept
+        {
+            return cores_[core]->ctx_;
+        }
+        // For the calling thread's core, or for core 0 off the runtime's
+        // threads.
+        executor_type get_executor() const noexcept
+        {
+            return get_executor(_current_or_first());
+        }
+        core_allocator<> get_allocator() const noexcept
+        {
+            return get_allocator(_current_or_first());
+        }
+        std::experimental::net::io_context& context() const noexcept
+        {
+            return context(_current_or_first());
+        }
+
+        // Accept TCP connections to endpoint on every core, each through a
+        // listening socket of its own bound with SO_REUSEPORT, so that the
+        // kernel spreads the connections over the cores. Calls
+        // on_accept(socket, core), which must not throw, on the core that
+        // accepted the socket, which belongs to that core's io_context.
+        // Each core gets its own copy of on_accept. Returns the endpoint
+        // that was bound, which tells the port if endpoint's was 0. If a
+        // core fails to listen, the cores already listening stop, and the
+        // exception is rethrown.
+        template<class Fn>
+        _tcp::endpoint listen(_tcp::endpoint endpoint, Fn on_accept)
+        {
+            std::vector<_listener*> opened;
+            try
+            {
+                for(auto& core : cores_)
+                {
+                    auto listener = std::make_unique<_listener>(core->ctx_);
+                    auto& acceptor = listener->acceptor_;
+                    acceptor.open(endpoint.protocol());
+                    acceptor.set_option(_tcp::acceptor::reuse_address(true));
+                    acceptor.set_option(_reuse_port{});
+                    acceptor.bind(endpoint);
+                    acceptor.listen();
+                    // The other cores share the port that the first was
+                    // given.
+                    endpoint = acceptor.local_endpoint();
+                    auto* const l = listener.get();
+                    {
+                        std::lock_guard<std::mutex> lock{core->mtx_};
+                        core->listeners_.push_back(std::move(listener));
+                    }
+                    opened.push_back(l);
+                    _accept_loop(core.get(), l, on_accept,
+                                 [](std::exception_ptr) {} |
+                                     via(get_executor(core->index_),
+                                         get_allocator(core->index_)));
+                }
+            }
+            catch(...)
+            {
+                // A listener belongs to its core's thread, so close each
+                // there.
+                for(std::size_t i = 0; i < opened.size(); ++i)
+                    std::experimental::net::post(
+                        cores_[i]->ctx_, [l = opened[i]] { l->_close(); });
+                throw;
+            }
+            return endpoint;
+        }
+
+        // Close the listeners and stop the event loops. Operations still
+        // pending on a core, such as reads on open connections, are
+        // abandoned, as they would be by stopping an io_context.
+        void stop()
+        {
+            for(auto& core : cores_)
+                std::experimental::net::post(
+                    core->ctx_, [core = core.get()] { core->_stop(); });
+        }
+        // Stop, then wait for the cores' threads to exit.
+        void join()
+        {
+            stop();
+            for(auto& t : threads_)
+                if(t.joinable())
+                    t.join();
+        }
+
+    private:
+        std::size_t _current_or_first() const noexcept
+        {
+            auto const core = current_core();
+            return core < 0 ? 0 : static_cast<std::size_t>(core);
+        }
+    };
+} // namespace coronet
+
+#endif
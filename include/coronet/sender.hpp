@@ -0,0 +1,924 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+//
+#ifndef CORONET_SENDER_HPP
+#define CORONET_SENDER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include <meta/meta.hpp>
+
+#include <experimental/coroutine>
+#include <experimental/io_context> // for async_result
+
+#include <coronet/coronet.hpp>
+#include <coronet/detail/waiter.hpp>
+
+namespace coronet
+{
+    // A sender is a lazy asynchronous operation. Connecting it to a receiver
+    // gives an operation state, which does nothing until start() is called
+    // on it, and which must stay where it is until the receiver has been
+    // called. The receiver gets the result through exactly one call to
+    // set_value(v), or set_value() for a sender of void, or
+    // set_error(eptr). Receivers must not throw.
+    //
+    // The adaptors below nest the operation states of the senders they are
+    // made of inside their own, so a composed pipeline is one object that
+    // lives wherever it is connected: on the stack, in a frame, or in
+    // another operation state.
+    struct sender_tag
+    {};
+
+    struct CSender
+    {
+        template<class S>
+        auto requires_()
+            -> decltype(
+                requires_<CSame, typename S::sender_concept, sender_tag>,
+                meta::id<typename S::value_type>{});
+    };
+    template<class S>
+    inline constexpr bool Sender = is_satisfied_by<CSender, std::decay_t<S>>;
+
+    template<class S, class R>
+    using connect_result_t =
+        decltype(std::declval<S>().connect(std::declval<R>()));
+
+    // Converts to the result of calling fn, so that an immovable operation
+    // state can be emplaced from the connect call that returns it.
+    template<class Fn>
+    struct _emplacer
+    {
+        Fn fn_;
+        operator std::invoke_result_t<Fn&>()
+        {
+            return fn_();
+        }
+    };
+
+    template<class Fn>
+    _emplacer(Fn)->_emplacer<Fn>;
+
+    // Awaits any sender by connecting it to a receiver that lives in the
+    // awaitable, and so in the awaiting coroutine's frame. The coroutine
+    // does not suspend if the sender completes inside start(); otherwise
+    // it is resumed in its own execution context.
+    template<class S>
+    struct _sender_awaitable : _waiter
+    {
+    private:
+        using _value_t = typename S::value_type;
+
+        struct _receiver
+        {
+            _sender_awaitable* self_;
+
+            template<class... Vs>
+            void set_value(Vs&&... vs)
+            {
+                if constexpr(std::is_void_v<_value_t>)
+                    self_->result_.return_void();
+                else
+                    self_->result_.return_value(static_cast<Vs&&>(vs)...);
+                self_->_done();
+            }
+            void set_error(std::exception_ptr eptr)
+            {
+                self_->eptr_ = std::move(eptr);
+                self_->_done();
+            }
+        };
+
+        _result_storage<_value_t> result_{};
+        std::exception_ptr eptr_{};
+        // Set by whichever of await_suspend and the receiver gets there
+        // second, which then resumes the awaiter.
+        std::atomic<bool> ready_{false};
+        connect_result_t<S, _receiver> op_;
+
+        void _done()
+        {
+            if(ready_.exchange(true, std::memory_order_acq_rel))
+                resume();
+        }
+
+    public:
+        explicit _sender_awaitable(S&& s)
+          : op_(std::move(s).connect(_receiver{this}))
+        {}
+        _sender_awaitable(_sender_awaitable&&) = delete;
+
+        static constexpr bool await_ready() noexcept
+        {
+            return false;
+        }
+        template<class Promise>
+        bool await_suspend(std::experimental::coroutine_handle<Promise> awaiter)
+        {
+            set_coroutine(awaiter);
+            op_.start();
+            return !ready_.exchange(true, std::memory_order_acq_rel);
+        }
+        _value_t await_resume()
+        {
+            if(eptr_)
+                std::rethrow_exception(eptr_);
+            return result_._get();
+        }
+    };
+
+    // A completion token that makes an async operation return a sender: a
+    // coroutine that stays suspended at its INITIAL_SUSPEND until it is
+    // started, then runs on e, with its frame allocated by a.
+    template<class E, class A = std::allocator<void>>
+    struct as_sender_t
+    {
+        static_assert(Executor<E>);
+        static_assert(Allocator<A>);
+        E exec_{};
+        A alloc_{};
+
+        as_sender_t() = delete;
+        constexpr explicit as_sender_t(E e, A a = A{})
+          : exec_(e)
+          , alloc_(a)
+        {}
+        A const& get_allocator() const noexcept
+        {
+            return alloc_;
+        }
+        auto get_executor() const
+        {
+            return exec_;
+        }
+        // Awaited from a coroutine with the same executor and allocator,
+        // the operation runs inline, as with yield.
+        template<class Token>
+        bool _same_context(Token const& that) const
+        {
+            using E2 = std::decay_t<decltype(that.get_executor())>;
+            using A2 = std::decay_t<decltype(that.get_allocator())>;
+            if constexpr(Same<E, E2> && Same<A, A2>)
+                return exec_ == that.get_executor() &&
+                       (typename std::allocator_traits<A>::is_always_equal() ||
+                        alloc_ == that.get_allocator());
+            else
+                return false;
+        }
+    };
+
+    struct as_sender_gen_t
+    {
+        CO_PP_template(class E, class A = std::allocator<void>)(
+            requires Executor<E> && Allocator<A>)
+        constexpr auto operator()(E e, A a = A{}) const
+        {
+            return as_sender_t{e, a};
+        }
+        CO_PP_template(class E, class A)(
+            requires Executor<E> && Allocator<A>)
+        constexpr auto operator()(A a, E e) const
+        {
+            return as_sender_t{e, a};
+        }
+    };
+
+    inline constexpr as_sender_gen_t as_sender{};
+
+    // The result of an async operation that was given an as_sender token.
+    // Its frame is allocated when the operation is called, as for any
+    // coroutine, but nothing runs until it is started or awaited.
+    template<class T, class Token>
+    struct [[nodiscard]] sender {
+    private:
+        template<class, class...>
+        friend struct std::experimental::coroutine_traits;
+        template<class, class, class, class>
+        friend struct _async_result_impl_;
+        static_assert(CompletionToken<Token>);
+
+        struct promise_type
+          : _frame_allocator<Token>
+          , _result_storage<T>
+          , _token_storage<Token>
+        {
+            std::exception_ptr eptr_{};
+            // Hands the result to whoever started the coroutine, and says
+            // what to resume next.
+            std::experimental::coroutine_handle<> (*complete_)(void*) noexcept =
+                nullptr;
+            void* target_ = nullptr;
+
+            promise_type() = default;
+            CO_PP_template(class... Ts)(
+                requires Same<Token,
+                              std::decay_t<meta::back<meta::list<Ts...>>>>)
+            promise_type(Ts&&... args)
+              : promise_type()
+            {
+                this->_set_token(_back(std::forward<Ts>(args)...));
+            }
+            // Unlike void_, leave the coroutine suspended; it is posted
+            // when it is started.
+            void set_token(Token token)
+            {
+                this->_set_token(std::move(token));
+            }
+            auto initial_suspend() const noexcept
+            {
+                // For now, the INITIAL_SUSPEND macro is treated as the
+                // coroutine's initial_suspend
+                return std::experimental::suspend_never{};
+            }
+            auto final_suspend() const noexcept
+            {
+                struct awaitable
+                {
+                    static bool await_ready() noexcept
+                    {
+                        return false;
+                    }
+                    std::experimental::coroutine_handle<> await_suspend(
+                        std::experimental::coroutine_handle<promise_type>
+                            coro) const noexcept
+                    {
+                        auto& p = coro.promise();
+                        return p.complete_(p.target_);
+                    }
+                    static void await_resume() noexcept {}
+                };
+                return awaitable{};
+            }
+            void unhandled_exception() noexcept
+            {
+                eptr_ = std::current_exception();
+            }
+            sender get_return_object() noexcept
+            {
+                return sender{*this};
+            }
+            template<class U>
+            auto await_transform(U t)
+            {
+                if constexpr(WantsExecutionContext<U>)
+                    return std::move(t)(this->_implicit_token());
+                else
+                    return t;
+            }
+        };
+
+        static void _post(
+            std::experimental::coroutine_handle<promise_type> coro)
+        {
+            auto const& token = coro.promise().get_token();
+            coronet::get_executor(token).post(coro,
+                                              coronet::get_allocator(token));
+        }
+
+        template<class R>
+        struct _operation
+        {
+            std::experimental::coroutine_handle<promise_type> coro_;
+            R receiver_;
+
+            _operation(std::experimental::coroutine_handle<promise_type> coro,
+                       R receiver)
+              : coro_(coro)
+              , receiver_(std::move(receiver))
+            {}
+            _operation(_operation&&) = delete;
+            ~_operation()
+            {
+                if(coro_)
+                    coro_.destroy();
+            }
+
+            // The frame is freed before the receiver is told, since the
+            // receiver may destroy this operation state.
+            static std::experimental::coroutine_handle<> _complete(
+                void* p) noexcept
+            {
+                auto& self = *static_cast<_operation*>(p);
+                auto const coro = std::exchange(self.coro_, {});
+                auto eptr = std::move(coro.promise().eptr_);
+                auto value = std::move(coro.promise().value_);
+                coro.destroy();
+                if(eptr)
+                    self.receiver_.set_error(std::move(eptr));
+                else if constexpr(std::is_void_v<T>)
+                    self.receiver_.set_value();
+                else
+                    self.receiver_.set_value(std::move(*value));
+                return noop_coroutine();
+            }
+            void start() noexcept
+            {
+                auto& p = coro_.promise();
+                p.complete_ = &_complete;
+                p.target_ = this;
+                try
+                {
+                    _post(coro_);
+                }
+                catch(...)
+                {
+                    receiver_.set_error(std::current_exception());
+                }
+            }
+        };
+
+        struct _awaitable : _waiter
+        {
+            std::experimental::coroutine_handle<promise_type> child_;
+            bool inline_ = false;
+
+            static std::experimental::coroutine_handle<> _complete(
+                void* p) noexcept
+            {
+                auto& self = *static_cast<_awaitable*>(p);
+                if(self.inline_)
+                    return std::experimental::coroutine_handle<>::from_address(
+                        self.coro_);
+                self.resume();
+                return noop_coroutine();
+            }
+            static constexpr bool await_ready() noexcept
+            {
+                return false;
+            }
+            template<class Promise>
+            std::experimental::coroutine_handle<> await_suspend(
+                std::experimental::coroutine_handle<Promise> awaiter)
+            {
+                set_coroutine(awaiter);
+                auto& p = child_.promise();
+                p.complete_ = &_complete;
+                p.target_ = this;
+                if constexpr(HasExecutionContext<Promise>)
+                {
+                    // The same shortcut as task: run inline, and resume the
+                    // awaiter by symmetric transfer rather than a post.
+                    if(_same_context(p.get_token(),
+                                     awaiter.promise().get_token()))
+                    {
+                        inline_ = true;
+                        return child_;
+                    }
+                }
+                else
+                    inline_ = true;
+                _post(child_);
+                return noop_coroutine();
+            }
+            T await_resume() const
+            {
+                auto& p = child_.promise();
+                if(p.eptr_)
+                    std::rethrow_exception(p.eptr_);
+                return p._get();
+            }
+        };
+
+        std::experimental::coroutine_handle<promise_type> coro_{};
+
+        explicit sender(promise_type& p)
+          : coro_(
+                std::experimental::coroutine_handle<promise_type>::from_promise(
+                    p))
+        {}
+
+    public:
+        using value_type = T;
+        using sender_concept = sender_tag;
+
+        sender(sender&& that) noexcept
+          : coro_(std::exchange(that.coro_, {}))
+        {}
+        ~sender()
+        {
+            if(coro_)
+                coro_.destroy();
+        }
+        template<class R>
+        _operation<R> connect(R receiver) &&
+        {
+            return _operation<R>{std::exchange(coro_, {}), std::move(receiver)};
+        }
+        auto operator co_await() const noexcept
+        {
+            return _awaitable{{}, coro_};
+        }
+    };
+
+    // A sender that completes inline, in start(), with the values given.
+    template<class T>
+    struct _just_sender
+    {
+        using value_type = T;
+        using sender_concept = sender_tag;
+
+        T value_;
+
+        template<class R>
+        struct _operation
+        {
+            T value_;
+            R receiver_;
+
+            void start() noexcept
+            {
+                receiver_.set_value(std::move(value_));
+            }
+        };
+        template<class R>
+        _operation<R> connect(R receiver) &&
+        {
+            return {std::move(value_), std::move(receiver)};
+        }
+        auto operator co_await() &&
+        {
+            return _sender_awaitable<_just_sender>{std::move(*this)};
+        }
+    };
+
+    template<>
+    struct _just_sender<void>
+    {
+        using value_type = void;
+        using sender_concept = sender_tag;
+
+        template<class R>
+        struct _operation
+        {
+            R receiver_;
+
+            void start() noexcept
+            {
+                receiver_.set_value();
+            }
+        };
+        template<class R>
+        _operation<R> connect(R receiver) &&
+        {
+            return {std::move(receiver)};
+        }
+        auto operator co_await() &&
+        {
+            return _sender_awaitable<_just_sender>{std::move(*this)};
+        }
+    };
+
+    template<class T>
+    auto just(T value)
+    {
+        return _just_sender<T>{std::move(value)};
+    }
+    inline auto just()
+    {
+        return _just_sender<void>{};
+    }
+
+    template<class Fn, class T>
+    struct _then_result_
+    {
+        using type = std::invoke_result_t<Fn&, T>;
+    };
+
+    template<class Fn>
+    struct _then_result_<Fn, void>
+    {
+        using type = std::invoke_result_t<Fn&>;
+    };
+
+    // Completes with fn applied to the value of s, inline, on whatever
+    // thread s completes on.
+    template<class S, class Fn>
+    struct _then_sender
+    {
+        using value_type = meta::_t<_then_result_<Fn, typename S::value_type>>;
+        using sender_concept = sender_tag;
+
+        S sender_;
+        Fn fn_;
+
+        template<class R>
+        struct _operation
+        {
+            struct _receiver
+            {
+                _operation* op_;
+
+                template<class... Vs>
+                void set_value(Vs&&... vs)
+                {
+                    op_->_set_value(static_cast<Vs&&>(vs)...);
+                }
+                void set_error(std::exception_ptr eptr)
+                {
+                    op_->receiver_.set_error(std::move(eptr));
+                }
+            };
+
+            Fn fn_;
+            R receiver_;
+            connect_result_t<S, _receiver> op_;
+
+            _operation(S&& s, Fn fn, R receiver)
+              : fn_(std::move(fn))
+              , receiver_(std::move(receiver))
+              , op_(std::move(s).connect(_receiver{this}))
+            {}
+            _operation(_operation&&) = delete;
+
+            template<class... Vs>
+            void _set_value(Vs&&... vs)
+            {
+                if constexpr(std::is_void_v<value_type>)
+                {
+                    try
+                    {
+                        fn_(static_cast<Vs&&>(vs)...);
+                    }
+                    catch(...)
+                    {
+                        return receiver_.set_error(std::current_exception());
+                    }
+                    receiver_.set_value();
+                }
+                else
+                {
+                    std::optional<value_type> result;
+                    try
+                    {
+                        result.emplace(fn_(static_cast<Vs&&>(vs)...));
+                    }
+                    catch(...)
+                    {
+                        return receiver_.set_error(std::current_exception());
+                    }
+                    receiver_.set_value(std::move(*result));
+                }
+            }
+            void start() noexcept
+            {
+                op_.start();
+            }
+        };
+        template<class R>
+        _operation<R> connect(R receiver) &&
+        {
+            return {std::move(sender_), std::move(fn_), std::move(receiver)};
+        }
+        auto operator co_await() &&
+        {
+            return _sender_awaitable<_then_sender>{std::move(*this)};
+        }
+    };
+
+    template<class Fn>
+    struct _then_fn
+    {
+        Fn fn_;
+
+        CO_PP_template(class S)(
+            requires Sender<S>)
+        friend auto operator|(S s, _then_fn self)
+        {
+            return _then_sender<S, Fn>{std::move(s), std::move(self.fn_)};
+        }
+    };
+
+    CO_PP_template(class S, class Fn)(
+        requires Sender<S>)
+    auto then(S s, Fn fn)
+    {
+        return _then_sender<S, Fn>{std::move(s), std::move(fn)};
+    }
+    template<class Fn>
+    auto then(Fn fn)
+    {
+        return _then_fn<Fn>{std::move(fn)};
+    }
+
+    template<class Fn, class T>
+    struct _let_result_
+    {
+        using type = std::decay_t<std::invoke_result_t<Fn&, T&>>;
+    };
+
+    template<class Fn>
+    struct _let_result_<Fn, void>
+    {
+        using type = std::decay_t<std::invoke_result_t<Fn&>>;
+    };
+
+    // Completes as the sender that fn returns when given the value of s.
+    // The value is kept alive, and the second operation state is built in
+    // place, inside this operation state.
+    template<class S, class Fn>
+    struct _let_sender
+    {
+    private:
+        using _in_t = typename S::value_type;
+        using _next_t = meta::_t<_let_result_<Fn, _in_t>>;
+        static_assert(Sender<_next_t>, "let_value needs a function that "
+                                       "returns a sender.");
+
+    public:
+        using value_type = typename _next_t::value_type;
+        using sender_concept = sender_tag;
+
+        S sender_;
+        Fn fn_;
+
+        template<class R>
+        struct _operation
+        {
+            struct _first_receiver
+            {
+                _operation* op_;
+
+                template<class... Vs>
+                void set_value(Vs&&... vs)
+                {
+                    op_->_set_value(static_cast<Vs&&>(vs)...);
+                }
+                void set_error(std::exception_ptr eptr)
+                {
+                    op_->receiver_.set_error(std::move(eptr));
+                }
+            };
+            struct _second_receiver
+            {
+                _operation* op_;
+
+                template<class... Vs>
+                void set_value(Vs&&... vs)
+                {
+                    op_->receiver_.set_value(static_cast<Vs&&>(vs)...);
+                }
+                void set_error(std::exception_ptr eptr)
+                {
+                    op_->receiver_.set_error(std::move(eptr));
+                }
+            };
+
+            Fn fn_;
+            R receiver_;
+            _result_storage<_in_t> value_{};
+            connect_result_t<S, _first_receiver> first_;
+            std::optional<connect_result_t<_next_t, _second_receiver>>
+                second_{};
+
+            _operation(S&& s, Fn fn, R receiver)
+              : fn_(std::move(fn))
+              , receiver_(std::move(receiver))
+              , first_(std::move(s).connect(_first_receiver{this}))
+            {}
+            _operation(_operation&&) = delete;
+
+            template<class... Vs>
+            void _set_value(Vs&&... vs)
+            {
+                try
+                {
+                    if constexpr(std::is_void_v<_in_t>)
+                        second_.emplace(_emplacer{[this] {
+                            return fn_().connect(_second_receiver{this});
+                        }});
+                    else
+                    {
+                        value_.return_value(static_cast<Vs&&>(vs)...);
+                        second_.emplace(_emplacer{[this] {
+                            return fn_(*value_.value_)
+                                .connect(_second_receiver{this});
+                        }});
+                    }
+                }
+                catch(...)
+                {
+                    return receiver_.set_error(std::current_exception());
+                }
+                second_->start();
+            }
+            void start() noexcept
+            {
+                first_.start();
+            }
+        };
+        template<class R>
+        _operation<R> connect(R receiver) &&
+        {
+            return {std::move(sender_), std::move(fn_), std::move(receiver)};
+        }
+        auto operator co_await() &&
+        {
+            return _sender_awaitable<_let_sender>{std::move(*this)};
+        }
+    };
+
+    template<class Fn>
+    struct _let_fn
+    {
+        Fn fn_;
+
+        CO_PP_template(class S)(
+            requires Sender<S>)
+        friend auto operator|(S s, _let_fn self)
+        {
+            return _let_sender<S, Fn>{std::move(s), std::move(self.fn_)};
+        }
+    };
+
+    CO_PP_template(class S, class Fn)(
+        requires Sender<S>)
+    auto let_value(S s, Fn fn)
+    {
+        return _let_sender<S, Fn>{std::move(s), std::move(fn)};
+    }
+    template<class Fn>
+    auto let_value(Fn fn)
+    {
+        return _let_fn<Fn>{std::move(fn)};
+    }
+
+    // The value of when_all: nothing, one value, or a completion of the
+    // values of those senders that have one.
+    template<class Values, class... Ts>
+    struct _when_all_value_;
+
+    template<class... Vs>
+    struct _when_all_value_<meta::list<Vs...>> : _async_values_<Vs...>
+    {};
+
+    template<class... Vs, class T, class... Ts>
+    struct _when_all_value_<meta::list<Vs...>, T, Ts...>
+      : _when_all_value_<meta::if_c<std::is_void_v<T>, meta::list<Vs...>,
+                                    meta::list<Vs..., T>>,
+                         Ts...>
+    {};
+
+    // Starts every sender, one after another, and completes when the last
+    // of them does, on the thread that completes it. If any fails, the
+    // others are still left to finish, and the first error is reported.
+    template<class... Ss>
+    struct _when_all_sender
+    {
+        using value_type = meta::_t<
+            _when_all_value_<meta::list<>, typename Ss::value_type...>>;
+        using sender_concept = sender_tag;
+
+        std::tuple<Ss...> senders_;
+
+        template<class R>
+        struct _operation
+        {
+            template<std::size_t I>
+            struct _receiver
+            {
+                _operation* op_;
+
+                template<class... Vs>
+                void set_value(Vs&&... vs)
+                {
+                    auto& slot = std::get<I>(op_->values_);
+                    if constexpr(sizeof...(Vs) == 0)
+                        slot.return_void();
+                    else
+                        slot.return_value(static_cast<Vs&&>(vs)...);
+                    op_->_arrive();
+                }
+                void set_error(std::exception_ptr eptr)
+                {
+                    if(!op_->failed_.exchange(true, std::memory_order_relaxed))
+                        op_->eptr_ = std::move(eptr);
+                    op_->_arrive();
+                }
+            };
+
+            template<class Is>
+            struct _ops_;
+            template<std::size_t... Is>
+            struct _ops_<std::index_sequence<Is...>>
+            {
+                using type =
+                    std::tuple<connect_result_t<Ss, _receiver<Is>>...>;
+            };
+            using _indices = std::index_sequence_for<Ss...>;
+
+            R receiver_;
+            std::tuple<_result_storage<typename Ss::value_type>...> values_{};
+            std::exception_ptr eptr_{};
+            std::atomic<bool> failed_{false};
+            std::atomic<std::size_t> pending_{sizeof...(Ss)};
+            meta::_t<_ops_<_indices>> ops_;
+
+            template<std::size_t... Is>
+            _operation(std::tuple<Ss...>&& ss, R receiver,
+                       std::index_sequence<Is...>)
+              : receiver_(std::move(receiver))
+              , ops_(_emplacer{[&ss, this] {
+                  return std::get<Is>(std::move(ss))
+                      .connect(_receiver<Is>{this});
+              }}...)
+            {}
+            _operation(std::tuple<Ss...>&& ss, R receiver)
+              : _operation(std::move(ss), std::move(receiver), _indices{})
+            {}
+            _operation(_operation&&) = delete;
+
+            template<std::size_t I>
+            auto _value()
+            {
+                auto& slot = std::get<I>(values_);
+                using S = std::tuple_element_t<I, std::tuple<Ss...>>;
+                if constexpr(std::is_void_v<typename S::value_type>)
+                    return std::tuple<>{};
+                else
+                    return std::make_tuple(std::move(*slot.value_));
+            }
+            template<std::size_t... Is>
+            void _complete(std::index_sequence<Is...>)
+            {
+                std::apply(
+                    [this](auto&&... vs) {
+                        if constexpr(sizeof...(vs) < 2)
+                            receiver_.set_value(std::move(vs)...);
+                        else
+                            receiver_.set_value(value_type{std::move(vs)...});
+                    },
+                    std::tuple_cat(_value<Is>()...));
+            }
+            void _arrive()
+            {
+                if(pending_.fetch_sub(1, std::memory_order_acq_rel) != 1)
+                    return;
+                if(failed_.load(std::memory_order_relaxed))
+                    receiver_.set_error(std::move(eptr_));
+                else
+                    _complete(_indices{});
+            }
+            void start() noexcept
+            {
+                std::apply([](auto&... ops) { (ops.start(), ...); }, ops_);
+            }
+        };
+        template<class R>
+        _operation<R> connect(R receiver) &&
+        {
+            return {std::move(senders_), std::move(receiver)};
+        }
+        auto operator co_await() &&
+        {
+            return _sender_awaitable<_when_all_sender>{std::move(*this)};
+        }
+    };
+
+    CO_PP_template(class... Ss)(
+        requires (Sender<Ss> && ...))
+    auto when_all(Ss... ss)
+    {
+        return _when_all_sender<Ss...>{{std::move(ss)...}};
+    }
+} // namespace coronet
+
+namespace std::experimental::net
+{
+    template<class Executor, class Allocator, class Ret, class... Args>
+    struct async_result<coronet::as_sender_t<Executor, Allocator>,
+                        Ret(Args...)>
+      : coronet::_async_result_impl_<coronet::as_sender_t<Executor, Allocator>,
+                                     Ret, meta::list<std::decay_t<Args>...>,
+                                     meta::quote<coronet::sender>>
+    {
+        using async_result::_async_result_impl_::_async_result_impl_;
+    };
+} // namespace std::experimental::net
+
+namespace std::experimental
+{
+    template<class T, class Token, class... Args>
+    struct coroutine_traits<coronet::sender<T, Token>, Args...>
+    {
+        using promise_type = typename coronet::sender<T, Token>::promise_type;
+    };
+} // namespace std::experimental
+
+#endif
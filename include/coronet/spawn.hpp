@@ -0,0 +1,110 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+//
+#ifndef CORONET_SPAWN_HPP
+#define CORONET_SPAWN_HPP
+
+#include <exception>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <experimental/coroutine>
+
+#include <coronet/coronet.hpp>
+
+namespace coronet
+{
+    // A detached coroutine that starts suspended so that it can be handed to
+    // an executor, and that destroys itself when it completes.
+    struct _spawned
+    {
+        struct promise_type
+        {
+            _spawned get_return_object() noexcept
+            {
+                return _spawned{std::experimental::coroutine_handle<
+                    promise_type>::from_promise(*this)};
+            }
+            std::experimental::suspend_always initial_suspend() const noexcept
+            {
+                return {};
+            }
+            std::experimental::suspend_never final_suspend() const noexcept
+            {
+                return {};
+            }
+            [[noreturn]] void unhandled_exception() noexcept
+            {
+                // There is nobody to report the error to.
+                std::terminate();
+            }
+            void return_void() noexcept {}
+        };
+        std::experimental::coroutine_handle<promise_type> coro_;
+    };
+
+    template<class Fn, class Token>
+    _spawned _spawn_one(Fn fun, Token token)
+    {
+        // The spawned operation runs in token's execution context, as if it
+        // were awaited by a coroutine that had been given token.
+        using Alloc = std::decay_t<decltype(token.get_allocator())>;
+        _execution_context ctx{token};
+        (void)co_await std::move(fun)(
+            _implicit_yield_t<Alloc>{token.get_allocator(), &ctx});
+    }
+
+    // Launch one detached operation per element of rng. Each element is an
+    // asynchronous operation that has not yet been given its completion
+    // token, such as the result of `async_stuff1(42)`. All the operations
+    // are enqueued on token's executor with a single bulk_post. If one of
+    // them exits with an exception, std::terminate is called. If enqueuing
+    // fails, the operations that were not enqueued are destroyed before
+    // the exception is rethrown; with an executor that has a bulk_post of
+    // its own, that is all of them.
+    CO_PP_template(class Rng, class Token)(
+        requires CompletionToken<Token>)
+    void spawn_all(Rng&& rng, Token token)
+    {
+        using handle_t = std::experimental::coroutine_handle<>;
+        auto alloc = coronet::get_allocator(token);
+        std::vector<handle_t, rebind_alloc<decltype(alloc), handle_t>> coros(
+            alloc);
+        try
+        {
+            for(auto&& fun : rng)
+                coros.push_back(_spawn_one(fun, token).coro_);
+        }
+        catch(...)
+        {
+            for(auto coro : coros)
+                coro.destroy();
+            throw;
+        }
+        auto first = coros.begin();
+        try
+        {
+            coronet::_bulk_post(
+                coronet::get_executor(token), first, coros.end(), alloc);
+        }
+        catch(...)
+        {
+            for(; first != coros.end(); ++first)
+                first->destroy();
+            throw;
+        }
+    }
+} // namespace coronet
+
+#endif
@@ -0,0 +1,306 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+//
+#ifndef CORONET_SYNCHRONIZATION_HPP
+#define CORONET_SYNCHRONIZATION_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#include <experimental/coroutine>
+
+#include <coronet/coronet.hpp>
+#include <coronet/detail/waiter.hpp>
+
+namespace coronet
+{
+    // A mutex whose lock operation suspends the calling coroutine instead of
+    // blocking its thread. Locking an unlocked mutex is a single CAS. When
+    // the mutex is contended, ownership is handed directly to the oldest
+    // waiter, which is resumed on its own executor.
+    //
+    // Use it with std::lock_guard or std::unique_lock and std::adopt_lock to
+    // unlock at scope exit:
+    //
+    //     co_await m.async_lock();
+    //     std::lock_guard<coronet::async_mutex> g{m, std::adopt_lock};
+    struct async_mutex
+    {
+    private:
+        // state_ is _unlocked, _locked (with no new waiters), or a pointer
+        // to a LIFO stack of waiters that arrived since the last unlock.
+        static constexpr std::uintptr_t _unlocked = 1;
+        static constexpr std::uintptr_t _locked = 0;
+        std::atomic<std::uintptr_t> state_{_unlocked};
+        // FIFO list of waiters, owned by whoever holds the lock.
+        _waiter* waiters_ = nullptr;
+
+        struct _lock_awaitable : _waiter
+        {
+            async_mutex* mtx_;
+
+            explicit _lock_awaitable(async_mutex* mtx) noexcept
+              : mtx_(mtx)
+            {}
+            bool await_ready() const noexcept
+            {
+                return mtx_->try_lock();
+            }
+            template<class Promise>
+            bool await_suspend(
+                std::experimental::coroutine_handle<Promise> awaiter)
+            {
+                set_coroutine(awaiter);
+                auto old = mtx_->state_.load(std::memory_order_acquire);
+                for(;;)
+                {
+                    if(old == _unlocked)
+                    {
+                        if(mtx_->state_.compare_exchange_weak(
+                               old, _locked, std::memory_order_acquire,
+                               std::memory_order_relaxed))
+                            return false;
+                    }
+                    else
+                    {
+                        next_ = reinterpret_cast<_waiter*>(old);
+                        if(mtx_->state_.compare_exchange_weak(
+                               old, reinterpret_cast<std::uintptr_t>(
+                                        static_cast<_waiter*>(this)),
+                               std::memory_order_release,
+                               std::memory_order_relaxed))
+                            return true;
+                    }
+                }
+            }
+            static void await_resume() noexcept {}
+        };
+
+    public:
+        async_mutex() = default;
+        async_mutex(async_mutex&&) = delete;
+        ~async_mutex()
+        {
+            assert(state_.load(std::memory_order_relaxed) == _unlocked);
+        }
+
+        bool try_lock() noexcept
+        {
+            auto old = _unlocked;
+            return state_.compare_exchange_strong(old, _locked,
+                                                  std::memory_order_acquire,
+                                                  std::memory_order_relaxed);
+        }
+
+        // Release the lock, or hand it to the oldest waiter.
+        void unlock()
+        {
+            _waiter* head = waiters_;
+            if(!head)
+            {
+                auto old = _locked;
+                if(state_.compare_exchange_strong(old, _unlocked,
+                                                  std::memory_order_release,
+                                                  std::memory_order_relaxed))
+                    return;
+                // New waiters arrived. Take them and put them in FIFO order.
+                old = state_.exchange(_locked, std::memory_order_acquire);
+                for(auto* w = reinterpret_cast<_waiter*>(old); w;)
+                {
+                    auto* next = w->next_;
+                    w->next_ = head;
+                    head = w;
+                    w = next;
+                }
+            }
+            waiters_ = head->next_;
+            head->resume();
+        }
+
+        CO_PP_template(class Token)(
+            requires CompletionToken<Token>)
+        auto async_lock(Token token) -> result_t<Token, void()>
+        {
+            INITIAL_SUSPEND(token);
+            co_await _lock_awaitable{this};
+        }
+        auto async_lock()
+        {
+            return callable_with_implicit_context{
+                [this](auto token) { return this->async_lock(token); }};
+        }
+    };
+
+    // A counting semaphore whose acquire operation suspends the calling
+    // coroutine instead of blocking its thread. Acquiring while the count is
+    // positive is a single CAS. Releases hand their units directly to
+    // waiters, oldest first, and each waiter is resumed on its own executor.
+    struct async_semaphore
+    {
+    private:
+        // Invariant: if there are waiters, count_ is zero.
+        std::atomic<std::ptrdiff_t> count_;
+        std::mutex mtx_;
+        _waiter_queue waiters_;
+
+        struct _acquire_awaitable : _waiter
+        {
+            async_semaphore* sem_;
+
+            explicit _acquire_awaitable(async_semaphore* sem) noexcept
+              : sem_(sem)
+            {}
+            bool await_ready() const noexcept
+            {
+                return sem_->try_acquire();
+            }
+            template<class Promise>
+            bool await_suspend(
+                std::experimental::coroutine_handle<Promise> awaiter)
+            {
+                set_coroutine(awaiter);
+                std::lock_guard<std::mutex> lock{sem_->mtx_};
+                if(sem_->try_acquire())
+                    return false;
+                sem_->waiters_.push(this);
+                return true;
+            }
+            static void await_resume() noexcept {}
+        };
+
+    public:
+        explicit async_semaphore(std::ptrdiff_t initial)
+          : count_(initial)
+        {}
+        async_semaphore(async_semaphore&&) = delete;
+
+        bool try_acquire() noexcept
+        {
+            auto old = count_.load(std::memory_order_relaxed);
+            while(old > 0)
+                if(count_.compare_exchange_weak(old, old - 1,
+                                                std::memory_order_acquire,
+                                                std::memory_order_relaxed))
+                    return true;
+            return false;
+        }
+
+        void release(std::ptrdiff_t n = 1)
+        {
+            _waiter_queue woken;
+            {
+                std::lock_guard<std::mutex> lock{mtx_};
+                for(; n != 0; --n)
+                {
+                    auto* w = waiters_.pop();
+                    if(!w)
+                        break;
+                    woken.push(w);
+                }
+                count_.fetch_add(n, std::memory_order_release);
+            }
+            _resume_all(woken.take_all());
+        }
+
+        CO_PP_template(class Token)(
+            requires CompletionToken<Token>)
+        auto async_acquire(Token token) -> result_t<Token, void()>
+        {
+            INITIAL_SUSPEND(token);
+            co_await _acquire_awaitable{this};
+        }
+        auto async_acquire()
+        {
+            return callable_with_implicit_context{
+                [this](auto token) { return this->async_acquire(token); }};
+        }
+    };
+
+    // A single-use countdown latch. async_wait suspends the calling
+    // coroutine until the count reaches zero, then resumes it on its own
+    // executor.
+    struct async_latch
+    {
+    private:
+        std::atomic<std::ptrdiff_t> count_;
+        std::mutex mtx_;
+        _waiter_queue waiters_;
+
+        struct _wait_awaitable : _waiter
+        {
+            async_latch* latch_;
+
+            explicit _wait_awaitable(async_latch* latch) noexcept
+              : latch_(latch)
+            {}
+            bool await_ready() const noexcept
+            {
+                return latch_->try_wait();
+            }
+            template<class Promise>
+            bool await_suspend(
+                std::experimental::coroutine_handle<Promise> awaiter)
+            {
+                set_coroutine(awaiter);
+                std::lock_guard<std::mutex> lock{latch_->mtx_};
+                if(latch_->try_wait())
+                    return false;
+                latch_->waiters_.push(this);
+                return true;
+            }
+            static void await_resume() noexcept {}
+        };
+
+    public:
+        explicit async_latch(std::ptrdiff_t count)
+          : count_(count)
+        {}
+        async_latch(async_latch&&) = delete;
+
+        bool try_wait() const noexcept
+        {
+            return count_.load(std::memory_order_acquire) <= 0;
+        }
+
+        void count_down(std::ptrdiff_t n = 1)
+        {
+            auto old = count_.fetch_sub(n, std::memory_order_acq_rel);
+            if(old > 0 && old - n <= 0)
+            {
+                _waiter* waiters;
+                {
+                    std::lock_guard<std::mutex> lock{mtx_};
+                    waiters = waiters_.take_all();
+                }
+                _resume_all(waiters);
+            }
+        }
+
+        CO_PP_template(class Token)(
+            requires CompletionToken<Token>)
+        auto async_wait(Token token) -> result_t<Token, void()>
+        {
+            INITIAL_SUSPEND(token);
+            co_await _wait_awaitable{this};
+        }
+        auto async_wait()
+        {
+            return callable_with_implicit_context{
+                [this](auto token) { return this->async_wait(token); }};
+        }
+    };
+} // namespace coronet
+
+#endif
@@ -0,0 +1,324 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+//
+#ifndef CORONET_TASK_SCOPE_HPP
+#define CORONET_TASK_SCOPE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#include <experimental/coroutine>
+
+#include <coronet/coronet.hpp>
+#include <coronet/detail/waiter.hpp>
+
+namespace coronet
+{
+    // A place to start detached operations that can still be waited for.
+    // Each operation is started in the execution context of a token of its
+    // own, as spawn_all does, and is counted as live until its frame is
+    // gone. async_join completes when nothing is live, so once it has
+    // completed the scope can be destroyed without leaking or cutting short
+    // anything it started.
+    //
+    // With a concurrency limit, async_spawn suspends the spawner until an
+    // operation finishes and hands it a slot. request_stop fails the
+    // spawners that are waiting, and tells the operations already started
+    // through stop_requested. An exception from an operation stops the
+    // scope too, and async_join rethrows it to every joiner. A stopped
+    // scope stays stopped.
+    //
+    // The live count and the flags share one atomic word. Starting and
+    // finishing an operation with nobody waiting touches only that word;
+    // the waiter queues and their mutex are for the slow paths.
+    struct task_scope
+    {
+    private:
+        static constexpr std::uint64_t _stopped = std::uint64_t(1) << 63;
+        static constexpr std::uint64_t _waiting = std::uint64_t(1) << 62;
+        static constexpr std::uint64_t _count = _waiting - 1;
+
+        std::atomic<std::uint64_t> state_{0};
+        std::uint64_t const limit_;
+        std::mutex mtx_;
+        _waiter_queue spawners_;
+        _waiter_queue joiners_;
+        std::exception_ptr eptr_{};
+
+        bool _try_acquire() noexcept
+        {
+            auto old = state_.load(std::memory_order_relaxed);
+            while(!(old & _stopped) && (old & _count) < limit_)
+                if(state_.compare_exchange_weak(old, old + 1,
+                                                std::memory_order_acquire,
+                                                std::memory_order_relaxed))
+                    return true;
+            return false;
+        }
+        // Called with mtx_ held, once the queues have been changed.
+        void _update_waiting() noexcept
+        {
+            if(spawners_.empty() && joiners_.empty())
+                state_.fetch_and(~_waiting, std::memory_order_relaxed);
+            else
+                state_.fetch_or(_waiting, std::memory_order_relaxed);
+        }
+        void _finish()
+        {
+            auto const old = state_.fetch_sub(1, std::memory_order_acq_rel);
+            if(!(old & _waiting))
+                return;
+            _waiter_queue woken;
+            {
+                std::lock_guard<std::mutex> lock{mtx_};
+                // Hand freed slots straight to the oldest spawners.
+                while(!spawners_.empty() && _try_acquire())
+                    woken.push(spawners_.pop());
+                if((state_.load(std::memory_order_acquire) & _count) == 0)
+                    while(auto* w = joiners_.pop())
+                        woken.push(w);
+                _update_waiting();
+            }
+            _resume_all(woken.take_all());
+        }
+        void _fail(std::exception_ptr eptr)
+        {
+            {
+                std::lock_guard<std::mutex> lock{mtx_};
+                if(!eptr_)
+                    eptr_ = std::move(eptr);
+            }
+            request_stop();
+        }
+
+        struct _spawn_awaitable : _waiter
+        {
+            task_scope* scope_;
+            bool stopped_ = false;
+
+            explicit _spawn_awaitable(task_scope* scope) noexcept
+              : scope_(scope)
+            {}
+            bool await_ready() const noexcept
+            {
+                return scope_->_try_acquire();
+            }
+            template<class Promise>
+            bool await_suspend(
+                std::experimental::coroutine_handle<Promise> awaiter)
+            {
+                set_coroutine(awaiter);
+                std::lock_guard<std::mutex> lock{scope_->mtx_};
+                // Announce the wait before trying again, so that an
+                // operation that finishes in between sees it.
+                scope_->state_.fetch_or(_waiting, std::memory_order_relaxed);
+                if(scope_->_try_acquire() ||
+                   (stopped_ = scope_->stop_requested()))
+                {
+                    scope_->_update_waiting();
+                    return false;
+                }
+                scope_->spawners_.push(this);
+                return true;
+            }
+            void await_resume() const
+            {
+                if(stopped_)
+                    throw std::system_error(
+                        std::make_error_code(std::errc::operation_canceled));
+            }
+        };
+
+        struct _join_awaitable : _waiter
+        {
+            task_scope* scope_;
+
+            explicit _join_awaitable(task_scope* scope) noexcept
+              : scope_(scope)
+            {}
+            bool await_ready() const noexcept
+            {
+                return scope_->size() == 0;
+            }
+            template<class Promise>
+            bool await_suspend(
+                std::experimental::coroutine_handle<Promise> awaiter)
+            {
+                set_coroutine(awaiter);
+                std::lock_guard<std::mutex> lock{scope_->mtx_};
+                scope_->state_.fetch_or(_waiting, std::memory_order_relaxed);
+                if(scope_->size() == 0)
+                {
+                    scope_->_update_waiting();
+                    return false;
+                }
+                scope_->joiners_.push(this);
+                return true;
+            }
+            void await_resume() const
+            {
+                std::exception_ptr eptr;
+                {
+                    std::lock_guard<std::mutex> lock{scope_->mtx_};
+                    eptr = scope_->eptr_;
+                }
+                if(eptr)
+                    std::rethrow_exception(eptr);
+            }
+        };
+
+        // The callback of an operation started in the scope. void_ invokes
+        // it only after it has freed the operation's frame.
+        struct _done
+        {
+            task_scope* scope_;
+
+            template<class E, class... Ts>
+            void operator()(E const& error, Ts&&...) const
+            {
+                if constexpr(std::is_same_v<E, std::exception_ptr>)
+                    if(error)
+                        scope_->_fail(error);
+                scope_->_finish();
+            }
+        };
+
+        // Start fun in token's context, in a slot already acquired. The
+        // operation's own frame is all that is allocated.
+        template<class Fn, class Token>
+        void _start(Fn fun, Token const& token)
+        {
+            static_assert(!meta::is<Token, _implicit_yield_t>::value,
+                          "An operation that outlives its spawner needs an "
+                          "execution context of its own, such as yield(e).");
+            try
+            {
+                (void)std::move(fun)(
+                    _done{this} | via(coronet::get_executor(token),
+                                      coronet::get_allocator(token)));
+            }
+            catch(...)
+            {
+                _finish();
+                throw;
+            }
+        }
+
+    public:
+        // Allow any number of operations to be live at once.
+        task_scope() noexcept
+          : limit_(_count)
+        {}
+        // Allow at most max_concurrency operations to be live at once.
+        explicit task_scope(std::size_t max_concurrency) noexcept
+          : limit_((std::min)(std::uint64_t(max_concurrency), _count))
+        {}
+        task_scope(task_scope&&) = delete;
+        ~task_scope()
+        {
+            assert(size() == 0 && spawners_.empty() && joiners_.empty());
+        }
+
+        // The number of operations started and not yet finished.
+        std::size_t size() const noexcept
+        {
+            return static_cast<std::size_t>(
+                state_.load(std::memory_order_acquire) & _count);
+        }
+        std::size_t max_concurrency() const noexcept
+        {
+            return static_cast<std::size_t>(limit_);
+        }
+        bool stop_requested() const noexcept
+        {
+            return (state_.load(std::memory_order_acquire) & _stopped) != 0;
+        }
+
+        // Stop starting operations. Waiting and future spawns fail with
+        // std::errc::operation_canceled. Started ones are left to finish.
+        void request_stop()
+        {
+            state_.fetch_or(_stopped, std::memory_order_release);
+            _waiter* spawners;
+            {
+                std::lock_guard<std::mutex> lock{mtx_};
+                spawners = spawners_.take_all();
+                _update_waiting();
+            }
+            for(auto* w = spawners; w; w = w->next_)
+                static_cast<_spawn_awaitable*>(w)->stopped_ = true;
+            _resume_all(spawners);
+        }
+
+        // Start fun, an asynchronous operation that has not yet been given
+        // its completion token, such as the result of `async_stuff1(42)`,
+        // in the execution context of ctx, if the scope has a free slot.
+        // Returns false, and starts nothing, if it has none or is stopped.
+        CO_PP_template(class Fn, class Ctx)(
+            requires CompletionToken<Ctx>)
+        bool try_spawn(Fn fun, Ctx const& ctx)
+        {
+            if(!_try_acquire())
+                return false;
+            _start(std::move(fun), ctx);
+            return true;
+        }
+
+        // Wait for a free slot, then start fun in the execution context of
+        // ctx, and complete. Fails with std::errc::operation_canceled if the
+        // scope is stopped first.
+        CO_PP_template(class Fn, class Ctx, class Token)(
+            requires CompletionToken<Ctx> && CompletionToken<Token>)
+        auto async_spawn(Fn fun, Ctx ctx, Token token)
+            -> result_t<Token, void(Fn, Ctx)>
+        {
+            INITIAL_SUSPEND(token);
+            co_await _spawn_awaitable{this};
+            _start(std::move(fun), ctx);
+        }
+        CO_PP_template(class Fn, class Ctx)(
+            requires CompletionToken<Ctx>)
+        auto async_spawn(Fn fun, Ctx ctx)
+        {
+            return callable_with_implicit_context{
+                [this, fun = std::move(fun), ctx](auto token) mutable {
+                    return this->async_spawn(std::move(fun), ctx, token);
+                }};
+        }
+
+        // Wait until no operation is live, then rethrow the first exception
+        // that one exited with, if any.
+        CO_PP_template(class Token)(
+            requires CompletionToken<Token>)
+        auto async_join(Token token) -> result_t<Token, void()>
+        {
+            INITIAL_SUSPEND(token);
+            co_await _join_awaitable{this};
+        }
+        auto async_join()
+        {
+            return callable_with_implicit_context{
+                [this](auto token) { return this->async_join(token); }};
+        }
+    };
+} // namespace coronet
+
+#endif
@@ -0,0 +1,296 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+//
+#ifndef CORONET_THREAD_POOL_HPP
+#define CORONET_THREAD_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <coronet/affinity.hpp>
+#include <coronet/coronet.hpp>
+#include <coronet/metrics.hpp>
+
+namespace coronet
+{
+    // A fixed-size pool of threads. There is one work queue per NUMA node
+    // of the pool's topology, serviced by worker threads pinned to that
+    // node's CPUs. Work posted through an executor with an affinity goes to
+    // that node's queue; other work goes to the poster's own node when
+    // posted from a worker, and to a node with idle workers otherwise.
+    //
+    // The executor supports bulk_post, so a batch of N work items is
+    // published under one lock acquisition and wakes at most min(N, idle)
+    // threads.
+    //
+    // metrics() reports the pool's queue depth, post counts, sampled
+    // post-to-run latency, and the time its workers spent idle.
+    struct thread_pool
+    {
+    private:
+        struct _item
+        {
+            std::function<void()> fun_;
+            _post_stamp stamp_;
+        };
+
+        struct _queue
+        {
+            std::mutex mtx_;
+            std::condition_variable cv_;
+            std::deque<_item> items_;
+            // Written under the lock, but read without it to pick a queue.
+            std::atomic<std::size_t> idle_{0};
+            bool stop_ = false;
+
+            void run(_executor_counters& counters)
+            {
+                std::unique_lock<std::mutex> lock{mtx_};
+                for(;;)
+                {
+                    while(items_.empty())
+                    {
+                        if(stop_)
+                            return;
+                        ++idle_;
+                        auto const since = counters.idle_begin();
+                        cv_.wait(lock);
+                        counters.idle_end(since);
+                        --idle_;
+                    }
+                    auto item = std::move(items_.front());
+                    items_.pop_front();
+                    lock.unlock();
+                    counters.on_start(item.stamp_);
+                    item.fun_();
+                    lock.lock();
+                }
+            }
+            void wake(std::size_t n)
+            {
+                for(; n != 0; --n)
+                    cv_.notify_one();
+            }
+        };
+
+        struct _state
+        {
+            coronet::topology topo_;
+            std::vector<_queue> queues_;
+            std::atomic<std::size_t> next_{0};
+            _executor_counters counters_;
+
+            explicit _state(coronet::topology topo)
+              : topo_(std::move(topo))
+              , queues_((std::max)(std::size_t(1), topo_.node_count()))
+            {}
+            int node_of(affinity aff) const noexcept
+            {
+                if(aff.node < 0 && aff.core >= 0)
+                    return topo_.node_of(aff.core);
+                return aff.node;
+            }
+            _queue& queue_for(int node) noexcept
+            {
+                auto const n = queues_.size();
+                if(node >= 0)
+                    return queues_[static_cast<std::size_t>(node) % n];
+                auto const& cur = thread_pool::_current();
+                if(cur.first == this)
+                    return queues_[static_cast<std::size_t>(cur.second)];
+                auto const start = next_++;
+                for(std::size_t i = 0; i < n; ++i)
+                {
+                    auto& q = queues_[(start + i) % n];
+                    if(q.idle_.load(std::memory_order_relaxed) != 0)
+                        return q;
+                }
+                return queues_[start % n];
+            }
+            // Whether posting to q from this thread leaves the poster's node.
+            bool is_remote(_queue const& q) const noexcept
+            {
+                auto const& cur = thread_pool::_current();
+                return cur.first == this &&
+                    &q != &queues_[static_cast<std::size_t>(cur.second)];
+            }
+        };
+
+        // Which pool and node, if any, the calling thread is a worker of.
+        static std::pair<_state const*, int>& _current() noexcept
+        {
+            static thread_local std::pair<_state const*, int> cur{nullptr, -1};
+            return cur;
+        }
+
+        // Executors hold a pointer to the state, so it must not move.
+        std::unique_ptr<_state> state_;
+        std::vector<std::thread> threads_;
+
+        void _start(std::size_t threads_per_node, bool pin)
+        {
+            auto const nodes = state_->queues_.size();
+            threads_.reserve(nodes * threads_per_node);
+            for(std::size_t node = 0; node < nodes; ++node)
+                for(std::size_t i = 0; i < threads_per_node; ++i)
+                    threads_.emplace_back(
+                        [state = state_.get(), node, pin] {
+                            if(pin)
+                                _pin_this_thread(state->topo_.cpus(node));
+                            _current() = {state, static_cast<int>(node)};
+                            state->queues_[node].run(state->counters_);
+                        });
+        }
+
+    public:
+        struct executor_type
+        {
+        private:
+            friend thread_pool;
+            _state* state_;
+            int node_;
+            explicit executor_type(_state* state, int node) noexcept
+              : state_(state)
+              , node_(node)
+            {}
+
+        public:
+            CO_PP_template(class F, class A)(
+                requires Invocable<F&> && Allocator<A>)
+            void post(F fun, A const&) const
+            {
+                auto& q = state_->queue_for(node_);
+                auto const stamp =
+                    state_->counters_.on_post(1, state_->is_remote(q));
+                std::size_t wake = 0;
+                {
+                    std::lock_guard<std::mutex> lock{q.mtx_};
+                    q.items_.push_back({std::move(fun), stamp});
+                    wake = q.idle_ != 0;
+                }
+                q.wake(wake);
+            }
+            CO_PP_template(class I, class S, class A)(
+                requires Allocator<A>)
+            void bulk_post(I first, S last, A const&) const
+            {
+                auto& q = state_->queue_for(node_);
+                std::size_t wake = 0;
+                {
+                    std::lock_guard<std::mutex> lock{q.mtx_};
+                    auto const begin = q.items_.size();
+                    try
+                    {
+                        for(; first != last; ++first)
+                            q.items_.push_back({*first, {}});
+                    }
+                    catch(...)
+                    {
+                        // All or nothing: take back what was queued.
+                        while(q.items_.size() != begin)
+                            q.items_.pop_back();
+                        throw;
+                    }
+                    auto const n = q.items_.size() - begin;
+                    if(n != 0)
+                        q.items_[begin].stamp_ =
+                            state_->counters_.on_post(n, state_->is_remote(q));
+                    wake = (std::min)(n, q.idle_.load());
+                }
+                q.wake(wake);
+            }
+            affinity get_affinity() const noexcept
+            {
+                return affinity{node_};
+            }
+            executor_type with_affinity(affinity aff) const noexcept
+            {
+                return executor_type{state_, state_->node_of(aff)};
+            }
+            friend bool operator==(executor_type a, executor_type b) noexcept
+            {
+                return a.state_ == b.state_ && a.node_ == b.node_;
+            }
+            friend bool operator!=(executor_type a, executor_type b) noexcept
+            {
+                return !(a == b);
+            }
+        };
+
+        // nthreads unpinned workers sharing one queue.
+        explicit thread_pool(std::size_t nthreads = (std::max)(
+                                 1u, std::thread::hardware_concurrency()))
+          : state_(std::make_unique<_state>(coronet::topology{}))
+        {
+            _start(nthreads, false);
+        }
+        // threads_per_node workers for each node of topo, pinned to the
+        // node's CPUs, with one queue per node.
+        thread_pool(coronet::topology topo, std::size_t threads_per_node)
+          : state_(std::make_unique<_state>(std::move(topo)))
+        {
+            _start(threads_per_node, state_->topo_.node_count() != 0);
+        }
+        thread_pool(thread_pool&&) = delete;
+        ~thread_pool()
+        {
+            join();
+        }
+        coronet::topology const& topology() const noexcept
+        {
+            return state_->topo_;
+        }
+        // The node whose queue the calling thread serves, if it is one of
+        // the pool's workers, and -1 otherwise.
+        int current_node() const noexcept
+        {
+            auto const& cur = _current();
+            return cur.first == state_.get() ? cur.second : -1;
+        }
+        executor_type get_executor(affinity aff = {}) const noexcept
+        {
+            return executor_type{state_.get(), state_->node_of(aff)};
+        }
+        executor_metrics metrics() const
+        {
+            return state_->counters_.snapshot();
+        }
+        // Let the worker threads drain the queues, then wait for them to
+        // exit.
+        void join()
+        {
+            for(auto& q : state_->queues_)
+            {
+                {
+                    std::lock_guard<std::mutex> lock{q.mtx_};
+                    q.stop_ = true;
+                }
+                q.cv_.notify_all();
+            }
+            for(auto& t : threads_)
+                if(t.joinable())
+                    t.join();
+        }
+    };
+} // namespace coronet
+
+#endif
@@ -0,0 +1,264 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+//
+#ifndef CORONET_TRACE_HPP
+#define CORONET_TRACE_HPP
+
+// Define as 1 to record where coroutine frames suspend and resume, for
+// write_trace. Otherwise the hooks expand to nothing.
+#ifndef CORONET_TRACE
+#define CORONET_TRACE 0
+#endif
+
+#if CORONET_TRACE
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <typeinfo>
+#include <vector>
+#if defined(__GNUC__) || defined(__clang__)
+#include <cxxabi.h>
+#include <cstdlib>
+#endif
+#endif
+
+namespace coronet
+{
+#if CORONET_TRACE
+    enum class _trace_kind : unsigned char
+    {
+        await_inline,  // frame awaits other, which runs on this thread
+        await_posted,  // frame awaits other, which is posted to detail
+        resume,        // frame resumes after an await
+        complete,      // frame finishes and resumes its awaiter, other
+        repost,        // frame is posted back to its awaiter's executor
+        spawn,         // frame is a detached operation posted to detail
+        callback       // frame finishes and invokes its callback
+    };
+
+    struct _trace_event
+    {
+        std::uint64_t ns_;
+        void const* frame_;
+        void const* other_;
+        char const* detail_; // A string with static storage duration.
+        _trace_kind kind_;
+    };
+
+    // Each thread records into a ring buffer of its own, so recording is
+    // a store and a release increment. When a buffer fills up, the oldest
+    // events are overwritten. Only the owning thread writes head_; the
+    // events before cleared_ have been forgotten by clear_trace, which
+    // along with write_trace touches cleared_ only under the registry's
+    // mutex.
+    struct _trace_buffer
+    {
+        static constexpr std::size_t capacity = std::size_t(1) << 16;
+        std::unique_ptr<_trace_event[]> events_{new _trace_event[capacity]};
+        std::atomic<std::uint64_t> head_{0};
+        std::uint64_t cleared_ = 0;
+        unsigned tid_ = 0;
+
+        void push(_trace_event const& e) noexcept
+        {
+            auto const h = head_.load(std::memory_order_relaxed);
+            events_[h & (capacity - 1)] = e;
+            head_.store(h + 1, std::memory_order_release);
+        }
+    };
+
+    // Buffers outlive their threads, so events survive until written.
+    struct _trace_registry
+    {
+        std::mutex mtx_;
+        std::vector<std::shared_ptr<_trace_buffer>> buffers_;
+
+        static _trace_registry& get() noexcept
+        {
+            static _trace_registry registry;
+            return registry;
+        }
+        std::shared_ptr<_trace_buffer> add()
+        {
+            auto buf = std::make_shared<_trace_buffer>();
+            std::lock_guard<std::mutex> lock{mtx_};
+            buf->tid_ = static_cast<unsigned>(buffers_.size() + 1);
+            buffers_.push_back(buf);
+            return buf;
+        }
+    };
+
+    inline void _trace(_trace_kind kind, void const* frame,
+                       void const* other = nullptr,
+                       char const* detail = nullptr) noexcept
+    {
+        static thread_local std::shared_ptr<_trace_buffer> const buf =
+            _trace_registry::get().add();
+        buf->push({static_cast<std::uint64_t>(
+                       std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now().time_since_epoch())
+                           .count()),
+                   frame, other, detail, kind});
+    }
+
+    inline std::string _trace_type_name(char const* name)
+    {
+        std::string s = name ? name : "";
+#if defined(__GNUC__) || defined(__clang__)
+        int status = 0;
+        if(char* d = abi::__cxa_demangle(name, nullptr, nullptr, &status))
+        {
+            s = d;
+            std::free(d);
+        }
+#endif
+        std::string out;
+        for(char c : s)
+        {
+            if(c == '"' || c == '\\')
+                out += '\\';
+            out += c;
+        }
+        return out;
+    }
+
+    // Write the recorded events as a Chrome trace, for chrome://tracing or
+    // ui.perfetto.dev, and return whether the file was written. Each await
+    // is an async slice on the awaiting frame, from its suspension to its
+    // resumption on whichever thread its executor ran it. Call this when
+    // the traced work has quiesced.
+    inline bool write_trace(char const* path)
+    {
+        struct entry
+        {
+            _trace_event e;
+            unsigned tid;
+        };
+        std::vector<entry> all;
+        {
+            auto& registry = _trace_registry::get();
+            std::lock_guard<std::mutex> lock{registry.mtx_};
+            for(auto const& buf : registry.buffers_)
+            {
+                auto const head = buf->head_.load(std::memory_order_acquire);
+                auto const n = (std::min)(head - buf->cleared_,
+                                          std::uint64_t(buf->capacity));
+                for(auto i = head - n; i != head; ++i)
+                    all.push_back(
+                        {buf->events_[i & (buf->capacity - 1)], buf->tid_});
+            }
+        }
+        std::stable_sort(all.begin(), all.end(), [](auto& a, auto& b) {
+            return a.e.ns_ < b.e.ns_;
+        });
+
+        std::FILE* out = std::fopen(path, "w");
+        if(!out)
+            return false;
+        std::map<char const*, std::string> names;
+        auto const name_of = [&](char const* s) -> std::string const& {
+            auto it = names.find(s);
+            if(it == names.end())
+                it = names.emplace(s, _trace_type_name(s)).first;
+            return it->second;
+        };
+        // Resumes with no matching await, because the buffer wrapped or
+        // the await was ready, are dropped.
+        std::set<void const*> suspended;
+        auto const t0 = all.empty() ? 0 : all.front().e.ns_;
+        char const* sep = "";
+        std::fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+        for(auto const& entry : all)
+        {
+            auto const& e = entry.e;
+            auto const ts = static_cast<double>(e.ns_ - t0) / 1000;
+            auto const common = [&](char const* name, char const* ph) {
+                std::fprintf(out,
+                             "%s\n{\"name\":\"%s\",\"cat\":\"coronet\","
+                             "\"ph\":\"%s\",\"ts\":%.3f,\"pid\":1,"
+                             "\"tid\":%u,\"id\":\"%p\"",
+                             sep, name, ph, ts, entry.tid, e.frame_);
+                sep = ",";
+            };
+            switch(e.kind_)
+            {
+            case _trace_kind::await_inline:
+            case _trace_kind::await_posted:
+                suspended.insert(e.frame_);
+                common("await", "b");
+                std::fprintf(
+                    out, ",\"args\":{\"callee\":\"%p\",\"executor\":\"%s\"}}",
+                    e.other_,
+                    e.kind_ == _trace_kind::await_inline
+                        ? "inline"
+                        : name_of(e.detail_).c_str());
+                break;
+            case _trace_kind::resume:
+                if(!suspended.erase(e.frame_))
+                    continue;
+                common("await", "e");
+                std::fprintf(out, "}");
+                break;
+            case _trace_kind::complete:
+                common("complete", "n");
+                std::fprintf(out, ",\"args\":{\"awaiter\":\"%p\"}}", e.other_);
+                break;
+            case _trace_kind::repost:
+                common("repost", "n");
+                std::fprintf(out, ",\"args\":{\"executor\":\"%s\"}}",
+                             name_of(e.detail_).c_str());
+                break;
+            case _trace_kind::spawn:
+                common("spawn", "n");
+                std::fprintf(out, ",\"args\":{\"executor\":\"%s\"}}",
+                             name_of(e.detail_).c_str());
+                break;
+            case _trace_kind::callback:
+                common("callback", "n");
+                std::fprintf(out, "}");
+                break;
+            }
+        }
+        std::fprintf(out, "\n]}\n");
+        return std::fclose(out) == 0;
+    }
+
+    // Forget the events recorded so far. Threads may go on recording.
+    inline void clear_trace()
+    {
+        auto& registry = _trace_registry::get();
+        std::lock_guard<std::mutex> lock{registry.mtx_};
+        for(auto const& buf : registry.buffers_)
+            buf->cleared_ = buf->head_.load(std::memory_order_acquire);
+    }
+
+#define CORONET_TRACE_EVENT(...) ::coronet::_trace(__VA_ARGS__)
+#else
+    inline bool write_trace(char const*)
+    {
+        return false;
+    }
+    inline void clear_trace() {}
+
+#define CORONET_TRACE_EVENT(...) ((void)0)
+#endif
+} // namespace coronet
+
+#endif
@@ -0,0 +1,265 @@
+// coronet - An experimental networking library that supports both the
+//           Universal Model of the Networking TS and the coroutines of
+//           the Coroutines TS.
+//
+//  Copyright Eric Niebler 2017
+//
+//  Use, modification and distribution is subject to the
+//  Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+//
+// Project home: https://github.com/ericniebler/coronet
+//
+#ifndef CORONET_UDP_HPP
+#define CORONET_UDP_HPP
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <system_error>
+
+#include <experimental/buffer>
+#include <experimental/internet>
+
+#if defined(__linux__)
+#include <sys/socket.h>
+#endif
+
+#include <coronet/coronet.hpp>
+#include <coronet/net.hpp>
+
+namespace coronet
+{
+    // A fixed array of datagram slots in one allocation, reused from batch
+    // to batch so that neither receiving nor sending allocates. Each slot
+    // holds up to max_datagram bytes and the endpoint the datagram came
+    // from or goes to. Slots [0, size()) are the datagrams that the last
+    // receive filled in, or that push queued for the next send.
+    struct datagram_batch
+    {
+        using endpoint_type = std::experimental::net::ip::udp::endpoint;
+
+    private:
+        std::size_t capacity_;
+        std::size_t max_datagram_;
+        std::size_t size_ = 0;
+        std::unique_ptr<char[]> data_;
+        std::unique_ptr<std::size_t[]> sizes_;
+        std::unique_ptr<endpoint_type[]> endpoints_;
+#if defined(__linux__)
+        std::unique_ptr<::iovec[]> iovecs_;
+        std::unique_ptr<::mmsghdr[]> headers_;
+#endif
+
+    public:
+        explicit datagram_batch(std::size_t capacity,
+                                std::size_t max_datagram = 2048)
+          : capacity_(capacity)
+          , max_datagram_(max_datagram)
+          , data_(new char[capacity * max_datagram])
+          , sizes_(new std::size_t[capacity]())
+          , endpoints_(new endpoint_type[capacity])
+#if defined(__linux__)
+          , iovecs_(new ::iovec[capacity])
+          , headers_(new ::mmsghdr[capacity])
+#endif
+        {}
+
+        char* _slot(std::size_t i) const noexcept
+        {
+            return data_.get() + i * max_datagram_;
+        }
+        endpoint_type& _endpoint(std::size_t i) noexcept
+        {
+            return endpoints_[i];
+        }
+        void _resize(std::size_t n) noexcept
+        {
+            size_ = n;
+        }
+        void _set_size(std::size_t i, std::size_t bytes) noexcept
+        {
+            sizes_[i] = bytes;
+        }
+#if defined(__linux__)
+        // Message headers for the slots from first on: all of them with
+        // room for a whole datagram to receive, or the queued ones to send.
+        ::mmsghdr* _headers(std::size_t first, bool receive) noexcept
+        {
+            for(auto i = first; i != (receive ? capacity_ : size_); ++i)
+            {
+                iovecs_[i].iov_base = _slot(i);
+                iovecs_[i].iov_len = receive ? max_datagram_ : sizes_[i];
+                auto& h = headers_[i].msg_hdr;
+                h = {};
+                h.msg_iov = &iovecs_[i];
+                h.msg_iovlen = 1;
+                h.msg_name = endpoints_[i].data();
+                h.msg_namelen = static_cast<::socklen_t>(
+                    receive ? endpoints_[i].capacity()
+                            : endpoints_[i].size());
+            }
+            return headers_.get() + first;
+        }
+        void _received(std::size_t n)
+        {
+            for(std::size_t i = 0; i != n; ++i)
+            {
+                sizes_[i] = headers_[i].msg_len;
+                endpoints_[i].resize(headers_[i].msg_hdr.msg_namelen);
+            }
+            size_ = n;
+        }
+#endif
+
+        std::size_t capacity() const noexcept
+        {
+            return capacity_;
+        }
+        std::size_t max_datagram() const noexcept
+        {
+            return max_datagram_;
+        }
+        std::size_t size() const noexcept
+        {
+            return size_;
+        }
+        bool empty() const noexcept
+        {
+            return size_ == 0;
+        }
+        bool full() const noexcept
+        {
+            return size_ == capacity_;
+        }
+        void clear() noexcept
+        {
+            size_ = 0;
+        }
+
+        std::experimental::net::mutable_buffer operator[](
+            std::size_t i) const noexcept
+        {
+            return {_slot(i), sizes_[i]};
+        }
+        endpoint_type const& endpoint(std::size_t i) const noexcept
+        {
+            return endpoints_[i];
+        }
+
+        // Copy a datagram into the next free slot, to be sent to the given
+        // endpoint. Returns false, and queues nothing, if the batch is full
+        // or the datagram does not fit in a slot.
+        bool push(std::experimental::net::const_buffer datagram,
+                  endpoint_type const& to) noexcept
+        {
+            if(full() || datagram.size() > max_datagram_)
+                return false;
+            std::memcpy(_slot(size_), datagram.data(), datagram.size());
+            sizes_[size_] = datagram.size();
+            endpoints_[size_] = to;
+            ++size_;
+            return true;
+        }
+    };
+
+    // Waits until at least one datagram arrives, then fills batch with as
+    // many as are queued on the socket, up to its capacity, with one system
+    // call, and completes with their number. A datagram longer than a slot
+    // is truncated.
+    CO_PP_template(class Socket, class Token)(
+        requires CompletionToken<Token>)
+    auto async_receive_batch(Socket& socket, datagram_batch& batch,
+                             Token token)
+        -> result_t<Token, std::size_t(Socket&, datagram_batch&)>
+    {
+        INITIAL_SUSPEND(token);
+#if defined(__linux__)
+        for(;;)
+        {
+            int const n = ::recvmmsg(
+                socket.native_handle(), batch._headers(0, true),
+                static_cast<unsigned>(batch.capacity()), MSG_DONTWAIT,
+                nullptr);
+            if(n > 0)
+            {
+                batch._received(static_cast<std::size_t>(n));
+                co_return batch.size();
+            }
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+                co_await _make_net_op([&](auto handler) {
+                    socket.async_wait(Socket::wait_read, std::move(handler));
+                });
+            else if(errno != EINTR)
+                throw std::system_error(errno, std::system_category());
+        }
+#else
+        std::size_t const n =
+            co_await _make_net_op<std::size_t>([&](auto handler) {
+                socket.async_receive_from(
+                    std::experimental::net::buffer(
+                        batch._slot(0), batch.max_datagram()),
+                    batch._endpoint(0), std::move(handler));
+            });
+        batch._set_size(0, n);
+        batch._resize(1);
+        co_return batch.size();
+#endif
+    }
+    template<class Socket>
+    auto async_receive_batch(Socket& socket, datagram_batch& batch)
+    {
+        return callable_with_implicit_context{
+            [&socket, &batch](auto token) {
+                return coronet::async_receive_batch(socket, batch, token);
+            }};
+    }
+
+    // Sends every datagram queued in batch, as many per system call as the
+    // socket takes, waiting for it to become writable when it takes none,
+    // and completes with their number. The batch is left as it was; clear
+    // it to reuse it.
+    CO_PP_template(class Socket, class Token)(
+        requires CompletionToken<Token>)
+    auto async_send_batch(Socket& socket, datagram_batch& batch, Token token)
+        -> result_t<Token, std::size_t(Socket&, datagram_batch&)>
+    {
+        INITIAL_SUSPEND(token);
+        std::size_t sent = 0;
+#if defined(__linux__)
+        while(sent < batch.size())
+        {
+            int const n = ::sendmmsg(
+                socket.native_handle(), batch._headers(sent, false),
+                static_cast<unsigned>(batch.size() - sent), MSG_DONTWAIT);
+            if(n > 0)
+                sent += static_cast<std::size_t>(n);
+            else if(errno == EAGAIN || errno == EWOULDBLOCK)
+                co_await _make_net_op([&](auto handler) {
+                    socket.async_wait(Socket::wait_write, std::move(handler));
+                });
+            else if(errno != EINTR)
+                throw std::system_error(errno, std::system_category());
+        }
+#else
+        for(; sent < batch.size(); ++sent)
+            co_await _make_net_op<std::size_t>([&](auto handler) {
+                socket.async_send_to(
+                    batch[sent], batch.endpoint(sent), std::move(handler));
+            });
+#endif
+        co_return sent;
+    }
+    template<class Socket>
+    auto async_send_batch(Socket& socket, datagram_batch& batch)
+    {
+        return callable_with_implicit_context{
+            [&socket, &batch](auto token) {
+                return coronet::async_send_batch(socket, batch, token);
+            }};
+    }
+} // namespace coronet
+
+#endif
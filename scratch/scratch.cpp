@@ -12,6 +12,7 @@
 // Project home: https://github.com/ericniebler/coronet
 //
 
+#include <coronet/any_task.hpp>
 #include <coronet/coronet.hpp>
 #include <cppcoro/sync_wait.hpp>
 #include <cppcoro/task.hpp>
@@ -41,7 +42,21 @@ inline constexpr coronet::async async_stuff2 =
 
 struct S
 {
-    // virtual coronet::callable_task<int> async_member_helper
+    // Async members can be virtual if they take a type-erased token.
+    virtual coronet::any_task<int> async_member_helper(
+        int arg, coronet::any_token token)
+    {
+        INITIAL_SUSPEND(token);
+        co_return co_await async_stuff2(arg + member);
+    }
+    auto async_member_helper(int arg)
+    {
+        return coronet::callable_with_implicit_context{
+            [this, arg](auto token) {
+                return this->async_member_helper(
+                    arg, coronet::any_token{token});
+            }};
+    }
 
     CO_PP_template(class Token)(
         requires coronet::CompletionToken<Token>)
@@ -85,6 +100,16 @@ main()
     i = cppcoro::sync_wait(s.async_member(20, coronet::yield(e)));
     std::printf("hello coroutine member! %d\n", i);
 
+    // Call a virtual async member
+    i = cppcoro::sync_wait(
+        s.async_member_helper(20, coronet::any_token{coronet::yield(e)}));
+    std::printf("hello virtual coroutine member! %d\n", i);
+
     g.reset();
     t.join();
+
+    // In the scratch_traced build, see where each coroutine suspended and
+    // resumed by loading this file into chrome://tracing.
+    if(coronet::write_trace("scratch.trace.json"))
+        std::printf("wrote scratch.trace.json\n");
 }